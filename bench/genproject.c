@@ -0,0 +1,289 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+/**
+ * Parameters of the generated project.
+ */
+static struct project {
+    /// number of translation units (non main sources)
+    long tus;
+    /// number of header files
+    long headers;
+    /// number of headers each translation unit includes
+    long fanout;
+    /// number of sources with a `main()` function
+    long mains;
+    /// number of tests, each with a .input and .data companion
+    long tests;
+    /// seed for the include pattern
+    unsigned long seed;
+    /// output directory
+    const char *dir;
+} Project = {
+    .tus = 100,
+    .headers = 20,
+    .fanout = 5,
+    .mains = 2,
+    .tests = 2,
+    .seed = 1,
+};
+
+static void usage(FILE *fp, const char *program_name)
+{
+    fprintf(fp, "generate a synthetic C project for benchmarking autocar\n"
+            "%s [options] <directory>\n"
+            "options:\n"
+            "-t <number> - number of translation units (default: %ld)\n"
+            "-H <number> - number of headers (default: %ld)\n"
+            "-f <number> - headers included per translation unit"
+                " (default: %ld)\n"
+            "-m <number> - number of main executables (default: %ld)\n"
+            "-T <number> - number of tests (default: %ld)\n"
+            "-s <number> - seed of the include pattern (default: %lu)\n",
+            program_name, Project.tus, Project.headers, Project.fanout,
+            Project.mains, Project.tests, Project.seed);
+}
+
+/**
+ * @brief Simple linear congruential generator, the include pattern only needs
+ * to be deterministic, not random.
+ */
+static unsigned long next_random(void)
+{
+    Project.seed = Project.seed * 6364136223846793005UL + 1442695040888963407UL;
+    return Project.seed >> 33;
+}
+
+static FILE *open_file(const char *fmt, long n)
+{
+    char path[4096];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), fmt, Project.dir, n);
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "fopen '%s': %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    return fp;
+}
+
+static void make_directory(const char *name)
+{
+    char path[4096];
+
+    snprintf(path, sizeof(path), "%s/%s", Project.dir, name);
+    if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+        fprintf(stderr, "mkdir '%s': %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void write_headers(void)
+{
+    FILE *fp;
+
+    for (long h = 0; h < Project.headers; h++) {
+        fp = open_file("%s/src/h%ld.h", h);
+        fprintf(fp, "#ifndef H%ld_H\n"
+                "#define H%ld_H\n"
+                "\n"
+                "static inline int h%ld(int x)\n"
+                "{\n"
+                "    return x * %ld + 1;\n"
+                "}\n"
+                "\n"
+                "#endif\n", h, h, h, h + 1);
+        fclose(fp);
+    }
+}
+
+static void write_units(void)
+{
+    FILE *fp;
+    long num_includes;
+    long *includes;
+
+    num_includes = Project.fanout < Project.headers ?
+        Project.fanout : Project.headers;
+    includes = malloc(sizeof(*includes) * (num_includes + 1));
+    for (long t = 0; t < Project.tus; t++) {
+        fp = open_file("%s/src/tu%ld.c", t);
+        for (long i = 0; i < num_includes; i++) {
+            /* pick distinct headers, the pattern stays the same for a seed */
+            bool dup;
+
+            do {
+                includes[i] = next_random() % Project.headers;
+                dup = false;
+                for (long j = 0; j < i; j++) {
+                    if (includes[j] == includes[i]) {
+                        dup = true;
+                        break;
+                    }
+                }
+            } while (dup);
+            fprintf(fp, "#include \"h%ld.h\"\n", includes[i]);
+        }
+        fprintf(fp, "\n"
+                "int tu%ld(int x)\n"
+                "{\n"
+                "    int r = x;\n"
+                "\n", t);
+        for (long i = 0; i < num_includes; i++) {
+            fprintf(fp, "    r += h%ld(r);\n", includes[i]);
+        }
+        fprintf(fp, "    return r;\n"
+                "}\n");
+        fclose(fp);
+    }
+    free(includes);
+}
+
+static void write_mains(void)
+{
+    FILE *fp;
+
+    for (long m = 0; m < Project.mains; m++) {
+        fp = open_file("%s/src/main%ld.c", m);
+        fprintf(fp, "#include <stdio.h>\n\n");
+        if (Project.tus > 0) {
+            fprintf(fp, "int tu%ld(int x);\n\n", m % Project.tus);
+        }
+        fprintf(fp, "int main(void)\n"
+                "{\n");
+        if (Project.tus > 0) {
+            fprintf(fp, "    printf(\"%%d\\n\", tu%ld(%ld));\n",
+                    m % Project.tus, m);
+        }
+        fprintf(fp, "    return 0;\n"
+                "}\n");
+        fclose(fp);
+    }
+}
+
+static void write_tests(void)
+{
+    FILE *fp;
+
+    for (long t = 0; t < Project.tests; t++) {
+        fp = open_file("%s/tests/test%ld.c", t);
+        fprintf(fp, "#include <stdio.h>\n"
+                "\n"
+                "int main(void)\n"
+                "{\n"
+                "    int c;\n"
+                "\n"
+                "    printf(\"test %ld\\n\");\n"
+                "    while (c = getchar(), c != EOF) {\n"
+                "        putchar(c);\n"
+                "    }\n"
+                "    return 0;\n"
+                "}\n", t);
+        fclose(fp);
+
+        fp = open_file("%s/tests/test%ld.input", t);
+        fprintf(fp, "input %ld\n", t);
+        fclose(fp);
+
+        fp = open_file("%s/tests/test%ld.data", t);
+        fprintf(fp, "test %ld\ninput %ld\n", t, t);
+        fclose(fp);
+    }
+}
+
+static void write_config(void)
+{
+    FILE *fp;
+
+    fp = open_file("%s/autocar.conf", 0);
+    fprintf(fp, "CC = gcc\n"
+            "C_FLAGS = -O0\n"
+            "C_LIBS =\n"
+            "BUILD = build\n"
+            "\n"
+            "add src\n");
+    if (Project.tests > 0) {
+        fprintf(fp, "add -t tests\n");
+    }
+    fclose(fp);
+}
+
+static bool parse_number(const char *s, long *pnum)
+{
+    char *end;
+
+    errno = 0;
+    *pnum = strtol(s, &end, 0);
+    return errno == 0 && end != s && end[0] == '\0' && *pnum >= 0;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    long *num;
+    long seed;
+
+    while (opt = getopt(argc, argv, "t:H:f:m:T:s:h"), opt != -1) {
+        switch (opt) {
+        case 't':
+            num = &Project.tus;
+            break;
+        case 'H':
+            num = &Project.headers;
+            break;
+        case 'f':
+            num = &Project.fanout;
+            break;
+        case 'm':
+            num = &Project.mains;
+            break;
+        case 'T':
+            num = &Project.tests;
+            break;
+        case 's':
+            if (!parse_number(optarg, &seed)) {
+                fprintf(stderr, "invalid seed '%s'\n", optarg);
+                return 1;
+            }
+            Project.seed = seed;
+            continue;
+        case 'h':
+            usage(stdout, argv[0]);
+            return 0;
+        default:
+            usage(stderr, argv[0]);
+            return 1;
+        }
+        if (!parse_number(optarg, num)) {
+            fprintf(stderr, "invalid number '%s' for -%c\n", optarg, opt);
+            return 1;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        usage(stderr, argv[0]);
+        return 1;
+    }
+    Project.dir = argv[optind];
+
+    if (mkdir(Project.dir, 0755) == -1 && errno != EEXIST) {
+        fprintf(stderr, "mkdir '%s': %s\n", Project.dir, strerror(errno));
+        return 1;
+    }
+    make_directory("src");
+    make_directory("tests");
+
+    write_headers();
+    write_units();
+    write_mains();
+    write_tests();
+    write_config();
+    return 0;
+}
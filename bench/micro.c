@@ -0,0 +1,451 @@
+/* all sources of autocar (except the ones with a `main()`) are included here so
+ * that the static functions can be measured directly, the list is generated by
+ * the Makefile */
+#include "micro_sources.h"
+
+#include <time.h>
+
+/**
+ * Number of calls to any allocation function.
+ *
+ * The allocation functions of glibc are replaced below to count them, glibc
+ * internally (`strdup()`, `getline()`...) also goes through these.
+ */
+static size_t Allocations;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+    Allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    Allocations++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    Allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+/// minimum time a single benchmark should run for (nanoseconds)
+static long long MinTime = 200 * 1000 * 1000LL;
+
+/// if only benchmarks containing this string should run
+static const char *Filter;
+
+static long long get_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Runs `proc` with increasing number of iterations until it takes at
+ * least `MinTime` and prints the result.
+ *
+ * @param name      Name of the benchmark.
+ * @param proc      Benchmark procedure, it gets `data` and the number of
+ *                  iterations it should run.
+ * @param data      Data to pass to `proc`.
+ * @param bytes     Number of bytes processed per operation, used for the
+ *                  throughput, if this is 0, operations per second are shown.
+ */
+static void measure(const char *name, void (*proc)(void *data, size_t n),
+        void *data, size_t bytes)
+{
+    size_t n;
+    long long start, time;
+    size_t allocs;
+    double ns_op;
+
+    if (Filter != NULL && strstr(name, Filter) == NULL) {
+        return;
+    }
+
+    for (n = 1;; n *= 2) {
+        allocs = Allocations;
+        start = get_time_ns();
+        proc(data, n);
+        time = get_time_ns() - start;
+        allocs = Allocations - allocs;
+        if (time >= MinTime || n >= ((size_t) 1 << 40)) {
+            break;
+        }
+    }
+
+    ns_op = (double) time / n;
+    printf("%-40s %12zu %14.1f ns/op %10.2f allocs/op", name, n, ns_op,
+            (double) allocs / n);
+    if (bytes > 0) {
+        printf(" %12.1f MB/s\n", bytes / ns_op * 1e9 / (1024 * 1024));
+    } else {
+        printf(" %12.0f op/s\n", 1e9 / ns_op);
+    }
+}
+
+static void bench_relative_path(void *data, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        free(get_relative_path(data));
+    }
+}
+
+static void bench_extension_type(void *data, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        (void) get_extension_type(data);
+    }
+}
+
+/**
+ * Paths are constructed so that increasing indices give sorted paths.
+ */
+static void make_path(char *buf, size_t i)
+{
+    sprintf(buf, "d%04zu/f%08zu.c", i / 1000, i);
+}
+
+struct file_bench {
+    /// number of files in the list
+    size_t num_files;
+    /// index of the next path to use
+    size_t next;
+};
+
+static void bench_search_file(void *data, size_t n)
+{
+    struct file_bench *fb = data;
+    char path[64];
+
+    for (size_t i = 0; i < n; i++) {
+        make_path(path, 2 * fb->next);
+        fb->next = (fb->next + 7919) % fb->num_files;
+        if (search_file(path, NULL) == NULL) {
+            abort();
+        }
+    }
+}
+
+static void bench_search_file_miss(void *data, size_t n)
+{
+    struct file_bench *fb = data;
+    char path[64];
+
+    for (size_t i = 0; i < n; i++) {
+        make_path(path, 2 * fb->next + 1);
+        fb->next = (fb->next + 7919) % fb->num_files;
+        if (search_file(path, NULL) != NULL) {
+            abort();
+        }
+    }
+}
+
+static void bench_add_file_existing(void *data, size_t n)
+{
+    struct file_bench *fb = data;
+    char path[64];
+
+    for (size_t i = 0; i < n; i++) {
+        make_path(path, 2 * fb->next);
+        fb->next = (fb->next + 7919) % fb->num_files;
+        (void) add_file(path, -1, 0);
+    }
+}
+
+/**
+ * Adds a file that is not in the list yet and then removes it again (the same
+ * way `delete` does it), so the size of the list stays the same.
+ */
+static void bench_add_file_new(void *data, size_t n)
+{
+    struct file_bench *fb = data;
+    char path[64];
+    struct file *file;
+    size_t index;
+
+    for (size_t i = 0; i < n; i++) {
+        make_path(path, 2 * fb->next + 1);
+        fb->next = (fb->next + 7919) % fb->num_files;
+        file = add_file(path, -1, 0);
+        (void) search_file(file->path, &index);
+        remove_file(index);
+    }
+}
+
+/**
+ * Checks the type and flags of every file like the build phases do.
+ */
+static void bench_scan_files(void *data, size_t n)
+{
+    size_t *pcount = data;
+    struct file *file;
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t f = 0; f < Files.num; f++) {
+            file = Files.ptr[f];
+            if (file->type == EXT_TYPE_SOURCE && !(file->flags & FLAG_IS_TEST)) {
+                (*pcount)++;
+            }
+        }
+    }
+}
+
+static void run_file_benches(void)
+{
+    static const size_t sizes[] = { 1000, 10000, 100000, 1000000 };
+    struct file_bench fb;
+    char name[64];
+    char path[64];
+    size_t count = 0;
+
+    for (size_t s = 0; s < ARRAY_SIZE(sizes); s++) {
+        fb.num_files = sizes[s];
+        fb.next = 0;
+
+        /* only even indices are in the list, odd ones are misses */
+        clear_files();
+        for (size_t i = 0; i < fb.num_files; i++) {
+            make_path(path, 2 * i);
+            (void) add_file(path, -1, 0);
+        }
+
+        snprintf(name, sizeof(name), "search_file/hit/%zu", sizes[s]);
+        measure(name, bench_search_file, &fb, 0);
+        snprintf(name, sizeof(name), "search_file/miss/%zu", sizes[s]);
+        measure(name, bench_search_file_miss, &fb, 0);
+        snprintf(name, sizeof(name), "add_file/existing/%zu", sizes[s]);
+        measure(name, bench_add_file_existing, &fb, 0);
+        snprintf(name, sizeof(name), "add_file/new+delete/%zu", sizes[s]);
+        measure(name, bench_add_file_new, &fb, 0);
+        snprintf(name, sizeof(name), "scan_files/%zu", sizes[s]);
+        measure(name, bench_scan_files, &count, 0);
+    }
+    clear_files();
+}
+
+struct directive_bench {
+    char *text;
+    size_t len;
+};
+
+static void bench_make_directive(void *data, size_t n)
+{
+    struct directive_bench *db = data;
+    FILE *fp;
+    char **paths;
+    size_t num_paths;
+
+    for (size_t i = 0; i < n; i++) {
+        fp = fmemopen(db->text, db->len, "r");
+        parse_make_directive(fp, &paths, &num_paths);
+        fclose(fp);
+        for (size_t p = 0; p < num_paths; p++) {
+            free(paths[p]);
+        }
+        free(paths);
+    }
+}
+
+static void run_directive_bench(size_t num_headers)
+{
+    struct directive_bench db;
+    FILE *fp;
+    char name[64];
+
+    fp = open_memstream(&db.text, &db.len);
+    fprintf(fp, "build/src/long_file_name.o: src/long_file_name.c");
+    for (size_t i = 0; i < num_headers; i++) {
+        fprintf(fp, " \\\n include/some/directory/header_%zu.h", i);
+    }
+    fputc('\n', fp);
+    fclose(fp);
+
+    snprintf(name, sizeof(name), "parse_make_directive/%zu", num_headers);
+    measure(name, bench_make_directive, &db, db.len);
+    free(db.text);
+}
+
+static void bench_advance_state(void *data, size_t n)
+{
+    const char *line = data;
+    size_t len;
+    struct arena arena;
+    struct state st;
+
+    len = strlen(line);
+    char buf[len + 1];
+
+    memset(&arena, 0, sizeof(arena));
+    for (size_t i = 0; i < n; i++) {
+        memcpy(buf, line, len + 1);
+        memset(&st, 0, sizeof(st));
+        st.state = STATE_REGULAR;
+        st.arena = &arena;
+        st.line = buf;
+        advance_state(&st);
+        reset_arena(&arena);
+    }
+    clear_arena(&arena);
+}
+
+static void run_advance_state_benches(void)
+{
+    static const char *flags[] = {
+        "-std=gnu99", "-Wall", "-Wextra", "-Werror", "-Wpedantic", "-g",
+        "-fsanitize=address", "-D_GNU_SOURCE", "-Iinclude", "-O2",
+    };
+    FILE *fp;
+    char *line;
+    size_t len;
+
+    set_conf("bench_flags", flags, ARRAY_SIZE(flags), SET_CONF_MODE_SET);
+
+    fp = open_memstream(&line, &len);
+    fputs("echo", fp);
+    for (size_t i = 0; i < 100; i++) {
+        fprintf(fp, " argument_%zu \"quoted %zu\"", i, i);
+    }
+    fclose(fp);
+    measure("advance_state/plain", bench_advance_state, line, len);
+    free(line);
+
+    fp = open_memstream(&line, &len);
+    fputs("echo", fp);
+    for (size_t i = 0; i < 100; i++) {
+        fputs(" $BENCH_FLAGS", fp);
+    }
+    fclose(fp);
+    measure("advance_state/expand", bench_advance_state, line, len);
+    free(line);
+
+    fp = open_memstream(&line, &len);
+    fputs("echo", fp);
+    for (size_t i = 0; i < 100; i++) {
+        fputs(" prefix$BENCH_FLAGS", fp);
+    }
+    fclose(fp);
+    measure("advance_state/expand_in_arg", bench_advance_state, line, len);
+    free(line);
+}
+
+static void bench_object_has_main(void *data, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (!object_has_main(data)) {
+            abort();
+        }
+    }
+}
+
+static void run_object_benches(void)
+{
+    static const size_t sizes[] = { 10, 1000, 10000 };
+    char dir[] = "/tmp/autocar-micro-XXXXXX";
+    char *src, *obj, *cmd;
+    char name[64];
+    FILE *fp;
+    struct stat st;
+
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "mkdtemp: %s\n", strerror(errno));
+        return;
+    }
+    src = sasprintf("%s/big.c", dir);
+    obj = sasprintf("%s/big.o", dir);
+    for (size_t s = 0; s < ARRAY_SIZE(sizes); s++) {
+        fp = fopen(src, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "fopen '%s': %s\n", src, strerror(errno));
+            break;
+        }
+        for (size_t i = 0; i < sizes[s]; i++) {
+            fprintf(fp, "int function_%zu(int x) { return x + %zu; }\n", i, i);
+        }
+        fprintf(fp, "int main(void) { return function_0(0); }\n");
+        fclose(fp);
+
+        cmd = sasprintf("gcc -c %s -o %s", src, obj);
+        if (system(cmd) != 0) {
+            fprintf(stderr, "could not compile '%s'\n", src);
+            free(cmd);
+            break;
+        }
+        free(cmd);
+        stat(obj, &st);
+
+        snprintf(name, sizeof(name), "object_has_main/%zu", sizes[s]);
+        measure(name, bench_object_has_main, obj, st.st_size);
+    }
+    unlink(src);
+    unlink(obj);
+    rmdir(dir);
+    free(src);
+    free(obj);
+}
+
+int main(int argc, char **argv)
+{
+    char *cwd;
+    char *abs_path;
+    int opt;
+
+    while (opt = getopt(argc, argv, "t:h"), opt != -1) {
+        switch (opt) {
+        case 't':
+            MinTime = strtoll(optarg, NULL, 0) * 1000 * 1000;
+            break;
+        default:
+            fprintf(opt == 'h' ? stdout : stderr,
+                    "%s [-t <milliseconds per benchmark>] [filter]\n",
+                    argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind < argc) {
+        Filter = argv[optind];
+    }
+
+    set_default_conf();
+    check_conf();
+
+    measure("get_relative_path/relative", bench_relative_path,
+            "src/some/../deeper/./directory/file.c", 0);
+    cwd = getcwd(NULL, 0);
+    abs_path = sasprintf("%s/src/some/../deeper//directory/file.c", cwd);
+    measure("get_relative_path/absolute", bench_relative_path, abs_path, 0);
+    free(abs_path);
+    free(cwd);
+
+    measure("get_extension_type/source", bench_extension_type,
+            "src/directory/file.c", 0);
+    measure("get_extension_type/other", bench_extension_type,
+            "src/directory/image.png", 0);
+
+    run_file_benches();
+
+    run_directive_bench(10);
+    run_directive_bench(1000);
+
+    run_advance_state_benches();
+
+    run_object_benches();
+
+    clear_conf();
+    return 0;
+}
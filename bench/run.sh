@@ -0,0 +1,156 @@
+#!/bin/bash
+
+# Benchmarks autocar on a synthetic project made by `genproject`.
+#
+# Measures (all in milliseconds):
+# startup         - `autocar` without config and without any files
+# cold_build      - first cycle on the fresh project
+# noop            - cycle where nothing changed
+# noop_warm       - cycle where nothing changed within a running autocar (what
+#                   the watch mode does every interval)
+# header_touch    - cycle after touching a single header
+# source_touch    - cycle after touching a single source
+#
+# The result is a single JSON object written to stdout (or the file given with
+# -o). Every option that is not listed below is passed to `genproject`.
+
+set -e
+shopt -s inherit_errexit
+
+bench_dir="$(cd "$(dirname "$0")" && pwd)"
+autocar="${AUTOCAR:-$bench_dir/../bulid/src/main}"
+genproject="${GENPROJECT:-$bench_dir/genproject}"
+repeat=5
+output=
+keep=
+gen_args=()
+
+usage() {
+    echo "usage: $0 [-a autocar] [-r repeat] [-o output] [-k] [genproject options]"
+    echo "-a <path> - autocar executable (default: $autocar)"
+    echo "-r <n>    - repetitions of the warm measurements (default: $repeat)"
+    echo "-o <path> - write the results to a file instead of stdout"
+    echo "-k        - keep the generated project"
+}
+
+while [ $# -gt 0 ] ; do
+    case "$1" in
+    -a) autocar="$2" ; shift 2 ;;
+    -r) repeat="$2" ; shift 2 ;;
+    -o) output="$2" ; shift 2 ;;
+    -k) keep=1 ; shift ;;
+    -h) usage ; exit 0 ;;
+    -[tHfmTs]) gen_args+=( "$1" "$2" ) ; shift 2 ;;
+    *) usage >&2 ; exit 1 ;;
+    esac
+done
+
+autocar="$(cd "$(dirname "$autocar")" && pwd)/$(basename "$autocar")"
+if [ ! -x "$autocar" ] ; then
+    echo "autocar executable '$autocar' not found, build autocar first" >&2
+    exit 1
+fi
+if [ ! -x "$genproject" ] ; then
+    echo "'$genproject' not found, run \`make -C bench\` first" >&2
+    exit 1
+fi
+
+project="$(mktemp -d)"
+if [ -z "$keep" ] ; then
+    trap 'rm -rf "$project"' EXIT
+else
+    echo "keeping project at: $project" >&2
+fi
+
+"$genproject" "${gen_args[@]}" "$project"
+cd "$project"
+
+# prints the time in milliseconds it took to run the given command
+time_ms() {
+    local start end
+
+    start=$(date +%s%N)
+    "$@" > /dev/null 2>&1 || { echo "'$*' failed in $project" >&2 ; exit 1 ; }
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000 ))
+}
+
+# median of all arguments (microseconds), printed as milliseconds
+median_ms() {
+    local sorted
+
+    sorted=( $(printf '%s\n' "$@" | sort -n) )
+    printf '%d.%03d' $(( sorted[$# / 2] / 1000 )) $(( sorted[$# / 2] % 1000 ))
+}
+
+# autocar compares timestamps in nanoseconds, but the kernel only advances them
+# once per clock tick, so a file touched right after a build can get the same
+# time as its object, move all files into the past so the next touch is always
+# strictly newer
+backdate() {
+    find . -exec touch -h -d "@$(( $(date +%s) - 100 ))" {} +
+}
+
+# runs the command after `setup` for `repeat` times and prints the median
+measure() {
+    local setup="$1" times=() t
+
+    shift
+    for (( i = 0; i < repeat; i++ )) ; do
+        $setup
+        t=$(time_ms "$@")
+        times+=( "$t" )
+    done
+    median_ms "${times[@]}"
+}
+
+nothing() {
+    :
+}
+
+touch_header() {
+    backdate
+    touch src/h0.h
+}
+
+touch_source() {
+    backdate
+    touch src/tu0.c
+}
+
+startup=$(measure nothing "$autocar" -n -i 0)
+cold_build=$(time_ms "$autocar" -i 0)
+cold_build=$(median_ms "$cold_build")
+noop=$(measure nothing "$autocar" -i 0)
+
+# the difference between running `repeat` extra cycles from a config and none
+{
+    echo "source autocar.conf"
+    for (( i = 0; i < repeat; i++ )) ; do
+        echo "build --collect"
+    done
+} > cycles.conf
+single=$(time_ms "$autocar" -i 0)
+cycles=$(time_ms "$autocar" -c cycles.conf -i 0)
+rm cycles.conf
+noop_warm=$(( cycles > single ? (cycles - single) / repeat : 0 ))
+noop_warm=$(median_ms "$noop_warm")
+
+header_touch=$(measure touch_header "$autocar" -i 0)
+source_touch=$(measure touch_source "$autocar" -i 0)
+
+count() {
+    find "$1" -name "$2" | wc -l
+}
+
+result=$(printf '{"tus": %d, "headers": %d, "mains": %d, "tests": %d, "files": %d, "repeat": %d, "startup_ms": %s, "cold_build_ms": %s, "noop_ms": %s, "noop_warm_ms": %s, "header_touch_ms": %s, "source_touch_ms": %s}' \
+    $(count src 'tu*.c') $(count src 'h*.h') $(count src 'main*.c') \
+    $(count tests '*.c') $(find src tests -type f | wc -l) "$repeat" \
+    "$startup" "$cold_build" "$noop" "$noop_warm" "$header_touch" "$source_touch")
+
+if [ -n "$output" ] ; then
+    cd - > /dev/null
+    echo "$result" > "$output"
+else
+    echo "$result"
+fi
@@ -1,4 +1,7 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,18 +10,33 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 
-#define ARRAY_SIZE(a) (sizeof(a)/sizeof(*(a)))
+const char *CC[] = { "gcc", NULL };
+const char *C_FLAGS[] = { "-std=gnu99", "-D_GNU_SOURCE", "-Wall", "-Wextra", "-Werror", "-Wpedantic", "-g", "-fsanitize=address", NULL };
+const char *C_LIBS[] = { "-lm", "-lbfd", "-lreadline", NULL };
+const char *SOURCES[] = { "src/arena.c", "src/args.c", "src/cache.c", "src/cli.c", "src/cmd.c", "src/compdb.c", "src/conf.c", "src/daemon.c", "src/eval.c", "src/file.c", "src/ignore.c", "src/jobserver.c", "src/memo.c", "src/meta.c", "src/pressure.c", "src/protocol.c", "src/salloc.c", "src/schedule.c", "src/sha256.c", "src/util.c", "src/walk.c", NULL };
+const char *MAIN_SOURCES[] = { "src/cache_server.c", "src/main.c", "src/worker.c", "tests/lol.c", NULL };
+
+const char *OBJECTS[] = { "bulid/src/arena.o", "bulid/src/args.o", "bulid/src/cache.o", "bulid/src/cli.o", "bulid/src/cmd.o", "bulid/src/compdb.o", "bulid/src/conf.o", "bulid/src/daemon.o", "bulid/src/eval.o", "bulid/src/file.o", "bulid/src/ignore.o", "bulid/src/jobserver.o", "bulid/src/memo.o", "bulid/src/meta.o", "bulid/src/pressure.o", "bulid/src/protocol.o", "bulid/src/salloc.o", "bulid/src/schedule.o", "bulid/src/sha256.o", "bulid/src/util.o", "bulid/src/walk.o", NULL };
+const char *MAIN_OBJECTS[] = { "bulid/src/cache_server.o", "bulid/src/main.o", "bulid/src/worker.o", "bulid/tests/lol.o", NULL };
 
-const char *CC = "gcc";
-const char *C_FLAGS[] = { "-std=gnu99", "-Wall", "-Wextra", "-Werror", "-Wpedantic", "-g", "-fsanitize=address" };
-const char *C_LIBS[] = { "-lm", "-lbfd", "-lreadline" };
-const char *SOURCES[] = { "src/args.c", "src/cli.c", "src/cmd.c", "src/conf.c", "src/eval.c", "src/file.c", "src/salloc.c", "src/util.c" };
-const char *MAIN_SOURCES[] = { "src/main.c", "tests/lol.c" };
+const char *MAIN_EXECUTABLES[] = { "bulid/src/cache_server", "bulid/src/main", "bulid/src/worker", "bulid/tests/lol", NULL };
 
-const char *OBJECTS[] = { "bulid/src/args.o", "bulid/src/cli.o", "bulid/src/cmd.o", "bulid/src/conf.o", "bulid/src/eval.o", "bulid/src/file.o", "bulid/src/salloc.o", "bulid/src/util.o" };
-const char *MAIN_OBJECTS[] = { "bulid/src/main.o", "bulid/tests/lol.o" };
+/* maximum number of children running at once */
+long Jobs;
+/* number of children running right now */
+long Running;
+/* set when any child failed, no new children are started after that */
+bool Failed;
+
+size_t count(const char **a)
+{
+    size_t n = 0;
 
-const char *MAIN_EXECUTABLES[] = { "bulid/src/main", "bulid/tests/lol" };
+    while (a[n] != NULL) {
+        n++;
+    }
+    return n;
+}
 
 void make_directory(const char *path)
 {
@@ -33,7 +51,7 @@ void make_directory(const char *path)
         if (mkdir(p, 0755) == -1) {
             if (errno != EEXIST) {
                 printf("mkdir '%s': %s\n", p, strerror(errno));
-                abort();
+                exit(1);
             }
         } else {
             printf("mkdir %s\n", p);
@@ -43,87 +61,230 @@ void make_directory(const char *path)
     }
 }
 
+/* gets the modification time in nanoseconds or -1 if the file is missing */
+long long get_mtime(const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) == -1) {
+        return -1;
+    }
+    return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+/* checks the object against its source and the headers listed in the
+ * dependency file the compiler wrote the last time */
+bool needs_compile(const char *source, const char *object, const char *deps)
+{
+    long long mtime, m;
+    FILE *fp;
+    char path[4096];
+    size_t len;
+    int c;
+    bool result;
+
+    mtime = get_mtime(object);
+    if (mtime < 0 || get_mtime(source) > mtime) {
+        return true;
+    }
+    fp = fopen(deps, "r");
+    if (fp == NULL) {
+        return true;
+    }
+    /* skip the target */
+    do {
+        c = fgetc(fp);
+    } while (c != EOF && c != ':');
+    result = c == EOF;
+    len = 0;
+    while (!result && c != EOF) {
+        c = fgetc(fp);
+        if (c == '\\') {
+            c = fgetc(fp);
+            if (c == '\n') {
+                continue;
+            }
+        } else if (c == EOF || c == ' ' || c == '\t' || c == '\n') {
+            if (len > 0) {
+                path[len] = '\0';
+                len = 0;
+                m = get_mtime(path);
+                if (m < 0 || m > mtime) {
+                    result = true;
+                }
+            }
+            if (c == '\n') {
+                break;
+            }
+            continue;
+        }
+        if (len == sizeof(path) - 1) {
+            result = true;
+        } else {
+            path[len++] = c;
+        }
+    }
+    fclose(fp);
+    return result;
+}
+
+/* waits for any child to finish */
+void wait_child(void)
+{
+    int wstatus;
+
+    if (waitpid(-1, &wstatus, 0) == -1) {
+        printf("waitpid: %s\n", strerror(errno));
+        exit(1);
+    }
+    Running--;
+    if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+        Failed = true;
+    }
+}
+
+/* waits for all children to finish and stops if any of them failed */
+void wait_children(void)
+{
+    while (Running > 0) {
+        wait_child();
+    }
+    if (Failed) {
+        printf("build failed\n");
+        exit(1);
+    }
+}
+
+/* starts a child once there is a free slot */
 void run_executable(char **args)
 {
     int pid;
-    int wstatus;
+
+    while (Running >= Jobs) {
+        wait_child();
+    }
+    if (Failed) {
+        wait_children();
+    }
 
     for (char **a = args; a[0] != NULL; a++) {
         printf("%s ", a[0]);
     }
     printf("\n");
+    fflush(stdout);
 
     pid = fork();
     if (pid == -1) {
         printf("fork: %s\n", strerror(errno));
-        abort();
+        Failed = true;
+        wait_children();
     }
     if (pid == 0) {
-        if (execvp(args[0], args) < 0) {
-            printf("execvp: %s\n", strerror(errno));
-            abort();
-        }
-    } else {
-        waitpid(pid, &wstatus, 0);
-        if (WEXITSTATUS(wstatus) != 0) {
-            printf("`%s` returned: %d\n", args[0], wstatus);
-            abort();
-        }
+        execvp(args[0], args);
+        printf("execvp: %s\n", strerror(errno));
+        _exit(127);
     }
+    Running++;
 }
 
-int main(void)
+void compile(char **args, size_t num_flags, const char *source,
+        const char *object)
 {
-    char *args[1 + ARRAY_SIZE(C_FLAGS) + 1 + ARRAY_SIZE(OBJECTS) + 3 +
-        ARRAY_SIZE(C_LIBS) + 1];
+    char deps[strlen(object) + sizeof(".d")];
 
-    args[0] = (char*) CC;
-    for (size_t i = 0; i < ARRAY_SIZE(C_FLAGS); i++) {
-        args[1 + i] = (char*) C_FLAGS[i];
+    strcpy(deps, object);
+    strcat(deps, ".d");
+    if (!needs_compile(source, object, deps)) {
+        return;
     }
+    make_directory(object);
+    args[3 + num_flags] = deps;
+    args[5 + num_flags] = (char*) source;
+    args[7 + num_flags] = (char*) object;
+    run_executable(args);
+}
 
-    args[1 + ARRAY_SIZE(C_FLAGS)] = (char*) "-c";
-    args[3 + ARRAY_SIZE(C_FLAGS)] = (char*) "-o";
-    args[5 + ARRAY_SIZE(C_FLAGS)] = (char*) NULL;
-    for (size_t i = 0; i < ARRAY_SIZE(SOURCES); i++) {
-        args[2 + ARRAY_SIZE(C_FLAGS)] = (char*) SOURCES[i];
-        args[4 + ARRAY_SIZE(C_FLAGS)] = (char*) OBJECTS[i];
-        make_directory(OBJECTS[i]);
-        run_executable(args);
+int main(int argc, char **argv)
+{
+    size_t num_flags = count(C_FLAGS);
+    size_t num_libs = count(C_LIBS);
+    size_t num_objects = count(OBJECTS);
+    char *args[1 + num_flags + 1 + num_objects + 6 + num_libs + 1];
+    const char *jobs;
+    long long mtime, m;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = argv[++i];
+        } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2] != '\0') {
+            jobs = &argv[i][2];
+        } else {
+            printf("usage: %s [-j jobs]\n", argv[0]);
+            return 1;
+        }
+        Jobs = strtol(jobs, NULL, 10);
+        if (Jobs <= 0) {
+            printf("invalid number of jobs: %s\n", jobs);
+            return 1;
+        }
+    }
+    if (Jobs <= 0) {
+        Jobs = sysconf(_SC_NPROCESSORS_ONLN);
+        if (Jobs <= 0) {
+            Jobs = 1;
+        }
     }
 
-    for (size_t i = 0; i < ARRAY_SIZE(MAIN_SOURCES); i++) {
-        args[2 + ARRAY_SIZE(C_FLAGS)] = (char*) MAIN_SOURCES[i];
-        args[4 + ARRAY_SIZE(C_FLAGS)] = (char*) MAIN_OBJECTS[i];
-        make_directory(MAIN_OBJECTS[i]);
-        run_executable(args);
+    args[0] = (char*) CC[0];
+    for (size_t i = 0; i < num_flags; i++) {
+        args[1 + i] = (char*) C_FLAGS[i];
     }
 
-    if (ARRAY_SIZE(MAIN_OBJECTS) == 0) {
+    args[1 + num_flags] = (char*) "-MMD";
+    args[2 + num_flags] = (char*) "-MF";
+    args[4 + num_flags] = (char*) "-c";
+    args[6 + num_flags] = (char*) "-o";
+    args[8 + num_flags] = (char*) NULL;
+    for (size_t i = 0; SOURCES[i] != NULL; i++) {
+        compile(args, num_flags, SOURCES[i], OBJECTS[i]);
+    }
+    for (size_t i = 0; MAIN_SOURCES[i] != NULL; i++) {
+        compile(args, num_flags, MAIN_SOURCES[i], MAIN_OBJECTS[i]);
+    }
+    wait_children();
+
+    if (MAIN_OBJECTS[0] == NULL) {
         printf("no main objects\n");
         return 0;
     }
 
-    for (size_t i = 0; i < ARRAY_SIZE(OBJECTS); i++) {
-        args[1 + ARRAY_SIZE(C_FLAGS) + i] = (char*) OBJECTS[i];
+    mtime = -1;
+    for (size_t i = 0; i < num_objects; i++) {
+        args[1 + num_flags + i] = (char*) OBJECTS[i];
+        m = get_mtime(OBJECTS[i]);
+        if (m > mtime) {
+            mtime = m;
+        }
     }
-    args[1 + ARRAY_SIZE(C_FLAGS) + ARRAY_SIZE(OBJECTS) + 1] = (char*) "-o";
-    for (size_t i = 0; i < ARRAY_SIZE(C_LIBS); i++) {
-        args[1 + ARRAY_SIZE(C_FLAGS) + ARRAY_SIZE(OBJECTS) + 3 + i] =
-            (char*) C_LIBS[i];
+    args[1 + num_flags + num_objects + 1] = (char*) "-o";
+    for (size_t i = 0; i < num_libs; i++) {
+        args[1 + num_flags + num_objects + 3 + i] = (char*) C_LIBS[i];
     }
-    args[1 + ARRAY_SIZE(C_FLAGS) + ARRAY_SIZE(OBJECTS) + 3 +
-        ARRAY_SIZE(C_LIBS)] = NULL;
-    for (size_t i = 0; i < ARRAY_SIZE(MAIN_OBJECTS); i++) {
-        args[1 + ARRAY_SIZE(C_FLAGS) + ARRAY_SIZE(OBJECTS)] =
-            (char*) MAIN_OBJECTS[i];
-        args[1 + ARRAY_SIZE(C_FLAGS) + ARRAY_SIZE(OBJECTS) + 2] =
-            (char*) MAIN_EXECUTABLES[i];
+    args[1 + num_flags + num_objects + 3 + num_libs] = NULL;
+    for (size_t i = 0; MAIN_OBJECTS[i] != NULL; i++) {
+        /* relink if any object is newer than the executable */
+        m = get_mtime(MAIN_EXECUTABLES[i]);
+        if (m >= 0 && m >= mtime && m >= get_mtime(MAIN_OBJECTS[i])) {
+            continue;
+        }
+        args[1 + num_flags + num_objects] = (char*) MAIN_OBJECTS[i];
+        args[1 + num_flags + num_objects + 2] = (char*) MAIN_EXECUTABLES[i];
         run_executable(args);
     }
+    wait_children();
 
     puts("run any of the main executables:");
-    for (size_t i = 0; i < ARRAY_SIZE(MAIN_EXECUTABLES); i++) {
+    for (size_t i = 0; MAIN_EXECUTABLES[i] != NULL; i++) {
         puts(MAIN_EXECUTABLES[i]);
     }
     return 0;
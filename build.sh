@@ -1,31 +1,81 @@
 #!/bin/bash
 
-set -ex
+set -e
 
-for ro in 'src/args' 'src/cli' 'src/cmd' 'src/conf' 'src/eval' 'src/file' 'src/salloc' 'src/util' ; do
+# number of compilers and linkers running at once, `-j` without a number uses
+# all processors
+max_jobs=1
+while [ $# -gt 0 ] ; do
+    case "$1" in
+    -j) if [ -n "$2" ] && [ "$2" -gt 0 ] 2>/dev/null ; then
+            max_jobs="$2"
+            shift
+        else
+            max_jobs="$(nproc)"
+        fi ;;
+    -j*) max_jobs="${1#-j}" ;;
+    *) echo "usage: $0 [-j [jobs]]" ; exit 1 ;;
+    esac
+    shift
+done
+
+running=0
+
+# stops all running commands and exits
+fail() {
+    kill $(jobs -p) 2>/dev/null || true
+    wait || true
+    echo "build failed"
+    exit 1
+}
+
+# waits for all running commands
+finish() {
+    while [ $running -gt 0 ] ; do
+        wait -n || fail
+        running=$((running - 1))
+    done
+}
+
+# runs a command in the background once there is a free slot
+run() {
+    if [ $running -ge $max_jobs ] ; then
+        wait -n || fail
+        running=$((running - 1))
+    fi
+    echo "+ $*"
+    "$@" &
+    running=$((running + 1))
+}
+
+for ro in 'src/arena' 'src/args' 'src/cache' 'src/cli' 'src/cmd' 'src/compdb' 'src/conf' 'src/daemon' 'src/eval' 'src/file' 'src/ignore' 'src/jobserver' 'src/memo' 'src/meta' 'src/pressure' 'src/protocol' 'src/salloc' 'src/schedule' 'src/sha256' 'src/util' 'src/walk' ; do
     o='bulid'/"$ro"'.o'
     s="$ro"'.c'
     mkdir -p "$(dirname "$o")"
-    'gcc' '-std=gnu99' '-Wall' '-Wextra' '-Werror' '-Wpedantic' '-g' '-fsanitize=address' -c "$s" -o "$o"
+    run 'gcc' '-std=gnu99' '-D_GNU_SOURCE' '-Wall' '-Wextra' '-Werror' '-Wpedantic' '-g' '-fsanitize=address' -c "$s" -o "$o"
+done
+
+for ro in 'src/cache_server' 'src/main' 'src/worker' 'tests/lol' ; do
+    o='bulid'"/$ro"'.o'
+    s="$ro"'.c'
+    mkdir -p "$(dirname "$o")"
+    run 'gcc' '-std=gnu99' '-D_GNU_SOURCE' '-Wall' '-Wextra' '-Werror' '-Wpedantic' '-g' '-fsanitize=address' -c "$s" -o "$o"
 done
+finish
 
-if [ 2 = 0 ] ; then
+if [ 4 = 0 ] ; then
     echo "no main executables"
     exit 0
 fi
 
-for ro in 'src/main' 'tests/lol' ; do
+for ro in 'src/cache_server' 'src/main' 'src/worker' 'tests/lol' ; do
     o='bulid'"/$ro"'.o'
-    s="$ro"'.c'
     e='bulid'/"$ro"''
-    mkdir -p "$(dirname "$o")"
-    'gcc' '-std=gnu99' '-Wall' '-Wextra' '-Werror' '-Wpedantic' '-g' '-fsanitize=address' -c "$s" -o "$o"
-    'gcc' '-std=gnu99' '-Wall' '-Wextra' '-Werror' '-Wpedantic' '-g' '-fsanitize=address' 'bulid/src/args.o' 'bulid/src/cli.o' 'bulid/src/cmd.o' 'bulid/src/conf.o' 'bulid/src/eval.o' 'bulid/src/file.o' 'bulid/src/salloc.o' 'bulid/src/util.o' "$o" -o "$e" '-lm' '-lbfd' '-lreadline'
+    run 'gcc' '-std=gnu99' '-D_GNU_SOURCE' '-Wall' '-Wextra' '-Werror' '-Wpedantic' '-g' '-fsanitize=address' 'bulid/src/arena.o' 'bulid/src/args.o' 'bulid/src/cache.o' 'bulid/src/cli.o' 'bulid/src/cmd.o' 'bulid/src/compdb.o' 'bulid/src/conf.o' 'bulid/src/daemon.o' 'bulid/src/eval.o' 'bulid/src/file.o' 'bulid/src/ignore.o' 'bulid/src/jobserver.o' 'bulid/src/memo.o' 'bulid/src/meta.o' 'bulid/src/pressure.o' 'bulid/src/protocol.o' 'bulid/src/salloc.o' 'bulid/src/schedule.o' 'bulid/src/sha256.o' 'bulid/src/util.o' 'bulid/src/walk.o' "$o" -o "$e" '-lm' '-lbfd' '-lreadline'
 done
-
-set +x
+finish
 
 echo "run any of the main executables:"
-for o in 'bulid/src/main' 'bulid/tests/lol' ; do
+for o in 'bulid/src/cache_server' 'bulid/src/main' 'bulid/src/worker' 'bulid/tests/lol' ; do
     echo "./$o"
 done
@@ -0,0 +1,120 @@
+#include "arena.h"
+#include "salloc.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/// alignment of `arena_alloc()`, enough for any type on common platforms
+#define ARENA_ALIGN 16
+
+/// minimum size of a block, larger allocations get a block of their own
+#define ARENA_BLOCK_SIZE (64 * 1024 - sizeof(struct arena_block))
+
+/**
+ * @brief Gets memory without any alignment.
+ */
+static char *arena_take(struct arena *arena, size_t size)
+{
+    struct arena_block *block;
+    size_t a;
+    char *s;
+
+    if (size > arena->left) {
+        a = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = smalloc(sizeof(*block) + a);
+        block->prev = arena->block;
+        block->size = a;
+        arena->block = block;
+        arena->ptr = block->data;
+        arena->left = a;
+    }
+    s = arena->ptr;
+    arena->ptr += size;
+    arena->left -= size;
+    return s;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+    size_t pad;
+
+    pad = -(uintptr_t) arena->ptr & (ARENA_ALIGN - 1);
+    if (pad + size <= arena->left) {
+        arena->ptr += pad;
+        arena->left -= pad;
+        return arena_take(arena, size);
+    }
+    /* the data of a new block is aligned by `malloc()` */
+    arena->left = 0;
+    return arena_take(arena, size);
+}
+
+char *arena_strndup(struct arena *arena, const char *s, size_t len)
+{
+    char *d;
+
+    d = arena_take(arena, len + 1);
+    memcpy(d, s, len);
+    d[len] = '\0';
+    return d;
+}
+
+char *arena_strdup(struct arena *arena, const char *s)
+{
+    return arena_strndup(arena, s, strlen(s));
+}
+
+void mark_arena(const struct arena *arena, struct arena_mark *mark)
+{
+    mark->block = arena->block;
+    mark->ptr = arena->ptr;
+    mark->left = arena->left;
+}
+
+void release_arena(struct arena *arena, const struct arena_mark *mark)
+{
+    struct arena_block *prev;
+
+    if (mark->block == NULL) {
+        reset_arena(arena);
+        return;
+    }
+    while (arena->block != mark->block) {
+        prev = arena->block->prev;
+        free(arena->block);
+        arena->block = prev;
+    }
+    arena->ptr = mark->ptr;
+    arena->left = mark->left;
+}
+
+void reset_arena(struct arena *arena)
+{
+    struct arena_block *block, *prev;
+
+    block = arena->block;
+    if (block == NULL) {
+        return;
+    }
+    while (block->prev != NULL) {
+        prev = block->prev;
+        free(block);
+        block = prev;
+    }
+    arena->block = block;
+    arena->ptr = block->data;
+    arena->left = block->size;
+}
+
+void clear_arena(struct arena *arena)
+{
+    struct arena_block *block, *prev;
+
+    for (block = arena->block; block != NULL; block = prev) {
+        prev = block->prev;
+        free(block);
+    }
+    arena->block = NULL;
+    arena->ptr = NULL;
+    arena->left = 0;
+}
@@ -0,0 +1,91 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * A memory block of an arena.
+ */
+struct arena_block {
+    /// the block that was allocated before this one
+    struct arena_block *prev;
+    /// number of usable bytes in `data`
+    size_t size;
+    /// the memory handed out
+    char data[];
+};
+
+/**
+ * An arena hands out memory from large blocks, single allocations can not be
+ * freed, only the entire arena at once.
+ *
+ * An arena that is set to all zeros is empty and ready to use.
+ */
+struct arena {
+    /// the block memory is currently taken from
+    struct arena_block *block;
+    /// next free byte in `block`
+    char *ptr;
+    /// number of free bytes in `block`
+    size_t left;
+};
+
+/**
+ * A position in an arena to go back to, see `release_arena()`.
+ */
+struct arena_mark {
+    /// the block of the arena at the time
+    struct arena_block *block;
+    /// next free byte in `block` at the time
+    char *ptr;
+    /// number of free bytes in `block` at the time
+    size_t left;
+};
+
+/**
+ * @brief Allocates memory that is aligned for any type.
+ *
+ * Exits when the allocation fails.
+ *
+ * @param arena The arena to allocate from.
+ * @param size  The number of bytes to allocate.
+ *
+ * @return The allocated memory, valid until the arena is reset or cleared.
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/**
+ * @brief Copies a string of given length into the arena and terminates it.
+ */
+char *arena_strndup(struct arena *arena, const char *s, size_t len);
+
+/**
+ * @brief Copies a string into the arena.
+ */
+char *arena_strdup(struct arena *arena, const char *s);
+
+/**
+ * @brief Remembers the current position of the arena.
+ */
+void mark_arena(const struct arena *arena, struct arena_mark *mark);
+
+/**
+ * @brief Frees all memory allocated after the mark was made.
+ *
+ * Marks made after the given one are invalid afterwards. Releasing a mark of
+ * an empty arena is the same as `reset_arena()`.
+ */
+void release_arena(struct arena *arena, const struct arena_mark *mark);
+
+/**
+ * @brief Frees all memory of the arena except for the first block which is
+ * reused.
+ */
+void reset_arena(struct arena *arena);
+
+/**
+ * @brief Frees all memory of the arena.
+ */
+void clear_arena(struct arena *arena);
+
+#endif
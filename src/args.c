@@ -36,6 +36,10 @@ struct program_opt {
         'n', 0, .b = &Args.no_config },
     { "interval", "set a repeat interval",
         'i', 1, .s = &Args.str_interval },
+    { "daemon", "keep running and accept command lines from --send",
+        'd', 0, .b = &Args.daemon },
+    { "send", "<line> run a command line in the running daemon",
+        's', 1, .s = &Args.send },
 };
 
 void usage(FILE *fp, const char *program_name)
@@ -66,7 +70,7 @@ bool parse_args(int argc, char **argv)
     char **vals;
     int num_vals;
     int on;
-    const struct program_opt *o;
+    const struct program_opt *o = NULL;
     char *equ;
 
     argc--;
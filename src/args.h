@@ -18,6 +18,8 @@ extern struct program_arguments {
     size_t num_files;
     char *str_interval;
     long interval;
+    bool daemon;
+    char *send;
 } Args;
 
 bool parse_args(int argc, char **argv);
@@ -0,0 +1,368 @@
+#include "args.h"
+#include "cache.h"
+#include "macros.h"
+#include "protocol.h"
+#include "salloc.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+/// seconds a cache server may take to answer before it is given up on
+#define HTTP_TIMEOUT 10
+
+void make_cache_key(const unsigned char digest[SHA256_SIZE],
+        char key[CACHE_KEY_SIZE])
+{
+    static const char digits[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < SHA256_SIZE; i++) {
+        key[i * 2] = digits[digest[i] >> 4];
+        key[i * 2 + 1] = digits[digest[i] & 0xf];
+    }
+    key[CACHE_KEY_SIZE - 1] = '\0';
+}
+
+bool is_cache_key(const char *s)
+{
+    for (size_t i = 0; i < CACHE_KEY_SIZE - 1; i++) {
+        if (!((s[i] >= '0' && s[i] <= '9') || (s[i] >= 'a' && s[i] <= 'f'))) {
+            return false;
+        }
+    }
+    return s[CACHE_KEY_SIZE - 1] == '\0';
+}
+
+/**
+ * @brief Reads from a socket until the other side closes it.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int read_until_end(int fd, char **pdata, size_t *psize)
+{
+    char *data = NULL;
+    size_t size = 0, cap = 0;
+    ssize_t n;
+
+    for (;;) {
+        if (size == cap) {
+            if (cap >= PROTOCOL_MAX_BLOB) {
+                errno = EPROTO;
+                break;
+            }
+            cap = cap == 0 ? 64 * 1024 : cap * 2;
+            data = srealloc(data, cap + 1);
+        }
+        n = read(fd, &data[size], cap - size);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (n == 0) {
+            data[size] = '\0';
+            *pdata = data;
+            *psize = size;
+            return 0;
+        }
+        size += n;
+    }
+    free(data);
+    return -1;
+}
+
+/**
+ * @brief Sends a request to the cache server and reads the response.
+ *
+ * Only responses with a body that is not chunked are understood, which is all
+ * the bundled server sends.
+ *
+ * @param cache     The cache.
+ * @param method    "GET" or "PUT".
+ * @param key       The key of the object.
+ * @param data      The body, may be `NULL` if `size` is 0.
+ * @param size      The size of the body.
+ * @param pbody     Output of the body of the response, may be `NULL` if it is
+ *                  not needed, otherwise it must be freed.
+ * @param pbody_size Output of the size of the body.
+ *
+ * @return The status code of the response or -1 on failure.
+ */
+static int http_request(const struct cache *cache, const char *method,
+        const char *key, const char *data, size_t size, char **pbody,
+        size_t *pbody_size)
+{
+    struct timeval timeout = { .tv_sec = HTTP_TIMEOUT };
+    char *request;
+    char *response;
+    size_t response_size;
+    char *body, *length;
+    int status;
+    int fd;
+
+    fd = connect_to(cache->host, cache->port);
+    if (fd == -1) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    request = sasprintf("%s %s/%s HTTP/1.1\r\n"
+            "Host: %s%s%s:%s\r\n"
+            "Content-Length: %zu\r\n"
+            "Connection: close\r\n"
+            "\r\n", method, cache->path, key,
+            strchr(cache->host, ':') == NULL ? "" : "[", cache->host,
+            strchr(cache->host, ':') == NULL ? "" : "]", cache->port, size);
+    if (write_all(fd, request, strlen(request)) == -1 ||
+            write_all(fd, data, size) == -1) {
+        LOG("could not send request to '%s:%s': %s\n", cache->host,
+                cache->port, strerror(errno));
+        free(request);
+        close(fd);
+        return -1;
+    }
+    free(request);
+    shutdown(fd, SHUT_WR);
+    if (read_until_end(fd, &response, &response_size) == -1) {
+        LOG("could not read response from '%s:%s': %s\n", cache->host,
+                cache->port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    body = strstr(response, "\r\n\r\n");
+    if (strncmp(response, "HTTP/1.", STRING_SIZE("HTTP/1.")) != 0 ||
+            body == NULL ||
+            sscanf(response, "HTTP/1.%*d %3d", &status) != 1) {
+        LOG("invalid response from '%s:%s'\n", cache->host, cache->port);
+        free(response);
+        return -1;
+    }
+    body[2] = '\0';
+    body += 4;
+    if (strcasestr(response, "\r\nTransfer-Encoding:") != NULL) {
+        LOG("'%s:%s' sent an encoded response, only plain ones are"
+                " supported\n", cache->host, cache->port);
+        free(response);
+        return -1;
+    }
+    length = strcasestr(response, "\r\nContent-Length:");
+    if (length != NULL && strtoull(length + STRING_SIZE("\r\nContent-Length:"),
+                NULL, 10) != response_size - (body - response)) {
+        LOG("truncated response from '%s:%s'\n", cache->host, cache->port);
+        free(response);
+        return -1;
+    }
+
+    if (pbody != NULL) {
+        *pbody_size = response_size - (body - response);
+        *pbody = smalloc(*pbody_size + 1);
+        memcpy(*pbody, body, *pbody_size);
+        (*pbody)[*pbody_size] = '\0';
+    }
+    free(response);
+    return status;
+}
+
+static int http_get(const struct cache *cache, const char *key, char **pdata,
+        size_t *psize)
+{
+    char *body;
+    size_t size;
+    int status;
+
+    status = http_request(cache, "GET", key, NULL, 0, &body, &size);
+    switch (status) {
+    case -1:
+        return -1;
+    case 200:
+        *pdata = body;
+        *psize = size;
+        return 1;
+    case 404:
+        free(body);
+        return 0;
+    }
+    LOG("'%s:%s' answered GET with %d\n", cache->host, cache->port, status);
+    free(body);
+    return -1;
+}
+
+static int http_put(const struct cache *cache, const char *key,
+        const char *data, size_t size)
+{
+    int status;
+
+    status = http_request(cache, "PUT", key, data, size, NULL, NULL);
+    if (status == -1) {
+        return -1;
+    }
+    if (status / 100 != 2) {
+        LOG("'%s:%s' answered PUT with %d\n", cache->host, cache->port,
+                status);
+        return -1;
+    }
+    return 0;
+}
+
+static int directory_get(const struct cache *cache, const char *key,
+        char **pdata, size_t *psize)
+{
+    char *path;
+    int result = 1;
+
+    path = sasprintf("%s/%s", cache->path, key);
+    if (read_file(path, pdata, psize) == -1) {
+        if (errno == ENOENT) {
+            result = 0;
+        } else {
+            LOG("could not read '%s': %s\n", path, strerror(errno));
+            result = -1;
+        }
+    }
+    free(path);
+    return result;
+}
+
+static int directory_put(const struct cache *cache, const char *key,
+        const char *data, size_t size)
+{
+    char *tmp, *path;
+    int fd;
+    int result = -1;
+
+    /* others may be reading the same object, it must appear complete */
+    mkdir(cache->path, 0777);
+    tmp = sasprintf("%s/.%s.XXXXXX", cache->path, key);
+    path = sasprintf("%s/%s", cache->path, key);
+    fd = mkstemp(tmp);
+    if (fd != -1) {
+        if (write_all(fd, data, size) == 0 && fchmod(fd, 0644) == 0 &&
+                close(fd) == 0) {
+            result = rename(tmp, path);
+        } else {
+            close(fd);
+        }
+        if (result == -1) {
+            unlink(tmp);
+        }
+    }
+    if (result == -1) {
+        LOG("could not write '%s': %s\n", path, strerror(errno));
+    }
+    free(tmp);
+    free(path);
+    return result;
+}
+
+static const struct cache_backend Backends[] = {
+    { "http://", http_get, http_put },
+    { "file://", directory_get, directory_put },
+};
+
+/**
+ * @brief Splits "host[:port][/path]" or "[address][:port][/path]".
+ *
+ * @return 0 on success, -1 if the value is malformed.
+ */
+static int parse_http_location(const char *s, struct cache *cache)
+{
+    const char *host_end, *port, *path;
+
+    path = strchrnul(s, '/');
+    if (s[0] == '[') {
+        s++;
+        host_end = memchr(s, ']', path - s);
+        if (host_end == NULL) {
+            return -1;
+        }
+        port = host_end + 1;
+        if (port[0] != ':' && port != path) {
+            return -1;
+        }
+    } else {
+        host_end = memchr(s, ':', path - s);
+        if (host_end == NULL) {
+            host_end = path;
+        }
+        port = host_end;
+    }
+    if (host_end == s) {
+        return -1;
+    }
+    cache->host = smalloc(host_end - s + 1);
+    memcpy(cache->host, s, host_end - s);
+    cache->host[host_end - s] = '\0';
+    if (port[0] == ':' && port + 1 != path) {
+        cache->port = smalloc(path - port);
+        memcpy(cache->port, port + 1, path - port - 1);
+        cache->port[path - port - 1] = '\0';
+    } else {
+        cache->port = sstrdup("80");
+    }
+    cache->path = sstrdup(path);
+    return 0;
+}
+
+int open_cache(struct cache *cache, const char *location)
+{
+    size_t len;
+
+    cache->backend = &Backends[ARRAY_SIZE(Backends) - 1];
+    for (size_t i = 0; i < ARRAY_SIZE(Backends); i++) {
+        len = strlen(Backends[i].prefix);
+        if (strncmp(location, Backends[i].prefix, len) == 0) {
+            cache->backend = &Backends[i];
+            location += len;
+            break;
+        }
+    }
+
+    cache->host = NULL;
+    cache->port = NULL;
+    if (cache->backend->get == http_get) {
+        if (parse_http_location(location, cache) == -1) {
+            return -1;
+        }
+    } else {
+        if (location[0] == '\0') {
+            return -1;
+        }
+        cache->path = sstrdup(location);
+    }
+    len = strlen(cache->path);
+    while (len > 1 && cache->path[len - 1] == '/') {
+        cache->path[--len] = '\0';
+    }
+    if (cache->backend->get == http_get && len == 1) {
+        cache->path[0] = '\0';
+    }
+    return 0;
+}
+
+int cache_get(const struct cache *cache, const char *key, char **pdata,
+        size_t *psize)
+{
+    return cache->backend->get(cache, key, pdata, psize);
+}
+
+int cache_put(const struct cache *cache, const char *key, const char *data,
+        size_t size)
+{
+    return cache->backend->put(cache, key, data, size);
+}
+
+void close_cache(struct cache *cache)
+{
+    free(cache->host);
+    free(cache->port);
+    free(cache->path);
+}
@@ -0,0 +1,100 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "sha256.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// port the bundled cache server listens on by default
+#define CACHE_PORT 7544
+
+/// size of a key as string, including the null terminator
+#define CACHE_KEY_SIZE (SHA256_SIZE * 2 + 1)
+
+/**
+ * @brief Converts a digest into a key, the lower case hex digits of it.
+ */
+void make_cache_key(const unsigned char digest[SHA256_SIZE],
+        char key[CACHE_KEY_SIZE]);
+
+/**
+ * @brief Checks if a string is a key made by `make_cache_key()`.
+ */
+bool is_cache_key(const char *s);
+
+/**
+ * A place objects are stored at, keyed by the hash of everything that goes
+ * into compiling them.
+ */
+struct cache {
+    /// how the cache is accessed
+    const struct cache_backend *backend;
+    /// host name or address, `NULL` if not used by the backend
+    char *host;
+    /// port or service name, `NULL` if not used by the backend
+    char *port;
+    /// path on the host or the directory, never ends with a '/'
+    char *path;
+};
+
+/**
+ * A way of storing objects, the backend is picked by the start of the location
+ * in `CACHE`.
+ */
+struct cache_backend {
+    /// start of the locations of this backend, like "http://"
+    const char *prefix;
+    /**
+     * @brief Looks up an object.
+     *
+     * @param cache     The cache.
+     * @param key       The key of the object.
+     * @param pdata     Output of the object, it must be freed.
+     * @param psize     Output of the size of the object.
+     *
+     * @return 1 if it was found, 0 if it was not and -1 on failure.
+     */
+    int (*get)(const struct cache *cache, const char *key, char **pdata,
+            size_t *psize);
+    /**
+     * @brief Stores an object.
+     *
+     * @return 0 on success, -1 on failure.
+     */
+    int (*put)(const struct cache *cache, const char *key, const char *data,
+            size_t size);
+};
+
+/**
+ * @brief Opens the cache at a location.
+ *
+ * A location is either "http://host[:port][/path]" (a server that answers GET
+ * and PUT requests on "path/<key>", see cache_server.c) or a directory shared
+ * by everyone, optionally starting with "file://".
+ *
+ * @param cache     Output of the cache, it must be closed with `close_cache()`.
+ * @param location  The location, usually the value of `CACHE`.
+ *
+ * @return 0 on success, -1 if the location is malformed.
+ */
+int open_cache(struct cache *cache, const char *location);
+
+/**
+ * @brief Looks up an object (see `struct cache_backend`).
+ */
+int cache_get(const struct cache *cache, const char *key, char **pdata,
+        size_t *psize);
+
+/**
+ * @brief Stores an object (see `struct cache_backend`).
+ */
+int cache_put(const struct cache *cache, const char *key, const char *data,
+        size_t size);
+
+/**
+ * @brief Frees the resources of a cache.
+ */
+void close_cache(struct cache *cache);
+
+#endif
@@ -0,0 +1,268 @@
+#include "cache.h"
+#include "macros.h"
+#include "protocol.h"
+#include "salloc.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+/*
+ * A small object cache server for autocar (see `CACHE`), it answers
+ * "GET /<key>" and "PUT /<key>" by reading and writing files named after the
+ * key in a directory. It is meant for trying out a shared cache, by default it
+ * only listens on localhost and anyone who can reach it can store objects
+ * others then link into their executables.
+ */
+
+/// maximum size of the request line and headers
+#define MAX_HEADER 8192
+
+/// seconds a client may stay silent before it is dropped
+#define CLIENT_TIMEOUT 30
+
+static void usage(const char *program)
+{
+    printf("usage: %s [-l address] [-p port] [-d directory]\n"
+            "  -l  address to listen on (default: 127.0.0.1)\n"
+            "  -p  port to listen on (default: %d)\n"
+            "  -d  directory the objects are stored in (default:"
+            " autocar-cache)\n", program, CACHE_PORT);
+}
+
+/**
+ * @brief Sends a response and a body.
+ */
+static int send_response(int fd, int status, const char *reason,
+        const char *body, size_t size)
+{
+    char *header;
+    int result;
+
+    header = sasprintf("HTTP/1.1 %d %s\r\n"
+            "Content-Length: %zu\r\n"
+            "Connection: close\r\n"
+            "\r\n", status, reason, size);
+    result = write_all(fd, header, strlen(header));
+    free(header);
+    if (result == 0) {
+        result = write_all(fd, body, size);
+    }
+    return result;
+}
+
+/**
+ * @brief Sends the object with given key.
+ */
+static int get_object(int fd, const char *directory, const char *key)
+{
+    char *path;
+    char *data;
+    size_t size;
+    int result;
+
+    path = sasprintf("%s/%s", directory, key);
+    if (read_file(path, &data, &size) == -1) {
+        free(path);
+        if (errno == ENOENT) {
+            return send_response(fd, 404, "Not Found", NULL, 0);
+        }
+        return send_response(fd, 500, "Internal Server Error", NULL, 0);
+    }
+    free(path);
+    result = send_response(fd, 200, "OK", data, size);
+    free(data);
+    return result;
+}
+
+/**
+ * @brief Reads the body of a request and stores it under given key.
+ *
+ * @param fd        The client.
+ * @param directory Where objects are stored.
+ * @param key       The key of the object.
+ * @param start     The part of the body already read with the header.
+ * @param start_size The size of `start`.
+ * @param size      The size of the entire body.
+ */
+static int put_object(int fd, const char *directory, const char *key,
+        const char *start, size_t start_size, size_t size)
+{
+    char *data;
+    char *tmp, *path;
+    int tmp_fd;
+    int result = -1;
+
+    data = smalloc(size + 1);
+    memcpy(data, start, start_size);
+    if (read_all(fd, &data[start_size], size - start_size) == -1) {
+        free(data);
+        return -1;
+    }
+
+    /* a reader must never see a partial object */
+    tmp = sasprintf("%s/.%s.XXXXXX", directory, key);
+    path = sasprintf("%s/%s", directory, key);
+    tmp_fd = mkstemp(tmp);
+    if (tmp_fd != -1) {
+        if (write_all(tmp_fd, data, size) == 0 && fchmod(tmp_fd, 0644) == 0 &&
+                close(tmp_fd) == 0) {
+            result = rename(tmp, path);
+        } else {
+            close(tmp_fd);
+        }
+        if (result == -1) {
+            unlink(tmp);
+        }
+    }
+    if (result == -1) {
+        fprintf(stderr, "could not write '%s': %s\n", path, strerror(errno));
+        result = send_response(fd, 500, "Internal Server Error", NULL, 0);
+    } else {
+        result = send_response(fd, 201, "Created", NULL, 0);
+    }
+    free(tmp);
+    free(path);
+    free(data);
+    return result;
+}
+
+/**
+ * @brief Reads a single request from a client and answers it.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int handle_client(int fd, const char *directory)
+{
+    struct timeval timeout = { .tv_sec = CLIENT_TIMEOUT };
+    char header[MAX_HEADER + 1];
+    size_t size = 0;
+    ssize_t n;
+    char *end;
+    char method[8], target[512];
+    char *key, *length;
+    unsigned long long content_length;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    do {
+        if (size == MAX_HEADER) {
+            return send_response(fd, 431, "Request Header Fields Too Large",
+                    NULL, 0);
+        }
+        n = read(fd, &header[size], MAX_HEADER - size);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        size += n;
+        header[size] = '\0';
+    } while (end = strstr(header, "\r\n\r\n"), end == NULL);
+    end[2] = '\0';
+    end += 4;
+
+    if (sscanf(header, "%7s %511s HTTP/1.%*d", method, target) != 2) {
+        return send_response(fd, 400, "Bad Request", NULL, 0);
+    }
+    key = strrchr(target, '/');
+    key = key == NULL ? target : key + 1;
+    if (!is_cache_key(key)) {
+        return send_response(fd, 404, "Not Found", NULL, 0);
+    }
+
+    if (strcmp(method, "GET") == 0) {
+        return get_object(fd, directory, key);
+    }
+    if (strcmp(method, "PUT") != 0) {
+        return send_response(fd, 405, "Method Not Allowed", NULL, 0);
+    }
+    length = strcasestr(header, "\r\nContent-Length:");
+    if (length == NULL) {
+        return send_response(fd, 411, "Length Required", NULL, 0);
+    }
+    content_length = strtoull(length + STRING_SIZE("\r\nContent-Length:"),
+            NULL, 10);
+    if (content_length > PROTOCOL_MAX_BLOB) {
+        return send_response(fd, 413, "Content Too Large", NULL, 0);
+    }
+    if ((size_t) (&header[size] - end) > content_length) {
+        return send_response(fd, 400, "Bad Request", NULL, 0);
+    }
+    return put_object(fd, directory, key, end, &header[size] - end,
+            content_length);
+}
+
+int main(int argc, char **argv)
+{
+    const char *address = "127.0.0.1";
+    const char *directory = "autocar-cache";
+    char port[16];
+    int opt;
+    int server, client;
+    int pid;
+
+    snprintf(port, sizeof(port), "%d", CACHE_PORT);
+    while (opt = getopt(argc, argv, "l:p:d:h"), opt != -1) {
+        switch (opt) {
+        case 'l':
+            address = optarg;
+            break;
+        case 'p':
+            snprintf(port, sizeof(port), "%s", optarg);
+            break;
+        case 'd':
+            directory = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (mkdir(directory, 0777) == -1 && errno != EEXIST) {
+        fprintf(stderr, "could not create '%s': %s\n", directory,
+                strerror(errno));
+        return 1;
+    }
+    server = listen_on(address, port);
+    if (server == -1) {
+        return 1;
+    }
+    fprintf(stderr, "listening on %s:%s, storing objects in '%s'\n", address,
+            port, directory);
+
+    /* the children are not waited for */
+    signal(SIGCHLD, SIG_IGN);
+    for (;;) {
+        client = accept4(server, NULL, NULL, SOCK_CLOEXEC);
+        if (client == -1) {
+            if (errno != EINTR) {
+                fprintf(stderr, "accept: %s\n", strerror(errno));
+            }
+            continue;
+        }
+        pid = fork();
+        if (pid == 0) {
+            close(server);
+            _exit(handle_client(client, directory) == 0 ? 0 : 1);
+        }
+        if (pid == -1) {
+            fprintf(stderr, "fork: %s\n", strerror(errno));
+        }
+        close(client);
+    }
+}
@@ -1,6 +1,7 @@
 #include "args.h"
 #include "cli.h"
 #include "cmd.h"
+#include "compdb.h"
 #include "conf.h"
 #include "file.h"
 #include "macros.h"
@@ -35,7 +36,7 @@ const struct command Commands[] = {
     [CMD_ADD] = { "add", cmd_add, "[files] [-tr files]",
         "add files to the file list" },
     [CMD_BUILD] = { "build", cmd_build, "[--collect|-c]",
-        "build everything" },
+        "build everything", true },
     [CMD_CONFIG] = { "config", cmd_config, "", "show all config options" },
     [CMD_DELETE] = { "delete", cmd_delete, "[files]",
         "deletes given files from the file list" },
@@ -43,8 +44,10 @@ const struct command Commands[] = {
         "prints the expandend arguments to stdout" },
     [CMD_HELP] = { "help", cmd_help, "[args]",
         "prints this help or only specific commands" },
-    [CMD_GENERATE] = { "generate", cmd_generate, "<shell|make>",
-        "generate a shell or make build file" },
+    [CMD_GENERATE] = { "generate", cmd_generate,
+        "<shell|make|c|ninja|compdb> [variant]",
+        "generate a build file or a compilation database of a variant\n"
+        "  (the first one by default)", true },
     [CMD_LIST] = { "list", cmd_list, "", "list all files" },
     [CMD_PAUSE] = { "pause", cmd_pause, "", "un-/pause the buffer" },
     [CMD_RUN] = { "run", cmd_run, "[<name> [args]]",
@@ -52,7 +55,7 @@ const struct command Commands[] = {
         "  to list all main programs.\n"
         "  Use `run $<index> [args]` for convenience" },
     [CMD_SOURCE] = { "source", cmd_source, "[files]",
-        "runs all given files as autocar script" },
+        "runs all given files as autocar script", true },
     [CMD_QUIT] = { "quit", cmd_quit, "", "quit all" },
 };
 
@@ -94,6 +97,8 @@ int source_path(const char *path)
     int result;
     FILE *fp, *pp;
     char *cmd;
+    pid_t pid;
+    int fd;
 
     DLOG("source: %s\n", path);
 
@@ -109,20 +114,19 @@ int source_path(const char *path)
             return -1;
         }
         DLOG("has shebang: %s\n", cmd);
-        pp = popen(cmd, "r");
-        if (pp == NULL) {
-            fprintf(stderr, "popen '%s': %s\n", cmd, strerror(errno));
-            fclose(fp);
-            free(cmd);
+        pid = start_shell("/bin/sh", cmd, &fd);
+        free(cmd);
+        /* `get_shebang_cmd()` closed the file already */
+        if (pid == -1) {
             return -1;
         }
-        free(cmd);
+        pp = fdopen(fd, "r");
         result = eval_file(pp);
-        pclose(pp);
+        fclose(pp);
+        wait_process(pid);
     } else {
-        rewind(fp);
-        result = eval_file(fp);
         fclose(fp);
+        result = eval_script(path);
     }
     return result;
 }
@@ -1,6 +1,7 @@
 #ifndef CMD_H
 #define CMD_H
 
+#include <stdbool.h>
 #include <stdio.h>
 
 #define CMD_ADD         0
@@ -22,6 +23,9 @@ extern const struct command {
     int (*cmd_proc)(char **args, size_t num_args, FILE *out);
     const char *args_help;
     const char *desc_help;
+    /// whether the command may change or free values of the config, its
+    /// arguments are copied before it runs in that case
+    bool changes_config;
 } Commands[CMD_MAX];
 
 /**
@@ -49,13 +53,31 @@ int run_command(int cmd, char **args, size_t num_args, FILE *out);
  */
 int run_command_line(char *line);
 
+/**
+ * @brief Frees the memory kept for running command lines.
+ */
+void clear_eval(void);
+
 /**
  * @brief Runs each line of given file.
  */
 int eval_file(FILE *fp);
 
 /**
- * @brief Opens path and calls `eval_file()`.
+ * @brief Runs each line of a file like `eval_file()`.
+ *
+ * The file is compiled once into its segments with the arguments split and
+ * the variables and file indices to expand marked. Sourcing the file again
+ * only expands and runs them, unless its modification time and content
+ * changed.
+ *
+ * @return 0 on success, -1 if the file can not be read.
+ */
+int eval_script(const char *path);
+
+/**
+ * @brief Opens path and calls `eval_script()`, or `eval_file()` with the
+ * output of the program in the shebang.
  */
 int source_path(const char *path);
 
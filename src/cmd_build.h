@@ -1,22 +1,31 @@
 int cmd_build(char **args, size_t num_args, FILE *out)
 {
+    bool built;
+
     (void) out;
 
+    if (num_args > 1 || (num_args == 1 && strcmp(args[0], "-c") != 0 &&
+                strcmp(args[0], "--collect") != 0)) {
+        printf("invalid arguments, try: `help build`\n");
+        return -1;
+    }
+
+    /* the main loop builds the same variants, they must not be replaced
+     * while it uses them */
+    pthread_mutex_lock(&Files.lock);
+    /* the variants may not be known yet when sourcing a config */
+    if (check_conf() != 0) {
+        pthread_mutex_unlock(&Files.lock);
+        return -1;
+    }
     if (num_args == 1) {
-        if (strcmp(args[0], "-c") == 0 || strcmp(args[0], "--collect") == 0) {
-            DLOG("build wants to collect files\n");
-            if (collect_files() != 0) {
-                return -1;
-            }
-        } else {
-            goto invalid_arg;
+        DLOG("build wants to collect files\n");
+        if (collect_files() != 0) {
+            pthread_mutex_unlock(&Files.lock);
+            return -1;
         }
-    } else if (num_args > 1) {
-        goto invalid_arg;
     }
-    return build_objects() && link_executables() ? 0 : -1;
-
-invalid_arg:
-    printf("invalid arguments, try: `help build`\n");
-    return -1;
+    built = build_objects() && link_executables();
+    pthread_mutex_unlock(&Files.lock);
+    return built ? 0 : -1;
 }
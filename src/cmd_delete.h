@@ -9,11 +9,7 @@ int cmd_delete(char **args, size_t num_args, FILE *out)
         for (size_t f = 0; f < Files.num; ) {
             file = Files.ptr[f];
             if (fnmatch(args[i], file->path, 0) == 0) {
-                free(file->path);
-                free(file);
-                Files.num--;
-                memmove(&Files.ptr[f], &Files.ptr[f + 1],
-                        sizeof(*Files.ptr) * (Files.num - f));
+                remove_file(f);
             } else {
                 f++;
             }
@@ -9,22 +9,47 @@ struct gen_object_list {
     char **main_objects;
     char **main_executables;
     size_t num_main;
+
+    char **tests;
+    char **test_inputs;
+    char **test_data;
+    char **test_outputs;
+    size_t num_tests;
+
+    /// a copy, `Variants` may be replaced once `Files.lock` is released
+    struct variant variant;
 };
 
-static int make_object_list(struct gen_object_list *gol)
+static int make_object_list(struct gen_object_list *gol,
+        const struct variant *variant)
 {
-    struct file *file, *obj;
+    struct file *file, *obj, *exec;
+    struct file *input, *data, *output;
+    struct file **files = NULL;
+    size_t num_files = 0;
+    size_t id;
     char *raw;
 
     gol->num = 0;
     gol->num_main = 0;
+    gol->num_tests = 0;
+    copy_variant(&gol->variant, variant);
 
-    for (size_t i = 0; i < Files.num; i++) {
-        file = Files.ptr[i];
-        if (file->type != EXT_TYPE_SOURCE || !(file->flags & FLAG_EXISTS)) {
+    /* taken out first because getting the objects adds to the file list */
+    id = 0;
+    while (file = next_indexed_file(INDEX_SOURCES, &id), file != NULL) {
+        if (!(file->flags & FLAG_EXISTS)) {
             continue;
         }
-        obj = get_object_file(file);
+        files = sreallocarray(files, num_files + 1, sizeof(*files));
+        files[num_files++] = file;
+    }
+    qsort(files, num_files, sizeof(*files), compare_file_paths);
+
+    for (size_t i = 0; i < num_files; i++) {
+        file = files[i];
+        obj = get_object_file(file, variant);
+        classify_object(file, obj);
         if ((obj->flags & FLAG_HAS_MAIN)) {
             gol->num_main++;
         } else {
@@ -46,12 +71,17 @@ static int make_object_list(struct gen_object_list *gol)
     gol->main_executables = sreallocarray(NULL, gol->num_main,
             sizeof(*gol->main_executables));
 
-    for (size_t i = 0, a = 0, b = 0; i < Files.num; i++) {
-        file = Files.ptr[i];
-        if (file->type != EXT_TYPE_SOURCE || !(file->flags & FLAG_EXISTS)) {
-            continue;
-        }
-        obj = get_object_file(file);
+    gol->tests = sreallocarray(NULL, gol->num_main, sizeof(*gol->tests));
+    gol->test_inputs = sreallocarray(NULL, gol->num_main,
+            sizeof(*gol->test_inputs));
+    gol->test_data = sreallocarray(NULL, gol->num_main,
+            sizeof(*gol->test_data));
+    gol->test_outputs = sreallocarray(NULL, gol->num_main,
+            sizeof(*gol->test_outputs));
+
+    for (size_t i = 0, a = 0, b = 0; i < num_files; i++) {
+        file = files[i];
+        obj = get_object_file(file, variant);
         raw = smalloc(file->ext - file->path + 1);
         memcpy(raw, file->path, file->ext - file->path);
         raw[file->ext - file->path] = '\0';
@@ -59,8 +89,32 @@ static int make_object_list(struct gen_object_list *gol)
             gol->main_sources[a] = file->path;
             gol->raw_main_objects[a] = raw;
             gol->main_objects[a] = obj->path;
-            gol->main_executables[a] = get_exec_file(obj)->path;
+            exec = get_exec_file(obj);
+            gol->main_executables[a] = exec->path;
             a++;
+
+            if (!(exec->flags & FLAG_IS_TEST)) {
+                continue;
+            }
+            get_test_files(exec, &input, &data, &output);
+            if (input == NULL && data == NULL) {
+                continue;
+            }
+            gol->tests[gol->num_tests] = exec->path;
+            gol->test_inputs[gol->num_tests] = input == NULL ? NULL :
+                input->path;
+            gol->test_data[gol->num_tests] = data == NULL ? NULL : data->path;
+            if (output == NULL) {
+                gol->test_outputs[gol->num_tests] = smalloc(exec->ext -
+                        exec->path + sizeof(".output"));
+                memcpy(gol->test_outputs[gol->num_tests], exec->path,
+                        exec->ext - exec->path);
+                strcpy(&gol->test_outputs[gol->num_tests][exec->ext -
+                        exec->path], ".output");
+            } else {
+                gol->test_outputs[gol->num_tests] = sstrdup(output->path);
+            }
+            gol->num_tests++;
         } else {
             gol->sources[b] = file->path;
             gol->raw_objects[b] = raw;
@@ -68,6 +122,7 @@ static int make_object_list(struct gen_object_list *gol)
             b++;
         }
     }
+    free(files);
     return 0;
 }
 
@@ -87,6 +142,16 @@ static void clear_object_list(struct gen_object_list *gol)
     free(gol->raw_main_objects);
     free(gol->main_objects);
     free(gol->main_executables);
+
+    free(gol->tests);
+    free(gol->test_inputs);
+    free(gol->test_data);
+    for (size_t i = 0; i < gol->num_tests; i++) {
+        free(gol->test_outputs[i]);
+    }
+    free(gol->test_outputs);
+
+    clear_variant(&gol->variant);
 }
 
 /**
@@ -177,33 +242,239 @@ static void print_c_escaped(const char *str, FILE *fp)
             h = u >> 4;
             l = u & 0xf;
             fputc(h >= 0xa ? 'a' - 0xa + h : '0' + h, fp);
-            fputc(l >= 0xa ? 'a' - 0xa + l : '0' + h, fp);
+            fputc(l >= 0xa ? 'a' - 0xa + l : '0' + l, fp);
         }
     }
     fputc('\"', fp);
 }
 
+/**
+ * @brief Prints the elements of an array initializer, each is followed by a
+ * comma so the template can end the array with `NULL`.
+ *
+ * @param fp File to print to.
+ */
 static void print_c_array(char *const *s, size_t n, FILE *fp)
+{
+    for (size_t i = 0; i < n; i++) {
+        print_c_escaped(s[i], fp);
+        fputs(", ", fp);
+    }
+}
+
+/**
+ * @brief Prints a path to a file while escaping all ninja interpretations.
+ *
+ * Ninja itself shell escapes paths when they are put into a command with
+ * `$in` or `$out`.
+ *
+ * @param fp File to print to.
+ */
+static void print_ninja_path(const char *str, FILE *fp)
+{
+    for (; str[0] != '\0'; str++) {
+        switch (str[0]) {
+        case '$':
+        case ' ':
+        case ':':
+            fputc('$', fp);
+            break;
+        }
+        fputc(str[0], fp);
+    }
+}
+
+/**
+ * @brief Prints a string to a file so that it ends up as a single shell word
+ * within a ninja command.
+ *
+ * @param fp File to print to.
+ */
+static void print_ninja_escaped(const char *str, FILE *fp)
+{
+    fputc('\'', fp);
+    for (; str[0] != '\0'; str++) {
+        switch (str[0]) {
+        case '\'':
+            fputs("'\\'", fp);
+            break;
+        case '$':
+            fputc('$', fp);
+            break;
+        case '\n':
+            fputs("$\n", fp);
+            continue;
+        }
+        fputc(str[0], fp);
+    }
+    fputc('\'', fp);
+}
+
+static void print_ninja_array(char *const *s, size_t n, FILE *fp)
 {
     for (size_t i = 0; i < n; i++) {
         if (i > 0) {
-            fputs(", ", fp);
+            fputc(' ', fp);
         }
-        print_c_escaped(s[i], fp);
+        print_ninja_escaped(s[i], fp);
     }
 }
 
-static const char *const shell_code = "\
+/**
+ * @brief Prints one build statement for each object, executable and test.
+ *
+ * @param fp File to print to.
+ */
+static void print_ninja_edges(const struct gen_object_list *gol, FILE *fp)
+{
+    for (size_t i = 0; i < gol->num; i++) {
+        fputs("build ", fp);
+        print_ninja_path(gol->objects[i], fp);
+        fputs(": cc ", fp);
+        print_ninja_path(gol->sources[i], fp);
+        fputc('\n', fp);
+    }
+    for (size_t i = 0; i < gol->num_main; i++) {
+        fputs("build ", fp);
+        print_ninja_path(gol->main_objects[i], fp);
+        fputs(": cc ", fp);
+        print_ninja_path(gol->main_sources[i], fp);
+        fputc('\n', fp);
+    }
+    fputc('\n', fp);
+
+    for (size_t i = 0; i < gol->num_main; i++) {
+        fputs("build ", fp);
+        print_ninja_path(gol->main_executables[i], fp);
+        fputs(": link ", fp);
+        print_ninja_path(gol->main_objects[i], fp);
+        for (size_t j = 0; j < gol->num; j++) {
+            fputc(' ', fp);
+            print_ninja_path(gol->objects[j], fp);
+        }
+        fputc('\n', fp);
+    }
+    fputc('\n', fp);
+
+    for (size_t i = 0; i < gol->num_tests; i++) {
+        fputs("build ", fp);
+        print_ninja_path(gol->test_outputs[i], fp);
+        fputs(gol->test_data[i] == NULL ? ": run " : ": test ", fp);
+        print_ninja_path(gol->tests[i], fp);
+        if (gol->test_inputs[i] != NULL || gol->test_data[i] != NULL) {
+            fputs(" |", fp);
+        }
+        if (gol->test_inputs[i] != NULL) {
+            fputc(' ', fp);
+            print_ninja_path(gol->test_inputs[i], fp);
+        }
+        if (gol->test_data[i] != NULL) {
+            fputc(' ', fp);
+            print_ninja_path(gol->test_data[i], fp);
+        }
+        fputc('\n', fp);
+        if (gol->test_inputs[i] != NULL) {
+            fputs("  input = ", fp);
+            print_ninja_escaped(gol->test_inputs[i], fp);
+            fputc('\n', fp);
+        }
+        if (gol->test_data[i] != NULL) {
+            fputs("  data = ", fp);
+            print_ninja_escaped(gol->test_data[i], fp);
+            fputc('\n', fp);
+        }
+    }
+    fputc('\n', fp);
+
+    fputs("build all: phony", fp);
+    for (size_t i = 0; i < gol->num_main; i++) {
+        fputc(' ', fp);
+        print_ninja_path(gol->main_executables[i], fp);
+    }
+    fputs("\nbuild test: phony", fp);
+    for (size_t i = 0; i < gol->num_tests; i++) {
+        fputc(' ', fp);
+        print_ninja_path(gol->test_outputs[i], fp);
+    }
+    fputs("\n\ndefault all\n", fp);
+}
+
+/**
+ * @brief Prints the compilation database, it does not need any template.
+ *
+ * @param fp File to print to.
+ */
+static void print_compdb_edges(const struct gen_object_list *gol, FILE *fp)
+{
+    print_compdb(fp, &gol->variant);
+}
+
+static const char *const shell_code[] = {
+"\
 #!/bin/bash\n\
 \n\
-set -ex\n\
+set -e\n\
+\n\
+# number of compilers and linkers running at once, `-j` without a number uses\n\
+# all processors\n\
+max_jobs=1\n\
+while [ $# -gt 0 ] ; do\n\
+    case \"$1\" in\n\
+    -j) if [ -n \"$2\" ] && [ \"$2\" -gt 0 ] 2>/dev/null ; then\n\
+            max_jobs=\"$2\"\n\
+            shift\n\
+        else\n\
+            max_jobs=\"$(nproc)\"\n\
+        fi ;;\n\
+    -j*) max_jobs=\"${1#-j}\" ;;\n\
+    *) echo \"usage: $0 [-j [jobs]]\" ; exit 1 ;;\n\
+    esac\n\
+    shift\n\
+done\n\
+\n\
+running=0\n\
+\n\
+# stops all running commands and exits\n\
+fail() {\n\
+    kill $(jobs -p) 2>/dev/null || true\n\
+    wait || true\n\
+    echo \"build failed\"\n\
+    exit 1\n\
+}\n\
+\n\
+# waits for all running commands\n\
+finish() {\n\
+    while [ $running -gt 0 ] ; do\n\
+        wait -n || fail\n\
+        running=$((running - 1))\n\
+    done\n\
+}\n\
+\n\
+# runs a command in the background once there is a free slot\n\
+run() {\n\
+    if [ $running -ge $max_jobs ] ; then\n\
+        wait -n || fail\n\
+        running=$((running - 1))\n\
+    fi\n\
+    echo \"+ $*\"\n\
+    \"$@\" &\n\
+    running=$((running + 1))\n\
+}\n\
 \n\
 for ro in {{{RAW_OBJECTS}}} ; do\n\
     o={{{BUILD}}}/\"$ro\"{{{EXT_OBJECT}}}\n\
     s=\"$ro\"{{{EXT_SOURCE}}}\n\
     mkdir -p \"$(dirname \"$o\")\"\n\
-    {{{CC}}} {{{C_FLAGS}}} -c \"$s\" -o \"$o\"\n\
+    run {{{CC}}} {{{C_FLAGS}}} -c \"$s\" -o \"$o\"\n\
+done\n\
+\n\
+for ro in {{{RAW_MAIN_OBJECTS}}} ; do\n\
+    o={{{BUILD}}}\"/$ro\"{{{EXT_OBJECT}}}\n\
+    s=\"$ro\"{{{EXT_SOURCE}}}\n\
+    mkdir -p \"$(dirname \"$o\")\"\n\
+    run {{{CC}}} {{{C_FLAGS}}} -c \"$s\" -o \"$o\"\n\
 done\n\
+finish\n\
 \n\
 if [ {{{#MAIN_EXECUTABLES}}} = 0 ] ; then\n\
     echo \"no main executables\"\n\
@@ -212,21 +483,20 @@ fi\n\
 \n\
 for ro in {{{RAW_MAIN_OBJECTS}}} ; do\n\
     o={{{BUILD}}}\"/$ro\"{{{EXT_OBJECT}}}\n\
-    s=\"$ro\"{{{EXT_SOURCE}}}\n\
     e={{{BUILD}}}/\"$ro\"{{{EXT_EXECUTABLE}}}\n\
-    mkdir -p \"$(dirname \"$o\")\"\n\
-    {{{CC}}} {{{C_FLAGS}}} -c \"$s\" -o \"$o\"\n\
-    {{{CC}}} {{{C_FLAGS}}} {{{OBJECTS}}} \"$o\" -o \"$e\" {{{C_LIBS}}}\n\
+    run {{{CC}}} {{{C_FLAGS}}} {{{OBJECTS}}} \"$o\" -o \"$e\" {{{C_LIBS}}}\n\
 done\n\
-\n\
-set +x\n\
+finish\n\
 \n\
 echo \"run any of the main executables:\"\n\
 for o in {{{MAIN_EXECUTABLES}}} ; do\n\
     echo \"./$o\"\n\
-done\n";
+done\n",
+    NULL
+};
 
-static const char *const make_code = "\
+static const char *const make_code[] = {
+"\
 CC = {{{CC}}}\n\
 C_FLAGS = {{{C_FLAGS}}}\n\
 C_LIBS = {{{C_LIBS}}}\n\
@@ -234,25 +504,37 @@ BUILD = {{{BUILD}}}\n\
 OBJECTS = {{{OBJECTS}}}\n\
 MAIN_OBJECTS = {{{MAIN_OBJECTS}}}\n\
 MAIN_EXECUTABLES = {{{MAIN_EXECUTABLES}}}\n\
+DIRECTORIES = $(sort $(patsubst %/,%,$(dir $(OBJECTS) $(MAIN_OBJECTS))))\n\
 \n\
 .PHONY: all\n\
-all: $(MAIN_EXECUTABLES) $(OBJECTS) $(MAIN_OBJECTS)\n\
+all: $(MAIN_EXECUTABLES)\n\
 \t$(foreach exec,$(MAIN_EXECUTABLES),$(info $(exec)))\n\
 \n\
-$(BUILD)/%{{{EXT_OBJECT}}}: %{{{EXT_SOURCE}}}\n\
-\t$(shell mkdir -p $(dir $@))\n\
-\t$(CC) $(C_FLAGS) -c $< -o $@\n\
+.SECONDEXPANSION:\n\
+\n\
+$(DIRECTORIES):\n\
+\tmkdir -p $@\n\
+\n\
+$(OBJECTS) $(MAIN_OBJECTS): $(BUILD)/%{{{EXT_OBJECT}}}: %{{{EXT_SOURCE}}} | $$(@D)\n\
+\t$(CC) $(C_FLAGS) -MMD -MP -MF $@.d -c $< -o $@\n\
 \n\
-$(BUILD)/%: $(BUILD)/%{{{EXT_OBJECT}}} $(OBJECTS)\n\
-\t$(shell mkdir -p $(dir $@))\n\
+$(MAIN_EXECUTABLES): %{{{EXT_EXECUTABLE}}}: %{{{EXT_OBJECT}}} $(OBJECTS)\n\
 \t$(CC) $(C_FLAGS) $(OBJECTS) $< -o $@ $(C_LIBS)\n\
 \n\
+-include $(addsuffix .d,$(OBJECTS) $(MAIN_OBJECTS))\n\
+\n\
 .PHONY: clean\n\
 clean:\n\
-\trm -rf $(BUILD)\n";
+\trm -rf $(BUILD)\n",
+    NULL
+};
 
-static const char *const c_code = "\
+static const char *const c_code[] = {
+"\
+#define _POSIX_C_SOURCE 200809L\n\
+\n\
 #include <errno.h>\n\
+#include <stdbool.h>\n\
 #include <stdio.h>\n\
 #include <stdlib.h>\n\
 #include <string.h>\n\
@@ -261,18 +543,33 @@ static const char *const c_code = "\
 #include <sys/stat.h>\n\
 #include <sys/wait.h>\n\
 \n\
-#define ARRAY_SIZE(a) (sizeof(a)/sizeof(*(a)))\n\
+const char *CC[] = { {{{CC}}}NULL };\n\
+const char *C_FLAGS[] = { {{{C_FLAGS}}}NULL };\n\
+const char *C_LIBS[] = { {{{C_LIBS}}}NULL };\n\
+const char *SOURCES[] = { {{{SOURCES}}}NULL };\n\
+const char *MAIN_SOURCES[] = { {{{MAIN_SOURCES}}}NULL };\n\
 \n\
-const char *CC = {{{CC}}};\n\
-const char *C_FLAGS[] = { {{{C_FLAGS}}} };\n\
-const char *C_LIBS[] = { {{{C_LIBS}}} };\n\
-const char *SOURCES[] = { {{{SOURCES}}} };\n\
-const char *MAIN_SOURCES[] = { {{{MAIN_SOURCES}}} };\n\
+const char *OBJECTS[] = { {{{OBJECTS}}}NULL };\n\
+const char *MAIN_OBJECTS[] = { {{{MAIN_OBJECTS}}}NULL };\n\
 \n\
-const char *OBJECTS[] = { {{{OBJECTS}}} };\n\
-const char *MAIN_OBJECTS[] = { {{{MAIN_OBJECTS}}} };\n\
+const char *MAIN_EXECUTABLES[] = { {{{MAIN_EXECUTABLES}}}NULL };\n\
 \n\
-const char *MAIN_EXECUTABLES[] = { {{{MAIN_EXECUTABLES}}} };\n\
+/* maximum number of children running at once */\n\
+long Jobs;\n\
+/* number of children running right now */\n\
+long Running;\n\
+/* set when any child failed, no new children are started after that */\n\
+bool Failed;\n\
+\n\
+size_t count(const char **a)\n\
+{\n\
+    size_t n = 0;\n\
+\n\
+    while (a[n] != NULL) {\n\
+        n++;\n\
+    }\n\
+    return n;\n\
+}\n\
 \n\
 void make_directory(const char *path)\n\
 {\n\
@@ -287,7 +584,7 @@ void make_directory(const char *path)\n\
         if (mkdir(p, 0755) == -1) {\n\
             if (errno != EEXIST) {\n\
                 printf(\"mkdir '%s': %s\\n\", p, strerror(errno));\n\
-                abort();\n\
+                exit(1);\n\
             }\n\
         } else {\n\
             printf(\"mkdir %s\\n\", p);\n\
@@ -297,117 +594,311 @@ void make_directory(const char *path)\n\
     }\n\
 }\n\
 \n\
+/* gets the modification time in nanoseconds or -1 if the file is missing */\n\
+long long get_mtime(const char *path)\n\
+{\n\
+    struct stat st;\n\
+\n\
+    if (stat(path, &st) == -1) {\n\
+        return -1;\n\
+    }\n\
+    return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;\n\
+}\n\
+\n\
+/* checks the object against its source and the headers listed in the\n\
+ * dependency file the compiler wrote the last time */\n\
+bool needs_compile(const char *source, const char *object, const char *deps)\n\
+{\n\
+    long long mtime, m;\n\
+    FILE *fp;\n\
+    char path[4096];\n\
+    size_t len;\n\
+    int c;\n\
+    bool result;\n\
+\n\
+    mtime = get_mtime(object);\n\
+    if (mtime < 0 || get_mtime(source) > mtime) {\n\
+        return true;\n\
+    }\n\
+    fp = fopen(deps, \"r\");\n\
+    if (fp == NULL) {\n\
+        return true;\n\
+    }\n\
+    /* skip the target */\n\
+    do {\n\
+        c = fgetc(fp);\n\
+    } while (c != EOF && c != ':');\n\
+    result = c == EOF;\n\
+    len = 0;\n\
+    while (!result && c != EOF) {\n\
+        c = fgetc(fp);\n\
+        if (c == '\\\\') {\n\
+            c = fgetc(fp);\n\
+            if (c == '\\n') {\n\
+                continue;\n\
+            }\n\
+        } else if (c == EOF || c == ' ' || c == '\\t' || c == '\\n') {\n\
+            if (len > 0) {\n\
+                path[len] = '\\0';\n\
+                len = 0;\n\
+                m = get_mtime(path);\n\
+                if (m < 0 || m > mtime) {\n\
+                    result = true;\n\
+                }\n\
+            }\n\
+            if (c == '\\n') {\n\
+                break;\n\
+            }\n\
+            continue;\n\
+        }\n\
+        if (len == sizeof(path) - 1) {\n\
+            result = true;\n\
+        } else {\n\
+            path[len++] = c;\n\
+        }\n\
+    }\n\
+    fclose(fp);\n\
+    return result;\n\
+}\n\
+\n",
+"\
+/* waits for any child to finish */\n\
+void wait_child(void)\n\
+{\n\
+    int wstatus;\n\
+\n\
+    if (waitpid(-1, &wstatus, 0) == -1) {\n\
+        printf(\"waitpid: %s\\n\", strerror(errno));\n\
+        exit(1);\n\
+    }\n\
+    Running--;\n\
+    if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {\n\
+        Failed = true;\n\
+    }\n\
+}\n\
+\n\
+/* waits for all children to finish and stops if any of them failed */\n\
+void wait_children(void)\n\
+{\n\
+    while (Running > 0) {\n\
+        wait_child();\n\
+    }\n\
+    if (Failed) {\n\
+        printf(\"build failed\\n\");\n\
+        exit(1);\n\
+    }\n\
+}\n\
+\n\
+/* starts a child once there is a free slot */\n\
 void run_executable(char **args)\n\
 {\n\
     int pid;\n\
-    int wstatus;\n\
+\n\
+    while (Running >= Jobs) {\n\
+        wait_child();\n\
+    }\n\
+    if (Failed) {\n\
+        wait_children();\n\
+    }\n\
 \n\
     for (char **a = args; a[0] != NULL; a++) {\n\
         printf(\"%s \", a[0]);\n\
     }\n\
     printf(\"\\n\");\n\
+    fflush(stdout);\n\
 \n\
     pid = fork();\n\
     if (pid == -1) {\n\
         printf(\"fork: %s\\n\", strerror(errno));\n\
-        abort();\n\
+        Failed = true;\n\
+        wait_children();\n\
     }\n\
     if (pid == 0) {\n\
-        if (execvp(args[0], args) < 0) {\n\
-            printf(\"execvp: %s\\n\", strerror(errno));\n\
-            abort();\n\
-        }\n\
-    } else {\n\
-        waitpid(pid, &wstatus, 0);\n\
-        if (WEXITSTATUS(wstatus) != 0) {\n\
-            printf(\"`%s` returned: %d\\n\", args[0], wstatus);\n\
-            abort();\n\
-        }\n\
+        execvp(args[0], args);\n\
+        printf(\"execvp: %s\\n\", strerror(errno));\n\
+        _exit(127);\n\
     }\n\
+    Running++;\n\
 }\n\
+\n",
+"\
+void compile(char **args, size_t num_flags, const char *source,\n\
+        const char *object)\n\
+{\n\
+    char deps[strlen(object) + sizeof(\".d\")];\n\
 \n\
-int main(void)\n\
+    strcpy(deps, object);\n\
+    strcat(deps, \".d\");\n\
+    if (!needs_compile(source, object, deps)) {\n\
+        return;\n\
+    }\n\
+    make_directory(object);\n\
+    args[3 + num_flags] = deps;\n\
+    args[5 + num_flags] = (char*) source;\n\
+    args[7 + num_flags] = (char*) object;\n\
+    run_executable(args);\n\
+}\n\
+\n\
+int main(int argc, char **argv)\n\
 {\n\
-    char *args[1 + ARRAY_SIZE(C_FLAGS) + 1 + ARRAY_SIZE(OBJECTS) + 3 +\n\
-        ARRAY_SIZE(C_LIBS) + 1];\n\
+    size_t num_flags = count(C_FLAGS);\n\
+    size_t num_libs = count(C_LIBS);\n\
+    size_t num_objects = count(OBJECTS);\n\
+    char *args[1 + num_flags + 1 + num_objects + 6 + num_libs + 1];\n\
+    const char *jobs;\n\
+    long long mtime, m;\n\
 \n\
-    args[0] = (char*) CC;\n\
-    for (size_t i = 0; i < ARRAY_SIZE(C_FLAGS); i++) {\n\
-        args[1 + i] = (char*) C_FLAGS[i];\n\
+    for (int i = 1; i < argc; i++) {\n\
+        if (strcmp(argv[i], \"-j\") == 0 && i + 1 < argc) {\n\
+            jobs = argv[++i];\n\
+        } else if (strncmp(argv[i], \"-j\", 2) == 0 && argv[i][2] != '\\0') {\n\
+            jobs = &argv[i][2];\n\
+        } else {\n\
+            printf(\"usage: %s [-j jobs]\\n\", argv[0]);\n\
+            return 1;\n\
+        }\n\
+        Jobs = strtol(jobs, NULL, 10);\n\
+        if (Jobs <= 0) {\n\
+            printf(\"invalid number of jobs: %s\\n\", jobs);\n\
+            return 1;\n\
+        }\n\
+    }\n\
+    if (Jobs <= 0) {\n\
+        Jobs = sysconf(_SC_NPROCESSORS_ONLN);\n\
+        if (Jobs <= 0) {\n\
+            Jobs = 1;\n\
+        }\n\
     }\n\
 \n\
-    args[1 + ARRAY_SIZE(C_FLAGS)] = (char*) \"-c\";\n\
-    args[3 + ARRAY_SIZE(C_FLAGS)] = (char*) \"-o\";\n\
-    args[5 + ARRAY_SIZE(C_FLAGS)] = (char*) NULL;\n\
-    for (size_t i = 0; i < ARRAY_SIZE(SOURCES); i++) {\n\
-        args[2 + ARRAY_SIZE(C_FLAGS)] = (char*) SOURCES[i];\n\
-        args[4 + ARRAY_SIZE(C_FLAGS)] = (char*) OBJECTS[i];\n\
-        make_directory(OBJECTS[i]);\n\
-        run_executable(args);\n\
+    args[0] = (char*) CC[0];\n\
+    for (size_t i = 0; i < num_flags; i++) {\n\
+        args[1 + i] = (char*) C_FLAGS[i];\n\
     }\n\
 \n\
-    for (size_t i = 0; i < ARRAY_SIZE(MAIN_SOURCES); i++) {\n\
-        args[2 + ARRAY_SIZE(C_FLAGS)] = (char*) MAIN_SOURCES[i];\n\
-        args[4 + ARRAY_SIZE(C_FLAGS)] = (char*) MAIN_OBJECTS[i];\n\
-        make_directory(MAIN_OBJECTS[i]);\n\
-        run_executable(args);\n\
+    args[1 + num_flags] = (char*) \"-MMD\";\n\
+    args[2 + num_flags] = (char*) \"-MF\";\n\
+    args[4 + num_flags] = (char*) \"-c\";\n\
+    args[6 + num_flags] = (char*) \"-o\";\n\
+    args[8 + num_flags] = (char*) NULL;\n\
+    for (size_t i = 0; SOURCES[i] != NULL; i++) {\n\
+        compile(args, num_flags, SOURCES[i], OBJECTS[i]);\n\
     }\n\
+    for (size_t i = 0; MAIN_SOURCES[i] != NULL; i++) {\n\
+        compile(args, num_flags, MAIN_SOURCES[i], MAIN_OBJECTS[i]);\n\
+    }\n\
+    wait_children();\n\
 \n\
-    if (ARRAY_SIZE(MAIN_OBJECTS) == 0) {\n\
+    if (MAIN_OBJECTS[0] == NULL) {\n\
         printf(\"no main objects\\n\");\n\
         return 0;\n\
     }\n\
 \n\
-    for (size_t i = 0; i < ARRAY_SIZE(OBJECTS); i++) {\n\
-        args[1 + ARRAY_SIZE(C_FLAGS) + i] = (char*) OBJECTS[i];\n\
+    mtime = -1;\n\
+    for (size_t i = 0; i < num_objects; i++) {\n\
+        args[1 + num_flags + i] = (char*) OBJECTS[i];\n\
+        m = get_mtime(OBJECTS[i]);\n\
+        if (m > mtime) {\n\
+            mtime = m;\n\
+        }\n\
     }\n\
-    args[1 + ARRAY_SIZE(C_FLAGS) + ARRAY_SIZE(OBJECTS) + 1] = (char*) \"-o\";\n\
-    for (size_t i = 0; i < ARRAY_SIZE(C_LIBS); i++) {\n\
-        args[1 + ARRAY_SIZE(C_FLAGS) + ARRAY_SIZE(OBJECTS) + 3 + i] =\n\
-            (char*) C_LIBS[i];\n\
+    args[1 + num_flags + num_objects + 1] = (char*) \"-o\";\n\
+    for (size_t i = 0; i < num_libs; i++) {\n\
+        args[1 + num_flags + num_objects + 3 + i] = (char*) C_LIBS[i];\n\
     }\n\
-    args[1 + ARRAY_SIZE(C_FLAGS) + ARRAY_SIZE(OBJECTS) + 3 +\n\
-        ARRAY_SIZE(C_LIBS)] = NULL;\n\
-    for (size_t i = 0; i < ARRAY_SIZE(MAIN_OBJECTS); i++) {\n\
-        args[1 + ARRAY_SIZE(C_FLAGS) + ARRAY_SIZE(OBJECTS)] =\n\
-            (char*) MAIN_OBJECTS[i];\n\
-        args[1 + ARRAY_SIZE(C_FLAGS) + ARRAY_SIZE(OBJECTS) + 2] =\n\
-            (char*) MAIN_EXECUTABLES[i];\n\
+    args[1 + num_flags + num_objects + 3 + num_libs] = NULL;\n\
+    for (size_t i = 0; MAIN_OBJECTS[i] != NULL; i++) {\n\
+        /* relink if any object is newer than the executable */\n\
+        m = get_mtime(MAIN_EXECUTABLES[i]);\n\
+        if (m >= 0 && m >= mtime && m >= get_mtime(MAIN_OBJECTS[i])) {\n\
+            continue;\n\
+        }\n\
+        args[1 + num_flags + num_objects] = (char*) MAIN_OBJECTS[i];\n\
+        args[1 + num_flags + num_objects + 2] = (char*) MAIN_EXECUTABLES[i];\n\
         run_executable(args);\n\
     }\n\
+    wait_children();\n\
 \n\
     puts(\"run any of the main executables:\");\n\
-    for (size_t i = 0; i < ARRAY_SIZE(MAIN_EXECUTABLES); i++) {\n\
+    for (size_t i = 0; MAIN_EXECUTABLES[i] != NULL; i++) {\n\
         puts(MAIN_EXECUTABLES[i]);\n\
     }\n\
     return 0;\n\
-}\n";
+}\n",
+    NULL
+};
+
+static const char *const ninja_code[] = {
+"\
+cc = {{{CC}}}\n\
+c_flags = {{{C_FLAGS}}}\n\
+c_libs = {{{C_LIBS}}}\n\
+diff = {{{DIFF}}}\n\
+\n\
+rule cc\n\
+  command = $cc -MMD -MF $out.d $c_flags -c $in -o $out\n\
+  depfile = $out.d\n\
+  deps = gcc\n\
+  description = CC $out\n\
+\n\
+rule link\n\
+  command = $cc $c_flags $in -o $out $c_libs\n\
+  description = LINK $out\n\
+\n\
+rule test\n\
+  command = ./$in < $input > $out.tmp && $diff $data $out.tmp && $\n\
+      mv -f $out.tmp $out\n\
+  description = TEST $in\n\
+\n\
+rule run\n\
+  command = ./$in < $input > $out && cat $out\n\
+  description = RUN $in\n\
+\n\
+input = /dev/null\n\
+\n\
+{{{EDGES}}}",
+    NULL
+};
+
+static const char *const compdb_code[] = {
+    "{{{EDGES}}}",
+    NULL
+};
 
 int cmd_generate(char **args, size_t num_args, FILE *out)
 {
     static const struct generator {
         const char *name;
         void (*print)(char *const *s, size_t n, FILE *fp);
-        const char *code;
+        /* prints what is put in place of `{{{EDGES}}}`, may be `NULL` */
+        void (*print_edges)(const struct gen_object_list *gol, FILE *fp);
+        /* the template split into parts, ends with `NULL` */
+        const char *const *code;
     } generators[] = {
-        { "shell", print_shell_array, shell_code },
-        { "make", print_make_array, make_code },
-        { "c", print_c_array, c_code },
+        { "shell", print_shell_array, NULL, shell_code },
+        { "make", print_make_array, NULL, make_code },
+        { "c", print_c_array, NULL, c_code },
+        { "ninja", print_ninja_array, print_ninja_edges, ninja_code },
+        { "compdb", print_c_array, print_compdb_edges, compdb_code },
     };
     static const char *variables[] = {
         "sources", "raw_objects", "objects",
         "main_sources", "raw_main_objects", "main_objects", "main_executables",
     };
-    const struct generator *gen;
+    const struct generator *gen = NULL;
+    const struct variant *variant;
     struct gen_object_list gol;
     bool num;
     struct config_entry *entry;
     size_t v;
     char **values;
     size_t num_values;
+    FILE *fp;
+    char *edges = NULL;
+    size_t edges_size = 0;
 
-    if (num_args != 1) {
-        printf("need one argument for 'generate' (shell, make or c)\n");
+    if (num_args != 1 && num_args != 2) {
+        printf("need one or two arguments for 'generate'"
+                " (shell, make, c, ninja or compdb and a variant)\n");
         return -1;
     }
 
@@ -424,97 +915,142 @@ int cmd_generate(char **args, size_t num_args, FILE *out)
     }
     if (gen == NULL) {
         printf("invalid argument for 'generate',"
-                " expected 'shell', 'make' or 'c'\n");
+                " expected 'shell', 'make', 'c', 'ninja' or 'compdb'\n");
         return -1;
     }
 
+    /* nothing is built, the lists come from what is known about the files
+     * already, so the lock is only held for a short time */
     pthread_mutex_lock(&Files.lock);
-    if (check_conf() != 0 || !build_objects() || !link_executables()) {
+    if (check_conf() != 0) {
         pthread_mutex_unlock(&Files.lock);
         return -1;
     }
-    make_object_list(&gol);
+    if (num_args == 2) {
+        variant = get_variant(args[1]);
+        if (variant == NULL) {
+            printf("there is no variant '%s'\n", args[1]);
+            pthread_mutex_unlock(&Files.lock);
+            return -1;
+        }
+    } else {
+        variant = &Variants.ptr[0];
+    }
+    make_object_list(&gol, variant);
+    /* the edges may look up more files, so they are printed before unlocking
+     * and only written out afterwards */
+    if (gen->print_edges != NULL) {
+        fp = open_memstream(&edges, &edges_size);
+        if (fp == NULL) {
+            LOG("open_memstream: %s\n", strerror(errno));
+            pthread_mutex_unlock(&Files.lock);
+            clear_object_list(&gol);
+            return -1;
+        }
+        gen->print_edges(&gol, fp);
+        fclose(fp);
+    }
     pthread_mutex_unlock(&Files.lock);
 
-    for (const char *c = gen->code, *s, *start; c[0] != '\0'; c++) {
-        if (c[0] == '{' && c[1] == '{' && c[2] == '{') {
-            s = &c[3];
-            if (s[0] == '#') {
-                num = true;
-                s++;
-            } else {
-                num = false;
-            }
-            start = s;
-            while (isalpha(s[0]) || s[0] == '_') {
-                s++;
-            }
-            if (s[0] == '}' && s[1] == '}' && s[2] == '}') {
-                for (v = 0; v < ARRAY_SIZE(variables); v++) {
-                    if (strncasecmp(variables[v], start, s - start) == 0 &&
-                            variables[v][s - start] == '\0') {
-                        break;
-                    }
+    for (const char *const *part = gen->code; part[0] != NULL; part++) {
+        for (const char *c = part[0], *s, *start; c[0] != '\0'; c++) {
+            if (c[0] == '{' && c[1] == '{' && c[2] == '{') {
+                s = &c[3];
+                if (s[0] == '#') {
+                    num = true;
+                    s++;
+                } else {
+                    num = false;
                 }
-                if (v != ARRAY_SIZE(variables)) {
-                    switch (v) {
-                    case 0:
-                        values = gol.sources;
-                        num_values = gol.num;
-                        break;
-                    case 1:
-                        values = gol.raw_objects;
-                        num_values = gol.num;
-                        break;
-                    case 2:
-                        values = gol.objects;
-                        num_values = gol.num;
-                        break;
-
-                    case 3:
-                        values = gol.main_sources;
-                        num_values = gol.num_main;
-                        break;
-                    case 4:
-                        values = gol.raw_main_objects;
-                        num_values = gol.num_main;
-                        break;
-                    case 5:
-                        values = gol.main_objects;
-                        num_values = gol.num_main;
-                        break;
-                    case 6:
-                        values = gol.main_executables;
-                        num_values = gol.num_main;
-                        break;
+                start = s;
+                while (isalpha(s[0]) || s[0] == '_') {
+                    s++;
+                }
+                if (s[0] == '}' && s[1] == '}' && s[2] == '}') {
+                    if (s - start == 5 && strncasecmp(start, "edges", 5) == 0) {
+                        /* the generator writes the rules itself */
+                        fwrite(edges, 1, edges_size, out);
+                        c = &s[2];
+                        continue;
                     }
-                } else {
-                    entry = get_conf_l(start, s - start, NULL);
-                    if (entry == NULL) {
-                        num_values = 0;
+                    for (v = 0; v < ARRAY_SIZE(variables); v++) {
+                        if (strncasecmp(variables[v], start, s - start) == 0 &&
+                                variables[v][s - start] == '\0') {
+                            break;
+                        }
+                    }
+                    values = NULL;
+                    num_values = 0;
+                    if (v != ARRAY_SIZE(variables)) {
+                        switch (v) {
+                        case 0:
+                            values = gol.sources;
+                            num_values = gol.num;
+                            break;
+                        case 1:
+                            values = gol.raw_objects;
+                            num_values = gol.num;
+                            break;
+                        case 2:
+                            values = gol.objects;
+                            num_values = gol.num;
+                            break;
+
+                        case 3:
+                            values = gol.main_sources;
+                            num_values = gol.num_main;
+                            break;
+                        case 4:
+                            values = gol.raw_main_objects;
+                            num_values = gol.num_main;
+                            break;
+                        case 5:
+                            values = gol.main_objects;
+                            num_values = gol.num_main;
+                            break;
+                        case 6:
+                            values = gol.main_executables;
+                            num_values = gol.num_main;
+                            break;
+                        }
+                    } else if (s - start == 5 &&
+                            strncasecmp(start, "build", 5) == 0) {
+                        /* these are taken from the variant */
+                        values = &gol.variant.build;
+                        num_values = 1;
+                    } else if (s - start == 7 &&
+                            strncasecmp(start, "c_flags", 7) == 0) {
+                        values = gol.variant.c_flags;
+                        num_values = gol.variant.num_c_flags;
+                    } else if (s - start == 6 &&
+                            strncasecmp(start, "c_libs", 6) == 0) {
+                        values = gol.variant.c_libs;
+                        num_values = gol.variant.num_c_libs;
                     } else {
-                        values = entry->values;
-                        num_values = entry->num_values;
+                        entry = get_conf_l(start, s - start, NULL);
+                        if (entry != NULL) {
+                            values = entry->values;
+                            num_values = entry->num_values;
+                        }
                     }
-                }
-                if (num) {
-                    fprintf(out, "%zu", num_values);
-                } else if (entry != NULL) {
-                    if (num_values == 0) {
+                    if (num) {
+                        fprintf(out, "%zu", num_values);
+                    } else if (num_values == 0) {
                         if (s[3] == ' ') {
                             s++;
                         }
                     } else {
                         gen->print(values, num_values, out);
                     }
+                    c = &s[2];
+                    continue;
                 }
-                c = &s[2];
-                continue;
             }
+            fputc(c[0], out);
         }
-        fputc(c[0], out);
     }
 
+    free(edges);
     clear_object_list(&gol);
     return 0;
 }
@@ -42,6 +42,10 @@ int cmd_list(char **args, size_t num_args, FILE *out)
         printf("(%zu) %s [%s] %s\n", i + 1,
                 file->path, ext_strings[file->type], str_flags);
     }
+    if (Files.num_skipped > 0) {
+        printf("(%zu other files were not added, see EXT_COLLECT)\n",
+                Files.num_skipped);
+    }
     pthread_mutex_unlock(&Files.lock);
     return 0;
 }
@@ -2,29 +2,23 @@ int cmd_run(char **args, size_t num_args, FILE *out)
 {
     int result = 0;
     struct file *file;
-    bool has_exec = false;
+    size_t id, index;
     char **exec_args;
 
     (void) out;
 
     if (num_args == 0) {
         pthread_mutex_lock(&Files.lock);
-        for (size_t i = 0; i < Files.num; i++) {
-            file = Files.ptr[i];
-            if (file->type != EXT_TYPE_EXECUTABLE) {
-                continue;
-            }
-            has_exec = true;
-        }
-        if (has_exec) {
+        id = 0;
+        file = next_indexed_file(INDEX_EXECUTABLES, &id);
+        if (file != NULL) {
             printf("choose an executable:\n");
-            for (size_t i = 0; i < Files.num; i++) {
-                file = Files.ptr[i];
-                if (file->type != EXT_TYPE_EXECUTABLE) {
-                    continue;
-                }
-                printf("(%zu) %s\n", i + 1, file->path);
-            }
+            do {
+                /* the index within the file list can be used with $<index> */
+                (void) search_file(file->path, &index);
+                printf("(%zu) %s\n", index + 1, file->path);
+            } while (file = next_indexed_file(INDEX_EXECUTABLES, &id),
+                    file != NULL);
         } else {
             printf("(no executables)\n");
         }
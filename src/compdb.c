@@ -0,0 +1,197 @@
+#include "args.h"
+#include "compdb.h"
+#include "conf.h"
+#include "file.h"
+#include "salloc.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/// content of the last written compilation database
+static struct {
+    char *path;
+    char *data;
+    size_t size;
+} Written;
+
+/**
+ * @brief Prints a string as JSON string.
+ */
+static void print_json_string(const char *str, FILE *fp)
+{
+    fputc('\"', fp);
+    for (; str[0] != '\0'; str++) {
+        switch (str[0]) {
+        case '\"':
+        case '\\':
+            fputc('\\', fp);
+            fputc(str[0], fp);
+            break;
+        case '\n':
+            fputs("\\n", fp);
+            break;
+        case '\t':
+            fputs("\\t", fp);
+            break;
+        default:
+            if ((unsigned char) str[0] < 0x20) {
+                fprintf(fp, "\\u%04x", (unsigned char) str[0]);
+            } else {
+                fputc(str[0], fp);
+            }
+        }
+    }
+    fputc('\"', fp);
+}
+
+int print_compdb(FILE *fp, const struct variant *variant)
+{
+    char *cwd;
+    struct file **sources = NULL;
+    size_t num_sources = 0;
+    struct file *file;
+    size_t id;
+    char **args;
+
+    cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        LOG("getcwd: %s\n", strerror(errno));
+        return -1;
+    }
+
+    id = 0;
+    while (file = next_indexed_file(INDEX_SOURCES, &id), file != NULL) {
+        if (!(file->flags & FLAG_EXISTS)) {
+            continue;
+        }
+        sources = sreallocarray(sources, num_sources + 1, sizeof(*sources));
+        sources[num_sources++] = file;
+    }
+    qsort(sources, num_sources, sizeof(*sources), compare_file_paths);
+
+    fputs("[", fp);
+    for (size_t i = 0; i < num_sources; i++) {
+        file = get_object_file(sources[i], variant);
+        args = get_compile_args(sources[i], file, variant);
+
+        fputs(i == 0 ? "\n" : ",\n", fp);
+        fputs("  {\n    \"directory\": ", fp);
+        print_json_string(cwd, fp);
+        fputs(",\n    \"arguments\": [", fp);
+        for (char **a = args; a[0] != NULL; a++) {
+            if (a != args) {
+                fputs(", ", fp);
+            }
+            print_json_string(a[0], fp);
+        }
+        fputs("],\n    \"file\": ", fp);
+        print_json_string(sources[i]->path, fp);
+        fputs(",\n    \"output\": ", fp);
+        print_json_string(file->path, fp);
+        fputs("\n  }", fp);
+        free(args);
+    }
+    fputs("\n]\n", fp);
+
+    free(sources);
+    free(cwd);
+    return 0;
+}
+
+/**
+ * @brief Checks if a file has exactly given content.
+ */
+static bool has_content(const char *path, const char *data, size_t size)
+{
+    FILE *fp;
+    char buf[4096];
+    size_t n;
+    bool same = true;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    while (n = fread(buf, 1, sizeof(buf), fp), n > 0) {
+        if (n > size || memcmp(buf, data, n) != 0) {
+            same = false;
+            break;
+        }
+        data += n;
+        size -= n;
+    }
+    fclose(fp);
+    return same && size == 0;
+}
+
+void update_compdb(void)
+{
+    struct config_entry *entry;
+    const char *path;
+    char *data;
+    size_t size;
+    FILE *fp;
+    char *tmp;
+
+    entry = get_conf("compdb", NULL);
+    if (entry == NULL || entry->num_values == 0 ||
+            entry->values[0][0] == '\0') {
+        return;
+    }
+    path = entry->values[0];
+
+    fp = open_memstream(&data, &size);
+    if (fp == NULL) {
+        LOG("open_memstream: %s\n", strerror(errno));
+        return;
+    }
+    if (print_compdb(fp, &Variants.ptr[0]) != 0) {
+        fclose(fp);
+        free(data);
+        return;
+    }
+    fclose(fp);
+
+    if (Written.path != NULL && strcmp(Written.path, path) == 0 &&
+            Written.size == size && memcmp(Written.data, data, size) == 0) {
+        free(data);
+        return;
+    }
+    if (!has_content(path, data, size)) {
+        /* write and rename so readers never see half a file */
+        tmp = sasprintf("%s.tmp", path);
+        fp = fopen(tmp, "wb");
+        if (fp == NULL) {
+            LOG("could not open '%s': %s\n", tmp, strerror(errno));
+            free(tmp);
+            free(data);
+            return;
+        }
+        fwrite(data, 1, size, fp);
+        if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+            LOG("could not write '%s': %s\n", path, strerror(errno));
+            unlink(tmp);
+            free(tmp);
+            free(data);
+            return;
+        }
+        free(tmp);
+        DLOG("wrote compilation database '%s'\n", path);
+    }
+
+    free(Written.path);
+    free(Written.data);
+    Written.path = sstrdup(path);
+    Written.data = data;
+    Written.size = size;
+}
+
+void clear_compdb(void)
+{
+    free(Written.path);
+    free(Written.data);
+    Written.path = NULL;
+    Written.data = NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef COMPDB_H
+#define COMPDB_H
+
+#include "conf.h"
+
+#include <stdio.h>
+
+/**
+ * @brief Prints a compilation database (`compile_commands.json`) of all
+ * existing sources.
+ *
+ * Every entry has the exact arguments autocar compiles the source with (see
+ * `get_compile_args()`), the entries are sorted by path.
+ *
+ * @param fp        File to print to.
+ * @param variant   The variant whose objects and flags are used.
+ *
+ * @return 0 on success, -1 if the current directory could not be determined.
+ */
+int print_compdb(FILE *fp, const struct variant *variant);
+
+/**
+ * @brief Writes the compilation database of the first variant to the path in
+ * `COMPDB`.
+ *
+ * Nothing happens when `COMPDB` is not set. The file is only written when its
+ * content differs from what was written last time or from what is on disk, so
+ * tools watching the file do not reload it after every cycle.
+ */
+void update_compdb(void);
+
+/**
+ * @brief Frees the copy of the last written compilation database.
+ */
+void clear_compdb(void);
+
+#endif
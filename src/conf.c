@@ -17,6 +17,23 @@
 
 struct config Config;
 
+struct variant_list Variants;
+
+/**
+ * The environment programs started by autocar get: the variables of the config
+ * and those autocar was started with, see `get_conf_environ()`.
+ */
+static struct {
+    /// all variables as "NAME=value", ends with `NULL`
+    char **ptr;
+    /// the first `num_owned` strings were made from the config and must be
+    /// freed, the others belong to `environ`
+    size_t num_owned;
+    /// whether `ptr` matches the config, it is only built again when a
+    /// program is started after the config changed
+    bool valid;
+} Environment;
+
 struct config_entry *get_conf(const char *name, size_t *pindex)
 {
     size_t l, m, r;
@@ -48,7 +65,11 @@ struct config_entry *get_conf(const char *name, size_t *pindex)
     return NULL;
 }
 
-struct config_entry *get_conf_l(const char *name, size_t name_len, size_t *pindex)
+/**
+ * @brief Gets the entry with given name with given length (see `get_conf_l()`).
+ */
+static struct config_entry *search_conf(const char *name, size_t name_len,
+        size_t *pindex)
 {
     size_t l, m, r;
     int cmp;
@@ -79,10 +100,20 @@ struct config_entry *get_conf_l(const char *name, size_t name_len, size_t *pinde
     if (pindex != NULL) {
         *pindex = r;
     }
-    printf("not found: %.*s\n", (int) name_len, name);
     return NULL;
 }
 
+struct config_entry *get_conf_l(const char *name, size_t name_len, size_t *pindex)
+{
+    struct config_entry *entry;
+
+    entry = search_conf(name, name_len, pindex);
+    if (entry == NULL) {
+        printf("not found: %.*s\n", (int) name_len, name);
+    }
+    return entry;
+}
+
 /**
  * Returns the index of the given value within the entry or `SIZE_MAX` if the
  * entry was not found.
@@ -103,8 +134,6 @@ int set_conf(const char *name, const char **values,
     size_t index;
     struct config_entry *entry;
     char *upper;
-    char *env;
-    size_t env_len, env_i;
 
     DLOG("changing '%s' with:", name);
     for (size_t i = 0; i < num_values; i++) {
@@ -173,24 +202,113 @@ int set_conf(const char *name, const char **values,
     }
     DLOG("\n");
 
-    env_len = entry->num_values == 0 ? 1 : 0;
+    Environment.valid = false;
+    return 0;
+}
+
+/**
+ * @brief Makes the "NAME=value" string of an entry, the values are separated
+ * by a space.
+ */
+static char *make_env_string(const struct config_entry *entry)
+{
+    size_t name_len, len;
+    char *env;
+
+    name_len = strlen(entry->name);
+    len = name_len + 2;
     for (size_t i = 0; i < entry->num_values; i++) {
-        env_len += strlen(entry->values[i]) + 1;
+        len += strlen(entry->values[i]) + 1;
     }
-    env = smalloc(env_len);
-    env_i = 0;
-    for (size_t i = 0, len; i < entry->num_values; i++) {
+    env = smalloc(len);
+    memcpy(env, entry->name, name_len);
+    len = name_len;
+    env[len++] = '=';
+    for (size_t i = 0, n; i < entry->num_values; i++) {
         if (i > 0) {
-            env[env_i++] = ' ';
+            env[len++] = ' ';
         }
-        len = strlen(entry->values[i]);
-        memcpy(&env[env_i], entry->values[i], len);
-        env_i += len;
+        n = strlen(entry->values[i]);
+        memcpy(&env[len], entry->values[i], n);
+        len += n;
     }
-    env[env_i] = '\0';
-    setenv(entry->name, env, 1);
-    free(env);
-    return 0;
+    env[len] = '\0';
+    return env;
+}
+
+static void clear_environment(void)
+{
+    for (size_t i = 0; i < Environment.num_owned; i++) {
+        free(Environment.ptr[i]);
+    }
+    free(Environment.ptr);
+    Environment.ptr = NULL;
+    Environment.num_owned = 0;
+    Environment.valid = false;
+}
+
+char **get_conf_environ(void)
+{
+    size_t num_environ = 0, num;
+    const char *equal;
+    struct config_entry *entry;
+
+    if (Environment.valid) {
+        return Environment.ptr;
+    }
+    clear_environment();
+
+    while (environ[num_environ] != NULL) {
+        num_environ++;
+    }
+    Environment.ptr = sreallocarray(NULL,
+            Config.num_entries + num_environ + 1, sizeof(*Environment.ptr));
+    for (size_t i = 0; i < Config.num_entries; i++) {
+        Environment.ptr[i] = make_env_string(&Config.entries[i]);
+    }
+    num = Config.num_entries;
+    Environment.num_owned = num;
+    /* the names in the config are upper case, a variable of the environment
+     * is only replaced if its name is exactly the same */
+    for (size_t i = 0; i < num_environ; i++) {
+        equal = strchr(environ[i], '=');
+        if (equal != NULL) {
+            entry = search_conf(environ[i], equal - environ[i], NULL);
+            if (entry != NULL &&
+                    strncmp(entry->name, environ[i], equal - environ[i]) == 0) {
+                continue;
+            }
+        }
+        Environment.ptr[num++] = environ[i];
+    }
+    Environment.ptr[num] = NULL;
+    Environment.valid = true;
+    return Environment.ptr;
+}
+
+char **copy_conf_environ(void)
+{
+    char **envp, **copy;
+    size_t num = 0;
+
+    envp = get_conf_environ();
+    while (envp[num] != NULL) {
+        num++;
+    }
+    copy = sreallocarray(NULL, num + 1, sizeof(*copy));
+    for (size_t i = 0; i < num; i++) {
+        copy[i] = sstrdup(envp[i]);
+    }
+    copy[num] = NULL;
+    return copy;
+}
+
+void free_conf_environ(char **envp)
+{
+    for (char **e = envp; e[0] != NULL; e++) {
+        free(e[0]);
+    }
+    free(envp);
 }
 
 static inline void print_value(FILE *fp, char *val)
@@ -230,6 +348,222 @@ void dump_conf(FILE *fp)
     }
 }
 
+/**
+ * @brief Copies values into a new array.
+ */
+static char **copy_values(char *const *values, size_t num)
+{
+    char **copy;
+
+    copy = sreallocarray(NULL, num, sizeof(*copy));
+    for (size_t i = 0; i < num; i++) {
+        copy[i] = sstrdup(values[i]);
+    }
+    return copy;
+}
+
+/**
+ * @brief Copies the values of the entry with given name.
+ *
+ * @param name      Name of the entry.
+ * @param fallback  Name of the entry to use if the first one is not set.
+ * @param pvalues   Output of the copied values.
+ * @param pnum      Output of the number of values.
+ */
+static void copy_conf_values(const char *name, const char *fallback,
+        char ***pvalues, size_t *pnum)
+{
+    struct config_entry *entry;
+
+    entry = get_conf(name, NULL);
+    if (entry == NULL) {
+        entry = get_conf(fallback, NULL);
+    }
+    *pvalues = copy_values(entry->values, entry->num_values);
+    *pnum = entry->num_values;
+}
+
+void copy_variant(struct variant *copy, const struct variant *variant)
+{
+    copy->name = sstrdup(variant->name);
+    copy->build = sstrdup(variant->build);
+    copy->c_flags = copy_values(variant->c_flags, variant->num_c_flags);
+    copy->num_c_flags = variant->num_c_flags;
+    copy->c_libs = copy_values(variant->c_libs, variant->num_c_libs);
+    copy->num_c_libs = variant->num_c_libs;
+}
+
+void clear_variant(struct variant *variant)
+{
+    free(variant->name);
+    free(variant->build);
+    for (size_t i = 0; i < variant->num_c_flags; i++) {
+        free(variant->c_flags[i]);
+    }
+    free(variant->c_flags);
+    for (size_t i = 0; i < variant->num_c_libs; i++) {
+        free(variant->c_libs[i]);
+    }
+    free(variant->c_libs);
+}
+
+static bool are_values_equal(char **a, size_t num_a, char **b, size_t num_b)
+{
+    if (num_a != num_b) {
+        return false;
+    }
+    for (size_t i = 0; i < num_a; i++) {
+        if (strcmp(a[i], b[i]) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool are_variants_equal(const struct variant *a, size_t num_a,
+        const struct variant *b, size_t num_b)
+{
+    if (num_a != num_b) {
+        return false;
+    }
+    for (size_t i = 0; i < num_a; i++) {
+        if (strcmp(a[i].name, b[i].name) != 0 ||
+                strcmp(a[i].build, b[i].build) != 0 ||
+                !are_values_equal(a[i].c_flags, a[i].num_c_flags,
+                    b[i].c_flags, b[i].num_c_flags) ||
+                !are_values_equal(a[i].c_libs, a[i].num_c_libs,
+                    b[i].c_libs, b[i].num_c_libs)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Checks if a directory is the same as or inside another one.
+ */
+static bool is_directory_within(const char *inner, const char *outer)
+{
+    size_t len;
+
+    while (inner[0] == '.' && inner[1] == '/') {
+        inner += 2;
+    }
+    while (outer[0] == '.' && outer[1] == '/') {
+        outer += 2;
+    }
+    len = strlen(outer);
+    while (len > 0 && outer[len - 1] == '/') {
+        len--;
+    }
+    return strncmp(inner, outer, len) == 0 &&
+        (inner[len] == '\0' || inner[len] == '/');
+}
+
+/**
+ * @brief Makes the variants from the config and replaces `Variants` if they
+ * differ.
+ *
+ * @return 0 on success, -1 if a variant is not valid.
+ */
+static int update_variants(void)
+{
+    struct config_entry *variants_entry, *build_entry;
+    struct variant *variants;
+    size_t num_variants = 0;
+    const char *name;
+    char *key;
+    bool valid = true;
+
+    variants_entry = get_conf("variants", NULL);
+    build_entry = get_conf("build", NULL);
+    if (variants_entry == NULL || variants_entry->num_values == 0) {
+        variants = smalloc(sizeof(*variants));
+        variants->name = sstrdup("");
+        variants->build = sstrdup(build_entry->values[0]);
+        copy_conf_values("c_flags", "c_flags", &variants->c_flags,
+                &variants->num_c_flags);
+        copy_conf_values("c_libs", "c_libs", &variants->c_libs,
+                &variants->num_c_libs);
+        num_variants = 1;
+    } else {
+        variants = sreallocarray(NULL, variants_entry->num_values,
+                sizeof(*variants));
+        for (size_t i = 0; i < variants_entry->num_values; i++) {
+            name = variants_entry->values[i];
+            if (name[0] == '\0' || name[strspn(name,
+                        "abcdefghijklmnopqrstuvwxyz"
+                        "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_")] != '\0') {
+                fprintf(stderr, "invalid variant name '%s', only letters,"
+                        " digits and '_' are allowed\n", name);
+                valid = false;
+                break;
+            }
+            variants[num_variants].name = sstrdup(name);
+            key = sasprintf("build_%s", name);
+            build_entry = get_conf(key, NULL);
+            free(key);
+            if (build_entry != NULL && build_entry->num_values == 1) {
+                variants[num_variants].build =
+                    sstrdup(build_entry->values[0]);
+            } else {
+                variants[num_variants].build = sasprintf("%s/%s",
+                        get_conf("build", NULL)->values[0], name);
+            }
+            key = sasprintf("c_flags_%s", name);
+            copy_conf_values(key, "c_flags", &variants[num_variants].c_flags,
+                    &variants[num_variants].num_c_flags);
+            free(key);
+            key = sasprintf("c_libs_%s", name);
+            copy_conf_values(key, "c_libs", &variants[num_variants].c_libs,
+                    &variants[num_variants].num_c_libs);
+            free(key);
+            num_variants++;
+        }
+    }
+
+    /* the files of a variant are told apart by their directory */
+    for (size_t i = 0; valid && i < num_variants; i++) {
+        for (size_t j = 0; j < num_variants; j++) {
+            if (i != j && is_directory_within(variants[i].build,
+                        variants[j].build)) {
+                fprintf(stderr, "the build directory of variant '%s' (%s) is"
+                        " inside the one of '%s' (%s)\n", variants[i].name,
+                        variants[i].build, variants[j].name,
+                        variants[j].build);
+                valid = false;
+                break;
+            }
+        }
+    }
+
+    if (!valid || are_variants_equal(variants, num_variants,
+                Variants.ptr, Variants.num)) {
+        for (size_t i = 0; i < num_variants; i++) {
+            clear_variant(&variants[i]);
+        }
+        free(variants);
+        return valid ? 0 : -1;
+    }
+    for (size_t i = 0; i < Variants.num; i++) {
+        clear_variant(&Variants.ptr[i]);
+    }
+    free(Variants.ptr);
+    Variants.ptr = variants;
+    Variants.num = num_variants;
+    return 0;
+}
+
+struct variant *get_variant(const char *name)
+{
+    for (size_t i = 0; i < Variants.num; i++) {
+        if (strcasecmp(Variants.ptr[i].name, name) == 0) {
+            return &Variants.ptr[i];
+        }
+    }
+    return NULL;
+}
+
 int check_conf(void)
 {
     static const struct {
@@ -273,12 +607,15 @@ int check_conf(void)
     exts_entry = get_conf("extensions", NULL);
     for (size_t i = 0; i < ARRAY_SIZE(checks_ext); i++) {
         entry = get_conf(checks_ext[i].name, NULL);
-        if (entry != NULL && entry->num_values == 1) {
+        if (entry != NULL && entry->num_values == 1 &&
+                strcmp(exts_entry->values[checks_ext[i].type],
+                    entry->values[0]) != 0) {
             free(exts_entry->values[checks_ext[i].type]);
             exts_entry->values[checks_ext[i].type] = sstrdup(entry->values[0]);
+            Environment.valid = false;
         }
     }
-    return 0;
+    return update_variants();
 }
 
 bool find_autocar_conf(const char *name_or_path)
@@ -340,6 +677,7 @@ void set_default_conf(void)
     };
     static const char *default_interval = "100";
     static const char *default_prompt = ">>> ";
+    static const char *default_ignore = ".git/";
 
     set_conf("cc", &default_compiler, 1, SET_CONF_MODE_SET);
     set_conf("diff", &default_diff, 1, SET_CONF_MODE_SET);
@@ -352,6 +690,7 @@ void set_default_conf(void)
     set_conf("ext_executable", &default_extensions[4], 1, SET_CONF_MODE_SET);
     set_conf("interval", &default_interval, 1, SET_CONF_MODE_SET);
     set_conf("prompt", &default_prompt, 1, SET_CONF_MODE_SET);
+    set_conf("ignore", &default_ignore, 1, SET_CONF_MODE_SET);
 }
 
 void clear_conf(void)
@@ -366,4 +705,10 @@ void clear_conf(void)
         }
         free(entry->values);
     }
+    clear_environment();
+
+    for (size_t i = 0; i < Variants.num; i++) {
+        clear_variant(&Variants.ptr[i]);
+    }
+    free(Variants.ptr);
 }
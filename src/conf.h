@@ -24,6 +24,35 @@ extern struct config {
     size_t num_entries;
 } Config;
 
+/**
+ * A build of all sources with its own flags into its own directory, the
+ * variants share the collected files and their dependencies (see `VARIANTS`).
+ */
+struct variant {
+    /// name of the variant, empty if `VARIANTS` is not set
+    char *name;
+    /// directory the objects and executables are put in
+    char *build;
+    /// flags to send the compiler
+    char **c_flags;
+    /// number of elements in `c_flags`
+    size_t num_c_flags;
+    /// flags to send the linker
+    char **c_libs;
+    /// number of elements in `c_libs`
+    size_t num_c_libs;
+};
+
+/**
+ * The variants that are built, updated by `check_conf()`.
+ */
+extern struct variant_list {
+    /// all variants in the order of `VARIANTS`
+    struct variant *ptr;
+    /// number of elements in `ptr`, at least 1 after `check_conf()` succeeded
+    size_t num;
+} Variants;
+
 /**
  * @brief Gets the entry with given name.
  *
@@ -45,6 +74,34 @@ struct config_entry *get_conf(const char *name, size_t *pindex);
  */
 struct config_entry *get_conf_l(const char *name, size_t name_len, size_t *pindex);
 
+/**
+ * @brief Gets the environment for a program autocar starts.
+ *
+ * Every variable of the config is in it as "NAME=value" with its values
+ * separated by a space, they replace variables of the same name autocar was
+ * started with. The config is never put into the environment of autocar
+ * itself.
+ *
+ * The array is only built again when the config changed since the last call.
+ *
+ * @return The variables, ending with `NULL`. It is valid until the config
+ *         changes.
+ */
+char **get_conf_environ(void);
+
+/**
+ * @brief Copies the result of `get_conf_environ()`, for threads that start
+ * programs while the config may change.
+ *
+ * @return The copy, free it with `free_conf_environ()`.
+ */
+char **copy_conf_environ(void);
+
+/**
+ * @brief Frees a copy from `copy_conf_environ()`.
+ */
+void free_conf_environ(char **envp);
+
 #define SET_CONF_MODE_SET 0
 #define SET_CONF_MODE_APPEND 1
 #define SET_CONF_MODE_SUBTRACT 2
@@ -63,6 +120,26 @@ struct config_entry *get_conf_l(const char *name, size_t name_len, size_t *pinde
 int set_conf(const char *name, const char **values,
         size_t num_values, int mode);
 
+/**
+ * @brief Finds the variant with given name (ignoring case).
+ *
+ * @return The variant or `NULL` if there is none with that name.
+ */
+struct variant *get_variant(const char *name);
+
+/**
+ * @brief Copies a variant, the copy stays valid when `Variants` is replaced.
+ *
+ * @param copy      Output of the copy, free it with `clear_variant()`.
+ * @param variant   The variant to copy.
+ */
+void copy_variant(struct variant *copy, const struct variant *variant);
+
+/**
+ * @brief Frees all members of a variant.
+ */
+void clear_variant(struct variant *variant);
+
 /**
  * @brief Looks for the autocar config file.
  *
@@ -83,6 +160,14 @@ void dump_conf(FILE *fp);
 
 /**
  * @brief Checks whether the config is ready for compiling.
+ *
+ * Also updates `Variants`, each name in `VARIANTS` is a variant that takes
+ * its settings from `C_FLAGS_<name>`, `C_LIBS_<name>` and `BUILD_<name>`.
+ * The first two default to `C_FLAGS` and `C_LIBS`, the directory to
+ * `<BUILD>/<name>`. Without `VARIANTS`, there is a single variant with the
+ * plain settings. If nothing changed, the list is left as is.
+ *
+ * @return 0 if the config is valid, -1 otherwise.
  */
 int check_conf(void);
 
@@ -0,0 +1,328 @@
+#include "args.h"
+#include "cmd.h"
+#include "daemon.h"
+#include "protocol.h"
+#include "salloc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+/// seconds a client may take to send its command line
+#define CLIENT_TIMEOUT 5
+
+/// number of descriptors a client sends: standard input, output and error
+#define NUM_CLIENT_FDS 3
+
+char *get_daemon_path(const char *conf)
+{
+    const char *name;
+
+    if (conf == NULL) {
+        return sstrdup(".autocar.sock");
+    }
+    name = strrchr(conf, '/');
+    if (name == NULL) {
+        return sasprintf(".%s.sock", conf);
+    }
+    name++;
+    return sasprintf("%.*s.%s.sock", (int) (name - conf), conf, name);
+}
+
+/**
+ * @brief Fills in the address of a socket path.
+ *
+ * @return 0 on success, -1 if the path is too long.
+ */
+static int make_address(struct sockaddr_un *addr, const char *path)
+{
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "socket path '%s' is too long\n", path);
+        return -1;
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/**
+ * @brief Connects to the socket of a daemon.
+ *
+ * @return The socket or -1 on failure (see `errno`).
+ */
+static int connect_daemon(const struct sockaddr_un *addr)
+{
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (const struct sockaddr*) addr, sizeof(*addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int open_daemon(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd, other;
+
+    if (make_address(&addr, path) == -1) {
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd == -1) {
+        fprintf(stderr, "socket: %s\n", strerror(errno));
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) == -1) {
+        if (errno != EADDRINUSE) {
+            fprintf(stderr, "bind '%s': %s\n", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        other = connect_daemon(&addr);
+        if (other != -1) {
+            fprintf(stderr, "a daemon is already running on '%s'\n", path);
+            close(other);
+            close(fd);
+            return -1;
+        }
+        LOG("replacing stale socket '%s'\n", path);
+        if (unlink(path) == -1 ||
+                bind(fd, (struct sockaddr*) &addr, sizeof(addr)) == -1) {
+            fprintf(stderr, "bind '%s': %s\n", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+    if (listen(fd, 16) == -1) {
+        fprintf(stderr, "listen '%s': %s\n", path, strerror(errno));
+        close_daemon(fd, path);
+        return -1;
+    }
+    /* a client going away must not take the daemon with it */
+    signal(SIGPIPE, SIG_IGN);
+    LOG("listening on '%s'\n", path);
+    return fd;
+}
+
+/**
+ * @brief Receives the first part of a request.
+ *
+ * @param fd        The client.
+ * @param psize     Output of the size of the command line.
+ * @param fds       Output of the descriptors of the client.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int receive_request(int fd, uint32_t *psize, int fds[NUM_CLIENT_FDS])
+{
+    unsigned char size[4];
+    union {
+        struct cmsghdr header;
+        char data[CMSG_SPACE(sizeof(int) * NUM_CLIENT_FDS)];
+    } control;
+    struct iovec iov = { .iov_base = size, .iov_len = sizeof(size) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.data,
+        .msg_controllen = sizeof(control.data),
+    };
+    struct cmsghdr *cmsg;
+    size_t num_fds = 0;
+    ssize_t n;
+
+    do {
+        n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0) {
+        return -1;
+    }
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET &&
+            cmsg->cmsg_type == SCM_RIGHTS) {
+        num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * num_fds);
+    }
+    if (num_fds != NUM_CLIENT_FDS || (msg.msg_flags & MSG_CTRUNC) ||
+            ((size_t) n < sizeof(size) &&
+             read_all(fd, &size[n], sizeof(size) - n) == -1)) {
+        for (size_t i = 0; i < num_fds; i++) {
+            close(fds[i]);
+        }
+        return -1;
+    }
+    *psize = (uint32_t) size[0] << 24 | (uint32_t) size[1] << 16 |
+        (uint32_t) size[2] << 8 | (uint32_t) size[3];
+    return 0;
+}
+
+/**
+ * @brief Runs the command line of a single client.
+ */
+static void serve_client(int fd)
+{
+    struct timeval timeout = { .tv_sec = CLIENT_TIMEOUT };
+    struct ucred cred;
+    socklen_t cred_size = sizeof(cred);
+    uint32_t size;
+    int fds[NUM_CLIENT_FDS];
+    int saved[NUM_CLIENT_FDS];
+    char *line;
+    int result;
+
+    /* the command line may run anything, like ":rm -rf ~" */
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_size) == -1 ||
+            cred.uid != getuid()) {
+        LOG("refusing a client of another user\n");
+        return;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (receive_request(fd, &size, fds) == -1) {
+        LOG("invalid request from a client\n");
+        return;
+    }
+    if (size > DAEMON_MAX_LINE) {
+        LOG("command line of a client is too long\n");
+        for (int i = 0; i < NUM_CLIENT_FDS; i++) {
+            close(fds[i]);
+        }
+        return;
+    }
+    line = smalloc(size + 1);
+    if (read_all(fd, line, size) == -1) {
+        LOG("could not read command line of a client\n");
+        for (int i = 0; i < NUM_CLIENT_FDS; i++) {
+            close(fds[i]);
+        }
+        free(line);
+        return;
+    }
+    line[size] = '\0';
+    DLOG("client sent: %s\n", line);
+
+    /* everything printed while running goes to the client, including what
+     * the compilers and tests print */
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < NUM_CLIENT_FDS; i++) {
+        saved[i] = fcntl(i, F_DUPFD_CLOEXEC, NUM_CLIENT_FDS);
+        if (fds[i] != i) {
+            dup2(fds[i], i);
+            close(fds[i]);
+        }
+    }
+    result = run_command_line(line);
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < NUM_CLIENT_FDS; i++) {
+        dup2(saved[i], i);
+        close(saved[i]);
+    }
+    clearerr(stdout);
+    clearerr(stderr);
+    free(line);
+
+    write_u32(fd, result == 0 ? 0 : 1);
+}
+
+void serve_daemon(int server, long timeout)
+{
+    struct pollfd pfd = { .fd = server, .events = POLLIN };
+    struct timespec ts;
+    int client;
+
+    ts.tv_sec = timeout / 1000000;
+    ts.tv_nsec = timeout % 1000000 * 1000;
+    if (ppoll(&pfd, 1, timeout < 0 ? NULL : &ts, NULL) <= 0) {
+        return;
+    }
+    while (client = accept4(server, NULL, NULL, SOCK_CLOEXEC), client != -1) {
+        serve_client(client);
+        close(client);
+    }
+}
+
+void close_daemon(int server, const char *path)
+{
+    close(server);
+    unlink(path);
+}
+
+int send_to_daemon(const char *path, const char *line)
+{
+    struct sockaddr_un addr;
+    const int fds[NUM_CLIENT_FDS] = { 0, 1, 2 };
+    size_t len;
+    unsigned char size[4];
+    union {
+        struct cmsghdr header;
+        char data[CMSG_SPACE(sizeof(fds))];
+    } control;
+    struct iovec iov = { .iov_base = size, .iov_len = sizeof(size) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.data,
+        .msg_controllen = sizeof(control.data),
+    };
+    struct cmsghdr *cmsg;
+    uint32_t status;
+    int fd;
+
+    len = strlen(line);
+    if (len > DAEMON_MAX_LINE) {
+        fprintf(stderr, "command line is too long\n");
+        return -1;
+    }
+    if (make_address(&addr, path) == -1) {
+        return -1;
+    }
+    fd = connect_daemon(&addr);
+    if (fd == -1) {
+        fprintf(stderr, "could not connect to a daemon on '%s': %s\n", path,
+                strerror(errno));
+        return -1;
+    }
+
+    size[0] = len >> 24;
+    size[1] = len >> 16;
+    size[2] = len >> 8;
+    size[3] = len;
+    memset(&control, 0, sizeof(control));
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(size) ||
+            write_all(fd, line, len) == -1) {
+        fprintf(stderr, "could not send to the daemon: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (read_u32(fd, &status) == -1) {
+        fprintf(stderr, "the daemon did not answer\n");
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return status == 0 ? 0 : 1;
+}
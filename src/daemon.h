@@ -0,0 +1,71 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+/*
+ * A running autocar (`--daemon`) accepts command lines on a UNIX socket next
+ * to its config, a client (`--send`) connects to it to run them without
+ * loading the config, collecting the files or reading the dependencies again.
+ *
+ * Request:
+ * - size of the command line (u32), sent with the standard input, output and
+ *   error of the client attached (`SCM_RIGHTS`)
+ * - the command line
+ *
+ * Response:
+ * - 0 if the command line succeeded, otherwise 1 (u32)
+ *
+ * The daemon runs the command line with the descriptors of the client in place
+ * of its own, so the output (also that of compilers and tests) goes straight to
+ * the client and is never copied through the socket.
+ */
+
+/// maximum size of a command line sent to a daemon
+#define DAEMON_MAX_LINE (64 * 1024)
+
+/**
+ * @brief Gets the path of the socket belonging to a config.
+ *
+ * It is the config with a '.' in front and ".sock" after, like
+ * ".autocar.conf.sock".
+ *
+ * @param conf  The config, `NULL` if there is none.
+ *
+ * @return The path, it must be freed.
+ */
+char *get_daemon_path(const char *conf);
+
+/**
+ * @brief Creates the socket of a daemon.
+ *
+ * A socket left behind by a daemon that is gone is replaced, if another daemon
+ * still answers on it, this fails.
+ *
+ * @return The socket or -1 on failure.
+ */
+int open_daemon(const char *path);
+
+/**
+ * @brief Waits for clients and runs their command lines.
+ *
+ * All clients that are waiting are served, one after the other.
+ *
+ * @param server    The socket made by `open_daemon()`.
+ * @param timeout   Microseconds to wait for the first client, -1 to wait
+ *                  until one comes.
+ */
+void serve_daemon(int server, long timeout);
+
+/**
+ * @brief Closes the socket of a daemon and removes it.
+ */
+void close_daemon(int server, const char *path);
+
+/**
+ * @brief Sends a command line to a daemon and waits until it ran.
+ *
+ * @return 0 if the command line succeeded, 1 if it failed and -1 if there is
+ *         no daemon or the connection broke.
+ */
+int send_to_daemon(const char *path, const char *line);
+
+#endif
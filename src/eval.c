@@ -1,17 +1,24 @@
+#include "arena.h"
 #include "args.h"
 #include "file.h"
 #include "conf.h"
 #include "cmd.h"
 #include "salloc.h"
+#include "sha256.h"
 #include "macros.h"
+#include "memo.h"
+#include "protocol.h"
+#include "util.h"
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <sys/stat.h>
 #include <sys/wait.h>
 
 #define STATE_ERROR (-1)
@@ -22,21 +29,200 @@
 #define STATE_REDIRECT 4
 #define STATE_SYSTEM 5
 #define STATE_EXEC_SYSTEM 6
+#define STATE_MEMO_SYSTEM 7
+
+/// most `NAME ::= <shell>` lines of a script running at the same time
+#define MAX_CONCURRENT_COMMANDS 16
+
+#define PART_TEXT 0
+#define PART_FILE 1
+#define PART_VALUE 2
+#define PART_VALUES 3
+
+/// memory of the arguments of all command lines, released after each segment
+static struct arena EvalMemory;
+
+/**
+ * A piece of a compiled argument.
+ */
+struct part {
+    /// `PART_TEXT` for text, `PART_FILE` for the path of a file ("$1"),
+    /// `PART_VALUE` for the first value of a variable within an argument and
+    /// `PART_VALUES` for all values of a variable, each its own argument
+    int type;
+    /// the text or the name of the variable
+    const char *s;
+    /// length of `s`
+    size_t len;
+    /// index of the file, starting at 1
+    size_t index;
+};
+
+/**
+ * An argument of a compiled segment, it is expanded each time it runs.
+ */
+struct word {
+    struct part *parts;
+    size_t num_parts;
+};
 
 struct state {
     int state;
+    /// where the arguments or the compiled words are allocated
+    struct arena *arena;
+    /// the arguments, they and the array are in `arena`
     char **args;
+    /// number of arguments or compiled words
     size_t num_args;
+    /// number of arguments `args` has room for
+    size_t a_args;
+    /// whether some arguments are values of the config and not copies
+    bool borrows;
     char *line;
+
+    /// whether the line is compiled into `words` instead of being expanded
+    bool compiling;
+    struct word *words;
+    /// number of words `words` has room for
+    size_t a_words;
+    /// the parts of the word being compiled
+    struct part *parts;
+    size_t num_parts;
+    /// number of parts `parts` has room for
+    size_t a_parts;
+    /// whether the operator depends on the number of values of a variable, the
+    /// segment can then only be interpreted
+    bool dynamic;
+};
+
+/**
+ * An argument while it is being read.
+ */
+struct arg {
+    char *ptr;
+    size_t len;
+    /// number of bytes `ptr` has room for
+    size_t a;
 };
 
+static void append_arg(struct state *st, struct arg *arg, const char *s,
+        size_t n)
+{
+    char *ptr;
+
+    if (arg->len + n > arg->a) {
+        do {
+            arg->a = arg->a == 0 ? 32 : arg->a * 2;
+        } while (arg->len + n > arg->a);
+        /* the old memory is left to the arena, an argument hardly grows more
+         * than a few times */
+        ptr = arena_alloc(st->arena, arg->a);
+        if (arg->len > 0) {
+            memcpy(ptr, arg->ptr, arg->len);
+        }
+        arg->ptr = ptr;
+    }
+    memcpy(&arg->ptr[arg->len], s, n);
+    arg->len += n;
+}
+
+static void push_arg(struct state *st, char *arg)
+{
+    char **args;
+
+    if (st->num_args == st->a_args) {
+        st->a_args = st->a_args == 0 ? 8 : st->a_args * 2;
+        args = arena_alloc(st->arena, sizeof(*args) * st->a_args);
+        if (st->num_args > 0) {
+            memcpy(args, st->args, sizeof(*args) * st->num_args);
+        }
+        st->args = args;
+    }
+    st->args[st->num_args++] = arg;
+}
+
+/**
+ * @brief Copies the arguments that are values of the config, this must be done
+ * before anything changes the config.
+ */
+static void own_args(struct state *st)
+{
+    if (!st->borrows) {
+        return;
+    }
+    for (size_t i = 0; i < st->num_args; i++) {
+        st->args[i] = arena_strdup(st->arena, st->args[i]);
+    }
+    st->borrows = false;
+}
+
+static void add_part(struct state *st, int type, const char *s, size_t len,
+        size_t index)
+{
+    struct part *parts;
+
+    if (st->num_parts == st->a_parts) {
+        st->a_parts = st->a_parts == 0 ? 8 : st->a_parts * 2;
+        parts = arena_alloc(st->arena, sizeof(*parts) * st->a_parts);
+        if (st->num_parts > 0) {
+            memcpy(parts, st->parts, sizeof(*parts) * st->num_parts);
+        }
+        st->parts = parts;
+    }
+    parts = &st->parts[st->num_parts++];
+    parts->type = type;
+    parts->s = s;
+    parts->len = len;
+    parts->index = index;
+}
+
+/**
+ * @brief Turns the text read so far into a part of the word being compiled.
+ */
+static void flush_text(struct state *st, struct arg *arg)
+{
+    if (arg->len == 0) {
+        return;
+    }
+    append_arg(st, arg, "", 1);
+    add_part(st, PART_TEXT, arg->ptr, arg->len - 1, 0);
+    arg->ptr = NULL;
+    arg->len = 0;
+    arg->a = 0;
+}
+
+static void push_word(struct state *st)
+{
+    struct word *words;
+    struct word *word;
+
+    if (st->num_args == st->a_words) {
+        st->a_words = st->a_words == 0 ? 8 : st->a_words * 2;
+        words = arena_alloc(st->arena, sizeof(*words) * st->a_words);
+        if (st->num_args > 0) {
+            memcpy(words, st->words, sizeof(*words) * st->num_args);
+        }
+        st->words = words;
+    }
+    word = &st->words[st->num_args++];
+    word->num_parts = st->num_parts;
+    word->parts = arena_alloc(st->arena, sizeof(*word->parts) * st->num_parts);
+    memcpy(word->parts, st->parts, sizeof(*word->parts) * st->num_parts);
+    st->num_parts = 0;
+}
+
+/**
+ * @brief Reads the arguments of the next segment.
+ *
+ * When compiling, variables and file indices are not expanded but become parts
+ * of the words, so they can be expanded later by `expand_words()`.
+ */
 static void advance_state(struct state *st)
 {
     int c;
+    char ch;
 
-    size_t arg_a = 10;
-    char *arg, *a;
-    size_t arg_len;
+    struct arg arg;
 
     bool esc;
     char quot;
@@ -47,13 +233,12 @@ static void advance_state(struct state *st)
     bool has_arg;
 
     char old;
-    size_t n;
     size_t index;
 
-    arg = smalloc(arg_a);
-
 beg:
-    arg_len = 0;
+    arg.ptr = NULL;
+    arg.len = 0;
+    arg.a = 0;
     has_arg = false;
     esc = false;
     quot = '\0';
@@ -62,7 +247,6 @@ beg:
     }
     c = st->line[0];
     if (c == '\0' || c == ';' || c == '#') {
-        free(arg);
         return;
     }
     for (; c = st->line[0], c != '\0'; st->line++) {
@@ -111,6 +295,11 @@ beg:
                     st->line += 2;
                     goto end;
                 }
+                if (c == ':' && st->line[1] == ':' && st->line[2] == '=') {
+                    st->state = STATE_MEMO_SYSTEM;
+                    st->line += 3;
+                    goto end;
+                }
                 break;
             }
             break;
@@ -144,19 +333,21 @@ beg:
             if (isdigit(st->line[1])) {
                 st->line++;
                 index = strtoull(st->line, &st->line, 0);
+                if (st->compiling) {
+                    flush_text(st, &arg);
+                    add_part(st, PART_FILE, NULL, 0, index);
+                    has_arg = true;
+                    st->line--;
+                    continue;
+                }
                 if (index == 0 || index - 1 >= Files.num) {
                     printf("file index is out of range\n");
                     goto err;
                 }
                 index--;
                 has_arg = true;
-                n = strlen(Files.ptr[index]->path);
-                if (arg_len + n > arg_a) {
-                    arg_a *= 2;
-                    arg = srealloc(arg, arg_a);
-                }
-                memcpy(&arg[arg_len], Files.ptr[index]->path, n);
-                arg_len += n;
+                append_arg(st, &arg, Files.ptr[index]->path,
+                        strlen(Files.ptr[index]->path));
                 st->line--;
                 continue;
             } else if (st->state >= STATE_SYSTEM) {
@@ -168,6 +359,24 @@ beg:
                     st->line[0] != '\0') {
                 st->line++;
             }
+            if (st->compiling) {
+                if (has_arg) {
+                    flush_text(st, &arg);
+                    add_part(st, PART_VALUE, arena_strndup(st->arena, start,
+                                st->line - start), st->line - start, 0);
+                } else {
+                    /* with `$X = 1`, X must have exactly one value to make this
+                     * an assignment */
+                    if (st->state == STATE_REGULAR && st->num_args <= 1) {
+                        st->dynamic = true;
+                    }
+                    add_part(st, PART_VALUES, arena_strndup(st->arena, start,
+                                st->line - start), st->line - start, 0);
+                    push_word(st);
+                }
+                st->line--;
+                continue;
+            }
             old = st->line[0];
             st->line[0] = '\0';
             entry = get_conf(start, NULL);
@@ -179,20 +388,14 @@ beg:
             }
 
             if (has_arg && entry->num_values > 0) {
-                n = strlen(entry->values[0]);
-                if (arg_len + n > arg_a) {
-                    arg_a *= 2;
-                    arg = srealloc(arg, arg_a);
-                }
-                memcpy(&arg[arg_len], entry->values[0], n);
-                arg_len += n;
-            } else {
-                st->args = sreallocarray(st->args,
-                        st->num_args + entry->num_values,
-                        sizeof(*st->args));
+                append_arg(st, &arg, entry->values[0],
+                        strlen(entry->values[0]));
+            } else if (entry->num_values > 0) {
+                /* large variables like `$C_FLAGS` are not copied */
                 for (size_t i = 0; i < entry->num_values; i++) {
-                    st->args[st->num_args++] = sstrdup(entry->values[i]);
+                    push_arg(st, entry->values[i]);
                 }
+                st->borrows = true;
             }
             st->line--;
             continue;
@@ -227,11 +430,8 @@ beg:
                 }
             }
         }
-        if (arg_len + 1 > arg_a) {
-            arg_a *= 2;
-            arg = srealloc(arg, arg_a);
-        }
-        arg[arg_len++] = c;
+        ch = c;
+        append_arg(st, &arg, &ch, 1);
         has_arg = true;
         esc = false;
     }
@@ -240,153 +440,224 @@ end:
     if (!has_arg) {
         goto beg;
     }
-    a = smalloc(arg_len + 1);
-    memcpy(a, arg, arg_len);
-    a[arg_len] = '\0';
-    st->args = sreallocarray(st->args, st->num_args + 1, sizeof(*st->args));
-    st->args[st->num_args++] = a;
+    if (st->compiling) {
+        flush_text(st, &arg);
+        push_word(st);
+        goto beg;
+    }
+    append_arg(st, &arg, "", 1);
+    push_arg(st, arg.ptr);
     goto beg;
 
 err:
     st->state = STATE_ERROR;
-    free(arg);
 }
 
-static int read_process(const char *cmd, char ***pargs, size_t *pnum_args)
-{
-    int pipe_fd[2];
+/**
+ * A shell command whose output is read.
+ */
+struct process {
     pid_t pid;
-    FILE *pp;
-    char *shell;
-    char **args = NULL;
-    size_t num_args = 0;
-    char *s, *a;
-    size_t s_a, s_i;
-    bool sp;
-    int c;
-
-    if (pipe(pipe_fd) == -1) {
-        printf("pipe: %s\n", strerror(errno));
-        return -1;
-    }
-
-    pid = fork();
-    if (pid == -1) {
-        printf("fork: %s\n", strerror(errno));
-        return -1;
-    }
+    /// the end of the pipe the output comes out of
+    int fd;
+};
 
-    if (pid == 0) {
-        close(pipe_fd[0]);
-        dup2(pipe_fd[1], STDOUT_FILENO);
-        close(pipe_fd[1]);
+/**
+ * @brief Starts a shell command with its output going into a pipe.
+ *
+ * The shell is `SHELL` of the config or else the one autocar was started
+ * with.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int start_process(const char *cmd, struct process *proc)
+{
+    struct config_entry *entry;
+    const char *shell;
 
-        shell = getenv("SHELL");
-        execl(shell, shell, "-c", cmd, NULL);
-        printf("execl: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+    entry = get_conf("shell", NULL);
+    if (entry != NULL && entry->num_values > 0) {
+        shell = entry->values[0];
     } else {
-        close(pipe_fd[1]);
-        pp = fdopen(pipe_fd[0], "r");
-        if (pp == NULL) {
-            printf("fdopen: %s\n", strerror(errno));
-            return -1;
+        shell = getenv("SHELL");
+        if (shell == NULL) {
+            shell = "/bin/sh";
         }
+    }
+    proc->pid = start_shell(shell, cmd, &proc->fd);
+    return proc->pid == -1 ? -1 : 0;
+}
 
-        s_a = 256;
-        s = smalloc(s_a);
-        s_i = 0;
-        while (c = fgetc(pp), c != EOF) {
-            sp = false;
-            while (isspace(c)) {
-                c = fgetc(pp);
-                sp = true;
-            }
-            if (s_i > 0 && (c == EOF || sp)) {
-                args = sreallocarray(args, num_args + 1, sizeof(*args));
-                a = smalloc(s_i + 1);
-                memcpy(a, s, s_i);
-                a[s_i] = '\0';
-                args[num_args++] = a;
-                s_i = 0;
+/**
+ * @brief Reads the output of a started command until it exits, each word it
+ * prints is added as argument.
+ *
+ * @param pstatus   Output of the exit code of the command, -1 if it did not
+ *                  exit normally.
+ *
+ * @return 0 on success, -1 if reading failed.
+ */
+static int finish_process(struct state *st, struct process *proc,
+        int *pstatus)
+{
+    char buf[4096];
+    ssize_t n;
+    struct arg arg = { NULL, 0, 0 };
+    const char *s, *e;
+    int result = 0;
+
+    while (n = read(proc->fd, buf, sizeof(buf)), n != 0) {
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
             }
-            if (c == EOF) {
-                break;
+            printf("read: %s\n", strerror(errno));
+            result = -1;
+            break;
+        }
+        for (s = buf; s != &buf[n]; s = e) {
+            if (isspace((unsigned char) s[0])) {
+                if (arg.len > 0) {
+                    append_arg(st, &arg, "", 1);
+                    push_arg(st, arg.ptr);
+                    arg.ptr = NULL;
+                    arg.len = 0;
+                    arg.a = 0;
+                }
+                e = s + 1;
+                continue;
             }
-            s[s_i++] = c;
-            if (s_i + 1 >= s_a) {
-                s_a *= 2;
-                s = srealloc(s, s_a);
+            e = s;
+            while (e != &buf[n] && !isspace((unsigned char) e[0])) {
+                e++;
             }
+            append_arg(st, &arg, s, e - s);
         }
-        free(s);
-        fclose(pp);
-        waitpid(pid, NULL, 0);
-        *pargs = args;
-        *pnum_args = num_args;
     }
-    return 0;
+    if (arg.len > 0) {
+        append_arg(st, &arg, "", 1);
+        push_arg(st, arg.ptr);
+    }
+    close(proc->fd);
+    *pstatus = wait_process(proc->pid);
+    return result;
 }
 
-int run_command_line(char *s)
+/**
+ * @brief Drops a started command whose output is not needed anymore.
+ */
+static void discard_process(struct process *proc)
 {
-    int result = 0;
-
-    struct state state;
-
-    int cmd;
-    size_t pref;
-
-    FILE *redir;
-
-    char **p_args;
-    size_t p_num_args;
-
-    DLOG("running cmd: %s\n", s);
+    close(proc->fd);
+    wait_process(proc->pid);
+}
 
-    state.line = s;
+/**
+ * @brief Sets a variable to the output of a command (`NAME := <shell>`).
+ *
+ * With `NAME ::= <shell>`, the output is memoized (see `get_memo()`).
+ *
+ * @param st    The state after reading the arguments.
+ * @param proc  The command if it was started already, otherwise `NULL`.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int assign_output(struct state *st, struct process *proc)
+{
+    const struct memo *memo;
+    struct process started;
+    int status;
+    int result;
 
-next_segment:
-    while (isblank(state.line[0])) {
-        state.line++;
+    if (st->num_args == 1) {
+        set_conf(st->args[0], NULL, 0, SET_CONF_MODE_SET);
+        return 0;
     }
-    DLOG("next segment: %s\n", state.line);
-    if (state.line[0] == ':') {
-        state.state = STATE_EXEC_SYSTEM;
-        state.line++;
-    } else {
-        state.state = STATE_REGULAR;
+    own_args(st);
+    if (proc == NULL && st->state == STATE_MEMO_SYSTEM) {
+        memo = get_memo(st->args[1]);
+        if (memo != NULL) {
+            DLOG("using memoized output of '%s'\n", st->args[1]);
+            return set_conf(st->args[0], (const char**) memo->values,
+                    memo->num_values, SET_CONF_MODE_SET);
+        }
     }
-    state.args = NULL;
-    state.num_args = 0;
+    if (proc == NULL) {
+        if (start_process(st->args[1], &started) == -1) {
+            return -1;
+        }
+        proc = &started;
+    }
+    result = finish_process(st, proc, &status);
+    if (result == 0) {
+        /* the output of a failed command is used but never remembered, the
+         * next run tries again */
+        if (st->state == STATE_MEMO_SYSTEM && status == 0) {
+            put_memo(st->args[1], &st->args[2], st->num_args - 2);
+        }
+        result = set_conf(st->args[0], (const char**) &st->args[2],
+                st->num_args - 2, SET_CONF_MODE_SET);
+    }
+    return result;
+}
 
-    advance_state(&state);
+/**
+ * @brief Finds the command a name is a prefix of.
+ *
+ * @return The command or `ARRAY_SIZE(Commands)` if there is none.
+ */
+static int find_command(const char *name)
+{
+    int cmd;
+    size_t pref;
 
-    if (state.num_args == 0) {
-        goto end;
+    for (cmd = 0; cmd < (int) ARRAY_SIZE(Commands); cmd++) {
+        for (pref = 0; name[pref] != '\0'; pref++) {
+            if (Commands[cmd].name[pref] != name[pref]) {
+                break;
+            }
+        }
+        if (name[pref] == '\0') {
+            break;
+        }
     }
+    return cmd;
+}
+
+/**
+ * @brief Runs a segment whose arguments were read.
+ *
+ * @param st    The state after reading at least one argument.
+ * @param cmd   The command if it is already known, otherwise -1.
+ *
+ * @return 0 if the segment succeeded, -1 otherwise.
+ */
+static int run_segment(struct state *st, int cmd)
+{
+    int result = 0;
+    FILE *redir;
+    pid_t pid;
 
-    DLOG("got args in state %d:", state.state);
-    for (size_t i = 0; i < state.num_args; i++) {
-        DLOG(" %s", state.args[i]);
+    DLOG("got args in state %d:", st->state);
+    for (size_t i = 0; i < st->num_args; i++) {
+        DLOG(" %s", st->args[i]);
     }
     DLOG("\n");
 
     redir = stdout;
 
-    switch (state.state) {
+    switch (st->state) {
     case STATE_ERROR:
         result = -1;
         break;
 
     case STATE_REDIRECT:
-        if (state.num_args == 1) {
+        if (st->num_args == 1) {
             printf("need redirect output name after '>'\n");
             break;
         }
-        state.num_args--;
-        redir = fopen(state.args[state.num_args], "w");
-        free(state.args[state.num_args]);
+        st->num_args--;
+        redir = fopen(st->args[st->num_args], "w");
         if (redir == NULL) {
             printf("fopen: %s\n", strerror(errno));
             result = -1;
@@ -394,21 +665,17 @@ next_segment:
         }
         /* fall through */
     case STATE_REGULAR:
-        for (cmd = 0; cmd < (int) ARRAY_SIZE(Commands); cmd++) {
-            for (pref = 0; state.args[0][pref] != '\0'; pref++) {
-                if (Commands[cmd].name[pref] != state.args[0][pref]) {
-                    break;
-                }
-            }
-            if (state.args[0][pref] == '\0') {
-                break;
-            }
+        if (cmd == -1) {
+            cmd = find_command(st->args[0]);
         }
         if (cmd == (int) ARRAY_SIZE(Commands)) {
-            printf("command '%s' not found\n", state.args[0]);
+            printf("command '%s' not found\n", st->args[0]);
             result = -1;
         } else {
-            result = run_command(cmd, &state.args[1], state.num_args - 1, redir);
+            if (Commands[cmd].changes_config) {
+                own_args(st);
+            }
+            result = run_command(cmd, &st->args[1], st->num_args - 1, redir);
         }
         if (redir != stdout) {
             fclose(redir);
@@ -418,37 +685,67 @@ next_segment:
     case STATE_EQUAL:
     case STATE_APPEND:
     case STATE_SUBTRACT:
-        result = set_conf(state.args[0], (const char**) &state.args[1],
-                state.num_args - 1, state.state - 1);
+        /* `X = $X` would otherwise read values that are already freed */
+        own_args(st);
+        result = set_conf(st->args[0], (const char**) &st->args[1],
+                st->num_args - 1, st->state - 1);
         break;
 
     case STATE_EXEC_SYSTEM:
-        system(state.args[0]);
+        pid = start_shell("/bin/sh", st->args[0], NULL);
+        if (pid != -1) {
+            wait_process(pid);
+        }
         break;
 
     case STATE_SYSTEM:
-        if (state.num_args == 1) {
-            set_conf(state.args[0], NULL, 0, SET_CONF_MODE_SET);
-            break;
-        }
-        result = read_process(state.args[1], &p_args, &p_num_args);
-        if (result == 0) {
-            result = set_conf(state.args[0], (const char**) p_args,
-                    p_num_args, SET_CONF_MODE_SET);
-        }
-        for (size_t i = 0; i < p_num_args; i++) {
-            free(p_args[i]);
-        }
-        free(p_args);
+    case STATE_MEMO_SYSTEM:
+        result = assign_output(st, NULL);
         break;
     }
+    return result;
+}
+
+int run_command_line(char *s)
+{
+    int result = 0;
+
+    struct state state;
+
+    struct arena_mark mark;
+
+    DLOG("running cmd: %s\n", s);
+
+    state.line = s;
+    state.arena = &EvalMemory;
+    state.compiling = false;
+
+next_segment:
+    while (isblank(state.line[0])) {
+        state.line++;
+    }
+    DLOG("next segment: %s\n", state.line);
+    if (state.line[0] == ':') {
+        state.state = STATE_EXEC_SYSTEM;
+        state.line++;
+    } else {
+        state.state = STATE_REGULAR;
+    }
+    /* a command line run by a command (like `source`) takes memory after
+     * the arguments of the one running it */
+    mark_arena(&EvalMemory, &mark);
+    state.args = NULL;
+    state.num_args = 0;
+    state.a_args = 0;
+    state.borrows = false;
 
-    for (size_t i = 0; i < state.num_args; i++) {
-        free(state.args[i]);
+    advance_state(&state);
+
+    if (state.num_args > 0) {
+        result = run_segment(&state, -1);
     }
-    free(state.args);
 
-end:
+    release_arena(&EvalMemory, &mark);
     while (isblank(state.line[0])) {
         state.line++;
     }
@@ -461,6 +758,471 @@ end:
     return result;
 }
 
+/**
+ * A segment of a line of a script, read once and expanded each time it runs.
+ */
+struct segment {
+    /// the state after reading the arguments
+    int state;
+    /// the command of a regular or redirecting segment, -1 if its name is
+    /// only known after expanding
+    int cmd;
+    /// the source of a segment that must be interpreted each time (see
+    /// `struct state`), otherwise `NULL`
+    char *text;
+    struct word *words;
+    size_t num_words;
+};
+
+struct script_line {
+    /// number of the line in the file, starting at 1
+    size_t number;
+    struct segment *segments;
+    size_t num_segments;
+};
+
+/**
+ * A sourced file in compiled form, it is used again while the file stays the
+ * same.
+ */
+struct script {
+    char *path;
+    /// modification time of the file when it was read
+    struct timespec mtime;
+    /// size of the file when it was read
+    off_t size;
+    /// hash of the content
+    unsigned char digest[SHA256_SIZE];
+    /// memory of the lines and everything in them
+    struct arena memory;
+    /// all lines that are not empty
+    struct script_line *lines;
+    size_t num_lines;
+    /// number of `eval_script()` calls running it
+    size_t users;
+    /// whether it was replaced and must be freed once it is not used anymore
+    bool stale;
+};
+
+static struct script_list {
+    struct script **ptr;
+    size_t num;
+} Scripts;
+
+/**
+ * @brief Compiles the segments of a line.
+ *
+ * @param script    The script to allocate from.
+ * @param s         The line, it is modified while reading but restored.
+ * @param line      Output of the segments.
+ */
+static void compile_line(struct script *script, char *s,
+        struct script_line *line)
+{
+    struct state state;
+    const char *start;
+    struct segment *segment;
+    size_t a = 0;
+
+    memset(&state, 0, sizeof(state));
+    state.arena = &script->memory;
+    state.compiling = true;
+    state.line = s;
+
+    line->segments = NULL;
+    line->num_segments = 0;
+    for (;;) {
+        while (isblank(state.line[0])) {
+            state.line++;
+        }
+        start = state.line;
+        if (state.line[0] == ':') {
+            state.state = STATE_EXEC_SYSTEM;
+            state.line++;
+        } else {
+            state.state = STATE_REGULAR;
+        }
+        state.words = NULL;
+        state.num_args = 0;
+        state.a_words = 0;
+        state.dynamic = false;
+
+        advance_state(&state);
+
+        if (state.num_args > 0) {
+            if (line->num_segments == a) {
+                a = a == 0 ? 4 : a * 2;
+                segment = arena_alloc(&script->memory, sizeof(*segment) * a);
+                if (line->num_segments > 0) {
+                    memcpy(segment, line->segments,
+                            sizeof(*segment) * line->num_segments);
+                }
+                line->segments = segment;
+            }
+            segment = &line->segments[line->num_segments++];
+            segment->state = state.state;
+            segment->cmd = -1;
+            segment->text = NULL;
+            segment->words = state.words;
+            segment->num_words = state.num_args;
+            if (state.dynamic) {
+                /* the rest of the line is run as text, like this an error
+                 * stops it exactly where `run_command_line()` would */
+                segment->text = arena_strdup(&script->memory, start);
+                segment->words = NULL;
+                segment->num_words = 0;
+                break;
+            } else if ((state.state == STATE_REGULAR ||
+                        state.state == STATE_REDIRECT) &&
+                    state.words[0].num_parts == 1 &&
+                    state.words[0].parts[0].type == PART_TEXT) {
+                segment->cmd = find_command(state.words[0].parts[0].s);
+                if (segment->cmd == (int) ARRAY_SIZE(Commands)) {
+                    segment->cmd = -1;
+                }
+            }
+        }
+
+        while (isblank(state.line[0])) {
+            state.line++;
+        }
+        if (state.line[0] != ';') {
+            break;
+        }
+        state.line++;
+    }
+}
+
+/**
+ * @brief Compiles the content of a file.
+ *
+ * @param path  The path of the file.
+ * @param data  The content, it is modified.
+ * @param size  The size of the content.
+ *
+ * @return The script, it must be freed with `free_script()`.
+ */
+static struct script *compile_script(const char *path, char *data,
+        size_t size)
+{
+    struct script *script;
+    struct script_line line;
+    size_t a = 0;
+    size_t number = 1;
+    char *s, *e;
+
+    script = scalloc(1, sizeof(*script));
+    script->path = sstrdup(path);
+    for (s = data; s != &data[size]; s = e + 1, number++) {
+        e = memchr(s, '\n', &data[size] - s);
+        if (e == NULL) {
+            e = &data[size];
+        }
+        e[0] = '\0';
+        line.number = number;
+        compile_line(script, s, &line);
+        if (line.num_segments > 0) {
+            if (script->num_lines == a) {
+                a = a == 0 ? 64 : a * 2;
+                script->lines = sreallocarray(script->lines, a,
+                        sizeof(*script->lines));
+            }
+            script->lines[script->num_lines++] = line;
+        }
+        if (e == &data[size]) {
+            break;
+        }
+    }
+    return script;
+}
+
+static void free_script(struct script *script)
+{
+    free(script->path);
+    free(script->lines);
+    clear_arena(&script->memory);
+    free(script);
+}
+
+/**
+ * @brief Expands the words of a compiled segment into arguments.
+ *
+ * @return 0 on success, -1 if a variable is unset or a file index is out of
+ *         range.
+ */
+static int expand_words(struct state *st, const struct segment *segment)
+{
+    const struct word *word;
+    const struct part *part;
+    struct config_entry *entry;
+    struct arg arg;
+
+    for (size_t i = 0; i < segment->num_words; i++) {
+        word = &segment->words[i];
+        if (word->num_parts == 1 && word->parts[0].type == PART_TEXT) {
+            /* a script is not freed while it runs */
+            push_arg(st, (char*) word->parts[0].s);
+            continue;
+        }
+        if (word->num_parts == 1 && word->parts[0].type == PART_VALUES) {
+            entry = get_conf(word->parts[0].s, NULL);
+            if (entry == NULL) {
+                printf("variable '%s' is unset\n", word->parts[0].s);
+                return -1;
+            }
+            for (size_t v = 0; v < entry->num_values; v++) {
+                push_arg(st, entry->values[v]);
+            }
+            st->borrows = st->borrows || entry->num_values > 0;
+            continue;
+        }
+
+        arg.ptr = NULL;
+        arg.len = 0;
+        arg.a = 0;
+        for (size_t p = 0; p < word->num_parts; p++) {
+            part = &word->parts[p];
+            switch (part->type) {
+            case PART_TEXT:
+                append_arg(st, &arg, part->s, part->len);
+                break;
+
+            case PART_FILE:
+                if (part->index == 0 || part->index - 1 >= Files.num) {
+                    printf("file index is out of range\n");
+                    return -1;
+                }
+                append_arg(st, &arg, Files.ptr[part->index - 1]->path,
+                        strlen(Files.ptr[part->index - 1]->path));
+                break;
+
+            case PART_VALUE:
+                entry = get_conf(part->s, NULL);
+                if (entry == NULL) {
+                    printf("variable '%s' is unset\n", part->s);
+                    return -1;
+                }
+                if (entry->num_values > 0) {
+                    append_arg(st, &arg, entry->values[0],
+                            strlen(entry->values[0]));
+                }
+                break;
+            }
+        }
+        append_arg(st, &arg, "", 1);
+        push_arg(st, arg.ptr);
+    }
+    return 0;
+}
+
+/**
+ * @brief Expands and runs a compiled segment.
+ *
+ * @param segment   The segment.
+ * @param proc      The started command of a `NAME ::= <shell>` segment, may
+ *                  be `NULL`.
+ */
+static int run_compiled_segment(const struct segment *segment,
+        struct process *proc)
+{
+    int result = 0;
+    struct state state;
+    struct arena_mark mark;
+
+    mark_arena(&EvalMemory, &mark);
+    if (segment->text != NULL) {
+        result = run_command_line(arena_strdup(&EvalMemory, segment->text));
+    } else {
+        state.state = segment->state;
+        state.arena = &EvalMemory;
+        state.args = NULL;
+        state.num_args = 0;
+        state.a_args = 0;
+        state.borrows = false;
+        state.compiling = false;
+        if (expand_words(&state, segment) == -1) {
+            state.state = STATE_ERROR;
+        }
+        if (proc != NULL) {
+            result = assign_output(&state, proc);
+        } else if (state.num_args > 0) {
+            result = run_segment(&state, segment->cmd);
+        }
+    }
+    release_arena(&EvalMemory, &mark);
+    return result;
+}
+
+/**
+ * @brief Gets the compiled form of a file, compiling it if it changed.
+ *
+ * @return The script or `NULL` if the file can not be read.
+ */
+static struct script *load_script(const char *path)
+{
+    struct stat st;
+    size_t index;
+    struct script *script = NULL, *compiled;
+    char *data;
+    size_t size;
+    struct sha256 ctx;
+    unsigned char digest[SHA256_SIZE];
+
+    if (stat(path, &st) == -1) {
+        fprintf(stderr, "stat '%s': %s\n", path, strerror(errno));
+        return NULL;
+    }
+    for (index = 0; index < Scripts.num; index++) {
+        if (strcmp(Scripts.ptr[index]->path, path) == 0) {
+            script = Scripts.ptr[index];
+            break;
+        }
+    }
+    if (script != NULL && script->size == st.st_size &&
+            script->mtime.tv_sec == st.st_mtim.tv_sec &&
+            script->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        return script;
+    }
+
+    if (read_file(path, &data, &size) == -1) {
+        fprintf(stderr, "read '%s': %s\n", path, strerror(errno));
+        return NULL;
+    }
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, size);
+    sha256_final(&ctx, digest);
+    if (script != NULL && memcmp(script->digest, digest, SHA256_SIZE) == 0) {
+        DLOG("'%s' was touched but is the same\n", path);
+        script->mtime = st.st_mtim;
+        free(data);
+        return script;
+    }
+
+    DLOG("compiling '%s'\n", path);
+    compiled = compile_script(path, data, size);
+    free(data);
+    compiled->mtime = st.st_mtim;
+    compiled->size = st.st_size;
+    memcpy(compiled->digest, digest, SHA256_SIZE);
+    if (script == NULL) {
+        Scripts.ptr = sreallocarray(Scripts.ptr, Scripts.num + 1,
+                sizeof(*Scripts.ptr));
+        Scripts.ptr[Scripts.num++] = compiled;
+    } else {
+        /* a script that sources itself after changing itself */
+        if (script->users > 0) {
+            script->stale = true;
+        } else {
+            free_script(script);
+        }
+        Scripts.ptr[index] = compiled;
+    }
+    return compiled;
+}
+
+/**
+ * @brief Gets the command of a line that is a single `NAME ::= <shell>` and
+ * may run at the same time as the lines around it.
+ *
+ * Commands using '$' are left out, they may read a variable set by the line
+ * before.
+ *
+ * @return The command or `NULL` if the line does not qualify.
+ */
+static const char *get_concurrent_command(const struct script_line *line)
+{
+    const struct segment *segment;
+    const char *cmd;
+
+    if (line->num_segments != 1) {
+        return NULL;
+    }
+    segment = &line->segments[0];
+    if (segment->text != NULL || segment->state != STATE_MEMO_SYSTEM ||
+            segment->num_words != 2) {
+        return NULL;
+    }
+    for (size_t i = 0; i < 2; i++) {
+        if (segment->words[i].num_parts != 1 ||
+                segment->words[i].parts[0].type != PART_TEXT) {
+            return NULL;
+        }
+    }
+    cmd = segment->words[1].parts[0].s;
+    return strchr(cmd, '$') == NULL ? cmd : NULL;
+}
+
+int eval_script(const char *path)
+{
+    struct script *script;
+    const struct script_line *line;
+    int result = 0;
+    size_t i;
+    /* consecutive `NAME ::= <shell>` lines that are not memoized run at the
+     * same time, this is the range of lines started */
+    struct process procs[MAX_CONCURRENT_COMMANDS];
+    bool started[MAX_CONCURRENT_COMMANDS];
+    size_t first = 0, end = 0;
+    const char *cmd;
+
+    script = load_script(path);
+    if (script == NULL) {
+        return -1;
+    }
+    script->users++;
+    for (i = 0; i < script->num_lines; i++) {
+        line = &script->lines[i];
+        if (i >= end && get_concurrent_command(line) != NULL) {
+            first = i;
+            for (end = i; end < script->num_lines &&
+                    end - first < MAX_CONCURRENT_COMMANDS; end++) {
+                cmd = get_concurrent_command(&script->lines[end]);
+                if (cmd == NULL) {
+                    break;
+                }
+                started[end - first] = get_memo(cmd) == NULL &&
+                    start_process(cmd, &procs[end - first]) == 0;
+            }
+        }
+        if (i < end) {
+            result = run_compiled_segment(&line->segments[0],
+                    started[i - first] ? &procs[i - first] : NULL);
+        } else {
+            for (size_t s = 0; s < line->num_segments; s++) {
+                result = run_compiled_segment(&line->segments[s], NULL);
+                if (result != 0) {
+                    break;
+                }
+            }
+        }
+        if (result != 0) {
+            printf("failed sourcing at line '%zu'\n", line->number);
+            break;
+        }
+    }
+    for (i++; i < end; i++) {
+        if (started[i - first]) {
+            discard_process(&procs[i - first]);
+        }
+    }
+    script->users--;
+    if (script->stale && script->users == 0) {
+        free_script(script);
+    }
+    return 0;
+}
+
+void clear_eval(void)
+{
+    for (size_t i = 0; i < Scripts.num; i++) {
+        free_script(Scripts.ptr[i]);
+    }
+    free(Scripts.ptr);
+    Scripts.ptr = NULL;
+    Scripts.num = 0;
+    clear_arena(&EvalMemory);
+}
+
 int eval_file(FILE *fp)
 {
     char *line = NULL;
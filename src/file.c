@@ -1,14 +1,19 @@
 #include "args.h"
+#include "arena.h"
+#include "compdb.h"
 #include "salloc.h"
 #include "macros.h"
 #include "file.h"
 #include "conf.h"
+#include "meta.h"
+#include "schedule.h"
 #include "util.h"
+#include "walk.h"
 
 #include <bfd.h>
 #include <ctype.h>
-#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
@@ -16,7 +21,153 @@
 
 #include <sys/wait.h>
 
-struct file_list Files;
+/* the cycle starts at 1 so that new files (with a cycle of 0) are stat'ed */
+struct file_list Files = { .cycle = 1 };
+
+/// number of files in a slab
+#define FILE_SLAB_SIZE 1024
+
+/**
+ * Memory of the file records and their paths, files are allocated in slabs so
+ * that files added together (like by `collect_files()`) are next to each other.
+ */
+static struct {
+    /// slabs of `FILE_SLAB_SIZE` files each
+    struct file **slabs;
+    /// number of elements in `slabs`
+    size_t num_slabs;
+    /// number of files taken from the last slab
+    size_t num_used;
+    /// removed files that can be reused
+    struct file **unused;
+    /// number of elements in `unused`
+    size_t num_unused;
+    /// paths of all files
+    struct arena paths;
+} FileMemory;
+
+/**
+ * Sets of file ids for every index (`INDEX_*`).
+ */
+static struct {
+    /// one bit for each file id
+    uint64_t *bits;
+    /// number of elements in `bits`
+    size_t num_words;
+} Indexes[INDEX_MAX];
+
+/**
+ * @brief Gets a zeroed file record.
+ */
+static struct file *alloc_file(void)
+{
+    struct file *file;
+    unsigned id;
+
+    if (FileMemory.num_unused > 0) {
+        file = FileMemory.unused[--FileMemory.num_unused];
+        id = file->id;
+    } else {
+        if (FileMemory.num_slabs == 0 ||
+                FileMemory.num_used == FILE_SLAB_SIZE) {
+            FileMemory.slabs = sreallocarray(FileMemory.slabs,
+                    FileMemory.num_slabs + 1, sizeof(*FileMemory.slabs));
+            FileMemory.slabs[FileMemory.num_slabs++] =
+                sreallocarray(NULL, FILE_SLAB_SIZE, sizeof(struct file));
+            FileMemory.num_used = 0;
+        }
+        id = (FileMemory.num_slabs - 1) * FILE_SLAB_SIZE +
+            FileMemory.num_used;
+        file = &FileMemory.slabs[FileMemory.num_slabs - 1]
+            [FileMemory.num_used++];
+    }
+    memset(file, 0, sizeof(*file));
+    file->id = id;
+    return file;
+}
+
+/**
+ * @brief Adds or removes a file id to or from an index.
+ */
+static void set_indexed(int index, unsigned id, bool member)
+{
+    const size_t word = id / 64;
+    const uint64_t bit = (uint64_t) 1 << (id % 64);
+
+    if (word >= Indexes[index].num_words) {
+        if (!member) {
+            return;
+        }
+        Indexes[index].bits = sreallocarray(Indexes[index].bits, word + 1,
+                sizeof(*Indexes[index].bits));
+        memset(&Indexes[index].bits[Indexes[index].num_words], 0,
+                sizeof(*Indexes[index].bits) *
+                (word + 1 - Indexes[index].num_words));
+        Indexes[index].num_words = word + 1;
+    }
+    if (member) {
+        Indexes[index].bits[word] |= bit;
+    } else {
+        Indexes[index].bits[word] &= ~bit;
+    }
+}
+
+/**
+ * @brief Puts a file into all indexes it belongs to and removes it from all
+ * others.
+ *
+ * @param file      The file to index.
+ * @param present   Whether the file is in the file list.
+ */
+static void index_file(const struct file *file, bool present)
+{
+    const bool has_main = (file->flags & FLAG_HAS_MAIN);
+
+    set_indexed(INDEX_SOURCES, file->id,
+            present && file->type == EXT_TYPE_SOURCE);
+    set_indexed(INDEX_OBJECTS, file->id,
+            present && file->type == EXT_TYPE_OBJECT && !has_main);
+    set_indexed(INDEX_MAIN_OBJECTS, file->id, present && has_main);
+    set_indexed(INDEX_EXECUTABLES, file->id,
+            present && file->type == EXT_TYPE_EXECUTABLE);
+    set_indexed(INDEX_TESTS, file->id,
+            present && file->type == EXT_TYPE_EXECUTABLE &&
+            (file->flags & FLAG_IS_TEST));
+    set_indexed(INDEX_OTHERS, file->id,
+            present && file->type == EXT_TYPE_OTHER);
+    set_indexed(INDEX_FOLDERS, file->id,
+            present && file->type == EXT_TYPE_FOLDER);
+}
+
+struct file *next_indexed_file(int index, size_t *pid)
+{
+    size_t word;
+    uint64_t bits;
+    size_t id;
+
+    word = *pid / 64;
+    if (word >= Indexes[index].num_words) {
+        return NULL;
+    }
+    /* mask out the ids before the start */
+    bits = Indexes[index].bits[word] & (~(uint64_t) 0 << (*pid % 64));
+    while (bits == 0) {
+        if (++word == Indexes[index].num_words) {
+            *pid = word * 64;
+            return NULL;
+        }
+        bits = Indexes[index].bits[word];
+    }
+    id = word * 64 + __builtin_ctzll(bits);
+    *pid = id + 1;
+    return &FileMemory.slabs[id / FILE_SLAB_SIZE][id % FILE_SLAB_SIZE];
+}
+
+void set_file_flags(struct file *file, int flags)
+{
+    file->flags = flags;
+    index_file(file, true);
+}
 
 /**
  * @brief Gets the extension of given path.
@@ -131,150 +282,520 @@ struct file *search_file(const char *path, size_t *pindex)
 }
 
 /**
- * @brief Update the `st` member and un-/set FLAG_EXISTS.
- *
- * Sets the `st` member of given file using `stat()` and sets FLAG_EXISTS for
- * all files successfully stat'ed.
+ * @brief Sets the stat members from a stat result and un-/sets FLAG_EXISTS.
  *
  * Files that have no extension (assumed to be executables) must have execute
  * permissions, otherwise they are not seen as existing.
+ *
+ * @param file  The file to update.
+ * @param s     Result of the stat call (0 for success).
+ * @param st    The stat information, only used if `s` is 0.
  */
-static void stat_file(struct file *file)
+static void apply_stat(struct file *file, int s, const struct stat *st)
 {
-    struct stat st;
-    int s;
-
-    s = stat(file->path, &st);
     if (s == 0 && (file->type != EXT_TYPE_EXECUTABLE ||
-                (st.st_mode & S_IXUSR))) {
+                (st->st_mode & S_IXUSR))) {
         file->flags |= FLAG_EXISTS;
-        file->st = st;
+        file->mtime_ns = (int64_t) st->st_mtim.tv_sec * 1000000000 +
+            st->st_mtim.tv_nsec;
+        file->size = st->st_size;
+        file->ino = st->st_ino;
     } else {
         file->flags &= ~FLAG_EXISTS;
-        file->st.st_mtime = 0;
+        file->mtime_ns = 0;
+        file->size = 0;
+        file->ino = 0;
     }
-    if (s == 0 && S_ISDIR(st.st_mode)) {
+    if (s == 0 && S_ISDIR(st->st_mode) && file->type != EXT_TYPE_FOLDER) {
         file->type = EXT_TYPE_FOLDER;
+        index_file(file, true);
     }
+    file->cycle = Files.cycle;
 }
 
-struct file *add_file(char *path, int type, int flags)
+/**
+ * @brief Update the stat members and un-/set FLAG_EXISTS.
+ *
+ * Sets the stat members of given file using `stat()` and sets FLAG_EXISTS for
+ * all files successfully stat'ed. Nothing happens if the file was already
+ * stat'ed in the current cycle.
+ */
+static void stat_file(struct file *file)
 {
-    size_t index;
-    struct file *file;
+    struct stat st;
+    int s;
 
-    DLOG("adding file: %s\n", path);
+    if (file->cycle == Files.cycle) {
+        return;
+    }
+    s = stat(file->path, &st);
+    apply_stat(file, s, &st);
+}
 
-    path = get_relative_path(path);
-    if (path == NULL) {
-        return NULL;
+/**
+ * @brief Stats a file again, even if it was already stat'ed in this cycle.
+ *
+ * This is needed for files that autocar writes itself.
+ */
+static void restat_file(struct file *file)
+{
+    file->cycle = 0;
+    stat_file(file);
+}
+
+/**
+ * @brief Updates the flags of a file that was added again.
+ *
+ * The flags that autocar found out itself are kept and `FLAG_IS_FRESH` is set
+ * if the flags changed.
+ */
+static void update_flags(struct file *file, int flags)
+{
+    DLOG("file already existed\n");
+    flags |= (file->flags & (FLAG_EXISTS | FLAG_HAS_MAIN | FLAG_HAS_DEPS));
+    if (file->flags != flags) {
+        flags |= FLAG_IS_FRESH;
     }
+    set_file_flags(file, flags);
+}
+
+/**
+ * @brief Allocates a file without adding it to the file list.
+ *
+ * The file is already put into the indexes, the caller must add it to the
+ * list.
+ *
+ * @param path  Path of the file, it is copied.
+ * @param type  Type of the file (`EXT_TYPE_*`) or -1 to use the extension.
+ * @param flags Flags of the file or'd together (`FLAG_*`).
+ *
+ * @return The allocated file.
+ */
+static struct file *make_file(const char *path, int type, int flags)
+{
+    struct file *file;
+
+    file = alloc_file();
+    file->path = arena_strdup(&FileMemory.paths, path);
+    file->type = type == -1 ? get_extension_type(file->path) : type;
+    file->flags = flags | FLAG_IS_FRESH;
+    file->ext = get_extension(file->path);
+    index_file(file, true);
+    DLOG("file: '%s' added with type %d and flags %d\n",
+            file->path, file->type, file->flags);
+    return file;
+}
+
+/**
+ * @brief Adds a file to the file list without stat'ing it.
+ *
+ * Unlike `add_file()`, the path must already be relative to the current
+ * directory and must not contain any '.' or '..' segments. If the file is
+ * already in the list, only its flags are updated.
+ *
+ * @param path  Path of the file, it is copied.
+ * @param type  Type of the file (`EXT_TYPE_*`) or -1 to use the extension.
+ * @param flags Flags of the file or'd together (`FLAG_*`).
+ *
+ * @return The file in the list.
+ */
+static struct file *put_file(const char *path, int type, int flags)
+{
+    size_t index;
+    struct file *file;
 
     file = search_file(path, &index);
     if (file != NULL) {
-        DLOG("file already existed\n");
-        free(path);
-        flags |= (file->flags & (FLAG_EXISTS | FLAG_HAS_MAIN));
-        if (file->flags != flags) {
-            flags |= FLAG_IS_FRESH;
-        }
-        file->flags = flags;
-        stat_file(file);
+        update_flags(file, flags);
         return file;
     }
 
-    file = scalloc(1, sizeof(*file));
-    file->path = path;
-    file->type = type == -1 ? get_extension_type(path) : type;
-    file->flags = flags | FLAG_IS_FRESH;
-    file->ext = get_extension(path);
+    file = make_file(path, type, flags);
     Files.ptr = sreallocarray(Files.ptr, Files.num + 1, sizeof(*Files.ptr));
     memmove(&Files.ptr[index + 1], &Files.ptr[index],
             sizeof(*Files.ptr) * (Files.num - index));
     Files.ptr[index] = file;
     Files.num++;
+    return file;
+}
+
+struct file *add_file(char *path, int type, int flags)
+{
+    struct file *file;
+
+    DLOG("adding file: %s\n", path);
+
+    path = get_relative_path(path);
+    if (path == NULL) {
+        return NULL;
+    }
+    file = put_file(path, type, flags);
+    free(path);
     stat_file(file);
-    DLOG("file: '%s' added with type %d and flags %d\n",
-            file->path, file->type, file->flags);
     return file;
 }
 
-struct path {
-    char *s;
-    size_t a;
-    int f;
-};
+/**
+ * @brief Drops the dependency list of a source file.
+ */
+static void clear_dependencies(struct file *file)
+{
+    free(file->related);
+    file->related = NULL;
+    file->num_related = 0;
+    file->flags &= ~FLAG_HAS_DEPS;
+}
 
-static int collect_from_directory(struct path *path, size_t len_path)
+void remove_file(size_t index)
 {
-    DIR *dir;
-    struct dirent *ent;
-    size_t len_name;
+    struct file *file, *other;
+    size_t id;
 
-    DLOG("collect from directory: '%s'\n", path->s);
+    file = Files.ptr[index];
+    Files.num--;
+    memmove(&Files.ptr[index], &Files.ptr[index + 1],
+            sizeof(*Files.ptr) * (Files.num - index));
 
-    dir = opendir(path->s);
-    if (dir == NULL) {
-        LOG("opendir(%s): %s\n", path->s, strerror(errno));
-        return -1;
-    }
-    while (ent = readdir(dir), ent != NULL) {
-        len_name = strlen(ent->d_name);
-        if (len_path + len_name + 2 > path->a) {
-            path->a = len_path + len_name + 2;
-            path->s = srealloc(path->s, path->a);
-        }
-        path->s[len_path] = '/';
-        strcpy(&path->s[len_path + 1], ent->d_name);
+    index_file(file, false);
 
-        if (ent->d_type == DT_DIR && (path->f & FLAG_IS_RECURSIVE)) {
-            if (ent->d_name[0] == '.') {
-                if (ent->d_name[1] == '\0') {
-                    continue;
-                }
-                if (ent->d_name[1] == '.' && ent->d_name[2] == '\0') {
-                    continue;
-                }
+    /* only sources have dependencies */
+    id = 0;
+    while (other = next_indexed_file(INDEX_SOURCES, &id), other != NULL) {
+        for (size_t d = 0; d < other->num_related; d++) {
+            if (other->related[d] == file) {
+                clear_dependencies(other);
+                break;
             }
-            collect_from_directory(path, len_path + 1 + len_name);
-        } else if (ent->d_type == DT_REG) {
-            path->s[len_path + len_name + 1] = '\0';
-            add_file(path->s, -1, path->f & FLAG_IS_TEST);
         }
     }
 
-    closedir(dir);
-    return 0;
+    free(file->related);
+    FileMemory.unused = sreallocarray(FileMemory.unused,
+            FileMemory.num_unused + 1, sizeof(*FileMemory.unused));
+    FileMemory.unused[FileMemory.num_unused++] = file;
 }
 
-int collect_files(void)
+void clear_files(void)
 {
-    int result = 0;
+    for (size_t i = 0; i < Files.num; i++) {
+        free(Files.ptr[i]->related);
+    }
+    free(Files.ptr);
+    Files.ptr = NULL;
+    Files.num = 0;
+
+    for (size_t i = 0; i < FileMemory.num_slabs; i++) {
+        free(FileMemory.slabs[i]);
+    }
+    free(FileMemory.slabs);
+    free(FileMemory.unused);
+    clear_arena(&FileMemory.paths);
+    memset(&FileMemory, 0, sizeof(FileMemory));
+
+    for (size_t i = 0; i < INDEX_MAX; i++) {
+        free(Indexes[i].bits);
+        Indexes[i].bits = NULL;
+        Indexes[i].num_words = 0;
+    }
+}
+
+/**
+ * @brief Compares two walk entries by path and then by root.
+ */
+static int compare_walk_entries(const void *a, const void *b)
+{
+    const struct walk_entry *const e1 = a, *const e2 = b;
+    int cmp;
+
+    cmp = strcmp(e1->path, e2->path);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return e1->root < e2->root ? -1 : e1->root > e2->root;
+}
+
+/**
+ * @brief Merges the files found by `walk_directories()` into the file list.
+ *
+ * The entries are sorted and then merged with the sorted file list in a single
+ * pass. If a file was found under multiple roots, the flags of the last root
+ * win, just like consecutive calls to `put_file()` would do.
+ *
+ * @param entries       The entries to merge, they get sorted.
+ * @param num_entries   The number of entries.
+ */
+static void merge_walk_entries(struct walk_entry *entries, size_t num_entries)
+{
+    struct file **ptr;
+    size_t num = 0;
+    size_t i = 0, j = 0;
+    int cmp;
     struct file *file;
-    struct path path;
-    size_t len_path;
 
-    path.a = 128;
-    path.s = smalloc(path.a);
-    for (size_t i = 0; i < Files.num; i++) {
-        file = Files.ptr[i];
-        if (file->type != EXT_TYPE_FOLDER || !(file->flags & FLAG_EXISTS)) {
+    if (num_entries == 0) {
+        return;
+    }
+
+    qsort(entries, num_entries, sizeof(*entries), compare_walk_entries);
+
+    ptr = sreallocarray(NULL, Files.num + num_entries, sizeof(*ptr));
+    while (j < num_entries) {
+        if (num > 0 && strcmp(ptr[num - 1]->path, entries[j].path) == 0) {
+            /* found under multiple roots */
+            update_flags(ptr[num - 1], entries[j].flags & FLAG_IS_TEST);
+            j++;
             continue;
         }
+        cmp = i == Files.num ? 1 : strcmp(Files.ptr[i]->path, entries[j].path);
+        if (cmp < 0) {
+            ptr[num++] = Files.ptr[i++];
+        } else if (cmp == 0) {
+            file = Files.ptr[i++];
+            update_flags(file, entries[j++].flags & FLAG_IS_TEST);
+            ptr[num++] = file;
+        } else {
+            file = make_file(entries[j].path, -1,
+                    entries[j].flags & FLAG_IS_TEST);
+            j++;
+            ptr[num++] = file;
+        }
+    }
+    while (i < Files.num) {
+        ptr[num++] = Files.ptr[i++];
+    }
+    free(Files.ptr);
+    Files.ptr = ptr;
+    Files.num = num;
+}
+
+/**
+ * @brief Splits extensions separated by '|' and appends them to a list.
+ *
+ * @return false if one of the extensions is '*'.
+ */
+static bool append_extensions(const char *s, char ***pexts, size_t *pnum_exts)
+{
+    const char *end;
+    char *ext;
 
-        len_path = strlen(file->path);
-        if (len_path + 1 > path.a) {
-            path.a = len_path + 1;
-            path.s = srealloc(path.s, path.a);
+    while (s[0] != '\0') {
+        end = strchrnul(s, '|');
+        if (end - s == 1 && s[0] == '*') {
+            return false;
+        }
+        if (end != s) {
+            ext = smalloc(end - s + 1);
+            memcpy(ext, s, end - s);
+            ext[end - s] = '\0';
+            *pexts = sreallocarray(*pexts, *pnum_exts + 1, sizeof(**pexts));
+            (*pexts)[(*pnum_exts)++] = ext;
         }
-        strcpy(path.s, file->path);
-        path.f = file->flags;
-        result += collect_from_directory(&path, len_path);
+        if (end[0] == '\0') {
+            break;
+        }
+        s = end + 1;
     }
-    free(path.s);
+    return true;
+}
+
+/**
+ * @brief Gets the extensions of the files that should be collected.
+ *
+ * These are sources, headers, the test files `.input`, `.data` and `.output`
+ * and all extensions within `EXT_COLLECT`.
+ *
+ * @param pexts         Output of the extensions, they must be freed.
+ * @param pnum_exts     Output of the number of extensions.
+ *
+ * @return false if all files should be collected, then there is no output.
+ */
+static bool get_collected_extensions(char ***pexts, size_t *pnum_exts)
+{
+    static const char *test_exts = ".input|.data|.output";
+    struct config_entry *exts_entry, *collect_entry;
+    bool all = false;
+
+    *pexts = NULL;
+    *pnum_exts = 0;
+
+    exts_entry = get_conf("extensions", NULL);
+    collect_entry = get_conf("ext_collect", NULL);
+    append_extensions(test_exts, pexts, pnum_exts);
+    if (exts_entry->values[EXT_TYPE_SOURCE] != NULL) {
+        append_extensions(exts_entry->values[EXT_TYPE_SOURCE],
+                pexts, pnum_exts);
+    }
+    if (exts_entry->values[EXT_TYPE_HEADER] != NULL) {
+        append_extensions(exts_entry->values[EXT_TYPE_HEADER],
+                pexts, pnum_exts);
+    }
+    for (size_t i = 0; collect_entry != NULL &&
+            i < collect_entry->num_values; i++) {
+        if (!append_extensions(collect_entry->values[i], pexts, pnum_exts)) {
+            all = true;
+            break;
+        }
+    }
+    if (all) {
+        for (size_t i = 0; i < *pnum_exts; i++) {
+            free((*pexts)[i]);
+        }
+        free(*pexts);
+        *pexts = NULL;
+        *pnum_exts = 0;
+        return false;
+    }
+    return true;
+}
+
+int collect_files(void)
+{
+    int result;
+    struct file *file;
+    size_t id;
+    struct walk_root *roots = NULL;
+    size_t num_roots = 0;
+    struct config_entry *ignore_entry, *build_entry;
+    struct ignore ignore;
+    struct walk_filter filter;
+    struct walk walk;
+
+    id = 0;
+    while (file = next_indexed_file(INDEX_FOLDERS, &id), file != NULL) {
+        if (!(file->flags & FLAG_EXISTS)) {
+            continue;
+        }
+        roots = sreallocarray(roots, num_roots + 1, sizeof(*roots));
+        roots[num_roots].path = file->path;
+        roots[num_roots].recursive = !!(file->flags & FLAG_IS_RECURSIVE);
+        roots[num_roots].flags = file->flags;
+        num_roots++;
+    }
+
+    ignore_entry = get_conf("ignore", NULL);
+    build_entry = get_conf("build", NULL);
+    compile_ignore(&ignore,
+            ignore_entry == NULL ? NULL : ignore_entry->values,
+            ignore_entry == NULL ? 0 : ignore_entry->num_values,
+            build_entry == NULL || build_entry->num_values == 0 ? NULL :
+                build_entry->values[0]);
+    for (size_t i = 0; i < Variants.num; i++) {
+        ignore_directory(&ignore, Variants.ptr[i].build);
+    }
+
+    filter.ignore = &ignore;
+    get_collected_extensions(&filter.exts, &filter.num_exts);
+
+    result = walk_directories(roots, num_roots, &filter, &walk);
+    merge_walk_entries(walk.entries, walk.num_entries);
+    Files.num_skipped = walk.num_skipped;
+
+    clear_walk(&walk);
+    for (size_t i = 0; i < filter.num_exts; i++) {
+        free(filter.exts[i]);
+    }
+    free(filter.exts);
+    clear_ignore(&ignore);
+    free(roots);
     return result;
 }
 
+/**
+ * Number of files that are stat'ed in a single batch, all directories of a
+ * batch are kept open until the batch is done.
+ */
+#define REFRESH_BATCH 1024
+
+/**
+ * @brief Starts a new cycle which invalidates all cached stat information.
+ */
+static void start_cycle(void)
+{
+    Files.cycle++;
+    if (Files.cycle == 0) {
+        Files.cycle = 1;
+    }
+    forget_directories();
+}
+
+void refresh_files(void)
+{
+    struct config_entry *io_uring_entry;
+    bool use_io_uring;
+    struct stat_request *reqs;
+    int *dir_fds;
+    size_t num_dir_fds;
+    size_t n;
+    struct file *file;
+    char *name, *prev_dir;
+    size_t len_dir, len_prev_dir;
+    int dir_fd;
+
+    start_cycle();
+
+    io_uring_entry = get_conf("io_uring", NULL);
+    use_io_uring = io_uring_entry != NULL && io_uring_entry->num_values > 0 &&
+        (io_uring_entry->values[0][0] == 'y' ||
+         io_uring_entry->values[0][0] == 't');
+
+    reqs = sreallocarray(NULL, REFRESH_BATCH, sizeof(*reqs));
+    dir_fds = sreallocarray(NULL, REFRESH_BATCH, sizeof(*dir_fds));
+    for (size_t i = 0; i < Files.num; i += n) {
+        n = MIN(Files.num - i, REFRESH_BATCH);
+        num_dir_fds = 0;
+        prev_dir = NULL;
+        len_prev_dir = 0;
+        dir_fd = AT_FDCWD;
+        for (size_t j = 0; j < n; j++) {
+            file = Files.ptr[i + j];
+            name = strrchr(file->path, '/');
+            if (name == NULL) {
+                len_dir = 0;
+                name = file->path;
+            } else {
+                len_dir = name - file->path;
+                name++;
+            }
+
+            /* the list is sorted, so files of the same directory are mostly
+             * next to each other */
+            if (len_dir == 0) {
+                reqs[j].dir_fd = AT_FDCWD;
+            } else if (prev_dir != NULL && len_dir == len_prev_dir &&
+                    memcmp(prev_dir, file->path, len_dir) == 0) {
+                reqs[j].dir_fd = dir_fd;
+            } else {
+                name[-1] = '\0';
+                dir_fd = open(file->path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+                name[-1] = '/';
+                if (dir_fd == -1) {
+                    /* fall back to the full path */
+                    dir_fd = AT_FDCWD;
+                    name = file->path;
+                    prev_dir = NULL;
+                } else {
+                    dir_fds[num_dir_fds++] = dir_fd;
+                    prev_dir = file->path;
+                    len_prev_dir = len_dir;
+                }
+                reqs[j].dir_fd = dir_fd;
+            }
+            reqs[j].name = name;
+        }
+
+        stat_batch(reqs, n, use_io_uring);
+
+        for (size_t j = 0; j < n; j++) {
+            apply_stat(Files.ptr[i + j], reqs[j].error, &reqs[j].st);
+        }
+        for (size_t d = 0; d < num_dir_fds; d++) {
+            close(dir_fds[d]);
+        }
+    }
+    free(reqs);
+    free(dir_fds);
+}
+
 /**
  * @brief Checks if the given object file has a function called 'main'.
  *
@@ -323,63 +844,126 @@ static bool object_has_main(const char *o)
 }
 
 /**
- * @brief Rebuilds a source file.
+ * @brief Guesses if a source file defines a function called 'main'.
  *
- * Constructs a command like: `gcc <flags> -c src -o obj` and runs it.
- * Also sets the `FLAG_HAS_MAIN` flag for the object if it includes a main
- * function.
+ * This only looks for a line that starts without indentation, has "main"
+ * followed by '(' and does not end with ';'. It is used when there is no
+ * object to look at, the next build sets the right flag.
  *
- * @param src The source file to rebuild.
- * @param obj The destination object file.
+ * @param path Path of the source file.
  *
- * @return Whether building was successful.
+ * @return Whether the source file seems to have a 'main' function.
  */
-static bool rebuild_object(struct file *src, struct file *obj)
+static bool source_has_main(const char *path)
 {
-    struct config_entry *cc_entry,
-                        *c_flags_entry,
-                        *err_file_entry;
-    char *err_file;
+    FILE *fp;
+    char line[1024];
+    char *m, *e;
+    bool has_main = false;
 
-    cc_entry = get_conf("cc", NULL);
-    c_flags_entry = get_conf("c_flags", NULL);
-    err_file_entry = get_conf("err_file", NULL);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return false;
+    }
+    while (!has_main && fgets(line, sizeof(line), fp) != NULL) {
+        if (!isalpha(line[0])) {
+            continue;
+        }
+        for (m = line; m = strstr(m, "main"), m != NULL; m += 4) {
+            if (m != line && (isalnum(m[-1]) || m[-1] == '_')) {
+                continue;
+            }
+            e = &m[4];
+            while (e[0] == ' ' || e[0] == '\t') {
+                e++;
+            }
+            if (e[0] == '(') {
+                e = &e[strlen(e)];
+                while (e != line && isspace(e[-1])) {
+                    e--;
+                }
+                has_main = e == line || e[-1] != ';';
+                break;
+            }
+        }
+    }
+    fclose(fp);
+    return has_main;
+}
 
-    err_file = err_file_entry == NULL || err_file_entry->num_values == 0 ?
-        NULL : err_file_entry->values[0];
+void classify_object(const struct file *src, struct file *obj)
+{
+    bool has_main;
 
-    char *args[6 + c_flags_entry->num_values];
-    int argi = 0;
+    if (!(obj->flags & FLAG_IS_FRESH) && (obj->flags & FLAG_EXISTS)) {
+        /* already looked at by `update_object()` or an earlier call */
+        return;
+    }
+    if ((obj->flags & FLAG_EXISTS) && obj->mtime_ns >= src->mtime_ns) {
+        has_main = object_has_main(obj->path);
+        obj->flags &= ~FLAG_IS_FRESH;
+    } else {
+        has_main = source_has_main(src->path);
+    }
+    if (has_main) {
+        set_file_flags(obj, obj->flags | FLAG_HAS_MAIN);
+    } else {
+        set_file_flags(obj, obj->flags & ~FLAG_HAS_MAIN);
+    }
+}
+
+char **get_compile_args(const struct file *src, const struct file *obj,
+        const struct variant *variant)
+{
+    struct config_entry *cc_entry;
+    char **args;
+    size_t argi = 0;
+
+    cc_entry = get_conf("cc", NULL);
 
+    args = sreallocarray(NULL, 6 + variant->num_c_flags, sizeof(*args));
     args[argi++] = cc_entry->values[0];
-    for (size_t f = 0; f < c_flags_entry->num_values; f++) {
-        args[argi++] = c_flags_entry->values[f];
+    for (size_t f = 0; f < variant->num_c_flags; f++) {
+        args[argi++] = variant->c_flags[f];
     }
     args[argi++] = (char*) "-c";
     args[argi++] = src->path;
     args[argi++] = (char*) "-o";
     args[argi++] = obj->path;
     args[argi] = NULL;
-    if (create_recursive_directory(obj->path) == -1) {
-        return false;
-    }
-    if (run_executable(args, err_file, NULL) != 0) {
+    return args;
+}
+
+/**
+ * @brief Takes over the result of compiling a source file.
+ *
+ * Also sets the `FLAG_HAS_MAIN` flag for the object if it includes a main
+ * function.
+ *
+ * @param obj       The object file that was built.
+ * @param status    The exit status of the compiler.
+ *
+ * @return Whether building was successful.
+ */
+static bool finish_object(struct file *obj, int status)
+{
+    if (status != 0) {
         obj->flags &= ~FLAG_EXISTS;
         return false;
     }
     if (object_has_main(obj->path)) {
-        obj->flags |= FLAG_HAS_MAIN;
+        set_file_flags(obj, obj->flags | FLAG_HAS_MAIN);
     } else {
-        obj->flags &= ~FLAG_HAS_MAIN;
+        set_file_flags(obj, obj->flags & ~FLAG_HAS_MAIN);
     }
-    obj->flags |= FLAG_EXISTS;
+    restat_file(obj);
     return true;
 }
 
-struct file *get_object_file(const struct file *file)
+struct file *get_object_file(const struct file *file,
+        const struct variant *variant)
 {
     struct config_entry *exts_entry;
-    struct config_entry *build_entry;
     char *e;
     size_t l;
     size_t lb;
@@ -387,14 +971,13 @@ struct file *get_object_file(const struct file *file)
     struct file *obj;
 
     exts_entry = get_conf("extensions", NULL);
-    build_entry = get_conf("build", NULL);
 
     e = exts_entry->values[EXT_TYPE_OBJECT];
     l = e == NULL ? 0 : strlen(e);
-    lb = strlen(build_entry->values[0]);
+    lb = strlen(variant->build);
 
     o = smalloc(lb + 1 + (file->ext - file->path) + l + 1);
-    memcpy(o, build_entry->values[0], lb);
+    memcpy(o, variant->build, lb);
     o[lb] = '/';
     memcpy(&o[lb + 1], file->path, file->ext - file->path);
     memcpy(&o[lb + 1 + file->ext - file->path], e, l);
@@ -478,9 +1061,11 @@ static void parse_make_directive(FILE *fp, char ***ppaths, size_t *pnum_paths)
 /**
  * @brief Checks if any included header files changed.
  *
- * Uses `gcc -MM -MG <file path>` and `parse_make_directive()` to get all header
- * files and then checks if they are newer than the object file which means the
- * source file needs rebuilding.
+ * The first time, this uses `gcc -MM -MG <file path>` and
+ * `parse_make_directive()` to get all header files and stores them in the
+ * `related` member of the source file, then it checks if they are newer than
+ * the object file which means the source file needs rebuilding. The list is
+ * kept until the source file is rebuilt.
  *
  * @param file  The source file.
  * @param obj   The associated object file.
@@ -493,11 +1078,12 @@ static bool has_header_changed(struct file *file, struct file *obj)
 {
     struct config_entry *header_entry;
     char *cmd;
+    pid_t pid;
+    int fd;
     FILE *pp;
-    char **paths;
-    size_t num_paths;
+    char **paths = NULL;
+    size_t num_paths = 0;
     struct file *other;
-    bool chg = false;
 
     header_entry = get_conf("ignore_header_change", NULL);
     if (header_entry != NULL && header_entry->num_values > 0 &&
@@ -506,61 +1092,121 @@ static bool has_header_changed(struct file *file, struct file *obj)
         return false;
     }
 
-    cmd = sasprintf("gcc -MM -MG %s", file->path);
-    pp = popen(cmd, "r");
-    free(cmd);
-    parse_make_directive(pp, &paths, &num_paths);
-    pclose(pp);
+    if (!(file->flags & FLAG_HAS_DEPS)) {
+        cmd = sasprintf("gcc -MM -MG %s", file->path);
+        pid = start_shell("/bin/sh", cmd, &fd);
+        free(cmd);
+        if (pid != -1) {
+            pp = fdopen(fd, "r");
+            parse_make_directive(pp, &paths, &num_paths);
+            fclose(pp);
+            wait_process(pid);
+        }
+
+        /* adding files may move the source, but not the pointer to it */
+        file->related = sreallocarray(NULL, num_paths,
+                sizeof(*file->related));
+        file->num_related = 0;
+        for (size_t i = 0; i < num_paths; i++) {
+            other = add_file(paths[i], -1, 0);
+            if (other != NULL) {
+                file->related[file->num_related++] = other;
+            }
+            free(paths[i]);
+        }
+        free(paths);
+        file->flags |= FLAG_HAS_DEPS;
+    }
 
-    for (size_t i = 0; i < num_paths; i++) {
-        other = add_file(paths[i], -1, 0);
-        if (other->st.st_mtime > obj->st.st_mtime) {
-            chg = true;
+    for (size_t i = 0; i < file->num_related; i++) {
+        if (file->related[i]->mtime_ns > obj->mtime_ns) {
+            return true;
         }
-        free(paths[i]);
     }
-    free(paths);
-    return chg;
+    return false;
 }
 
 /**
- * @brief Recompiles given source file if needed.
+ * @brief Checks if given source file needs to be recompiled.
+ *
+ * An object that is up to date but was not looked at yet gets its
+ * `FLAG_HAS_MAIN` flag.
  *
  * @param file  The source file.
  * @param obj   The associated object file.
  *
- * @return If recompiling was successful.
+ * @return Whether the object must be rebuilt.
  */
-static bool update_object(struct file *file, struct file *obj)
+static bool needs_rebuild(struct file *file, struct file *obj)
 {
     if (!(obj->flags & FLAG_EXISTS) ||
-            file->st.st_mtime > obj->st.st_mtime ||
+            file->mtime_ns > obj->mtime_ns ||
             has_header_changed(file, obj)) {
-        if (!rebuild_object(file, obj)) {
-            return false;
-        }
-    } else if (obj->flags & FLAG_IS_FRESH) {
+        /* the includes might have changed */
+        clear_dependencies(file);
+        return true;
+    }
+    if (obj->flags & FLAG_IS_FRESH) {
         if (object_has_main(obj->path)) {
-            obj->flags |= FLAG_HAS_MAIN;
+            set_file_flags(obj, obj->flags | FLAG_HAS_MAIN);
         } else {
-            obj->flags &= ~FLAG_HAS_MAIN;
+            set_file_flags(obj, obj->flags & ~FLAG_HAS_MAIN);
         }
     }
     obj->flags &= ~FLAG_IS_FRESH;
-    return true;
+    return false;
 }
 
 bool build_objects(void)
 {
-    struct file *file;
+    struct config_entry *err_file_entry;
+    const char *err_file;
+    struct file *file, *obj;
+    struct job *jobs = NULL;
+    struct file **objects = NULL;
+    size_t num_jobs = 0;
+    size_t id;
 
-    for (size_t i = 0; i < Files.num; i++) {
-        file = Files.ptr[i];
-        if (file->type == EXT_TYPE_SOURCE) {
-            update_object(file, get_object_file(file));
+    refresh_files();
+    update_compdb();
+
+    err_file_entry = get_conf("err_file", NULL);
+    err_file = err_file_entry == NULL || err_file_entry->num_values == 0 ?
+        NULL : err_file_entry->values[0];
+
+    /* the variants share the sources and their dependencies, the objects of
+     * all of them are compiled by the same slots */
+    for (size_t v = 0; v < Variants.num; v++) {
+        id = 0;
+        while (file = next_indexed_file(INDEX_SOURCES, &id), file != NULL) {
+            obj = get_object_file(file, &Variants.ptr[v]);
+            if (!needs_rebuild(file, obj) ||
+                    create_recursive_directory(obj->path) == -1) {
+                continue;
+            }
+            jobs = sreallocarray(jobs, num_jobs + 1, sizeof(*jobs));
+            objects = sreallocarray(objects, num_jobs + 1, sizeof(*objects));
+            jobs[num_jobs].args = get_compile_args(file, obj,
+                    &Variants.ptr[v]);
+            jobs[num_jobs].err_file = err_file;
+            objects[num_jobs++] = obj;
         }
+    }
+    id = 0;
+    while (file = next_indexed_file(INDEX_SOURCES, &id), file != NULL) {
         file->flags &= ~FLAG_IS_FRESH;
     }
+
+    /* the compilers run in other threads, but only this one touches the
+     * files */
+    run_jobs(jobs, num_jobs);
+    for (size_t i = 0; i < num_jobs; i++) {
+        finish_object(objects[i], jobs[i].status);
+        objects[i]->flags &= ~FLAG_IS_FRESH;
+        free(jobs[i].args);
+    }
+    free(jobs);
+    free(objects);
     return true;
 }
 
@@ -573,33 +1219,30 @@ bool build_objects(void)
  * @param objects       The objects to link.
  * @param num_objects   The number of objects to link.
  * @param main_object   The main objects.
+ * @param variant       The variant with the flags to link with.
  *
  * @return Whether linking was successful.
  */
 static bool relink_executable(struct file *exec,
         struct file **objects, size_t num_objects,
-        struct file *main_object)
+        struct file *main_object, const struct variant *variant)
 {
     struct config_entry *cc_entry,
-                        *c_flags_entry,
-                        *c_libs_entry,
                         *err_file_entry;
     char *err_file;
 
     cc_entry = get_conf("cc", NULL);
-    c_flags_entry = get_conf("c_flags", NULL);
-    c_libs_entry = get_conf("c_libs", NULL);
     err_file_entry = get_conf("err_file", NULL);
     err_file = err_file_entry == NULL || err_file_entry->num_values == 0 ?
         NULL : err_file_entry->values[0];
 
-    char *args[1 + c_flags_entry->num_values + num_objects + 3 +
-        c_libs_entry->num_values + + 1];
+    char *args[1 + variant->num_c_flags + num_objects + 3 +
+        variant->num_c_libs + 1];
     size_t argi = 0;
 
     args[argi++] = cc_entry->values[0];
-    for (size_t i = 0; i < c_flags_entry->num_values; i++) {
-        args[argi++] = c_flags_entry->values[i];
+    for (size_t i = 0; i < variant->num_c_flags; i++) {
+        args[argi++] = variant->c_flags[i];
     }
     for (size_t i = 0; i < num_objects; i++) {
         args[argi++] = objects[i]->path;
@@ -607,8 +1250,8 @@ static bool relink_executable(struct file *exec,
     args[argi++] = main_object->path;
     args[argi++] = "-o";
     args[argi++] = exec->path;
-    for (size_t i = 0; i < c_libs_entry->num_values; i++) {
-        args[argi++] = c_libs_entry->values[i];
+    for (size_t i = 0; i < variant->num_c_libs; i++) {
+        args[argi++] = variant->c_libs[i];
     }
     args[argi] = NULL;
     if (create_recursive_directory(exec->path) == -1) {
@@ -617,7 +1260,7 @@ static bool relink_executable(struct file *exec,
     if (run_executable(args, err_file, NULL) != 0) {
         return false;
     }
-    exec->flags |= FLAG_EXISTS;
+    restat_file(exec);
     return true;
 }
 
@@ -644,35 +1287,65 @@ struct file *get_exec_file(const struct file *file)
     return exec;
 }
 
-bool link_executables(void)
+int compare_file_paths(const void *a, const void *b)
+{
+    const struct file *const *f1 = a, *const *f2 = b;
+
+    return strcmp((*f1)->path, (*f2)->path);
+}
+
+bool is_variant_file(const struct file *file, const struct variant *variant)
+{
+    size_t len;
+
+    len = strlen(variant->build);
+    return strncmp(file->path, variant->build, len) == 0 &&
+        file->path[len] == '/';
+}
+
+/**
+ * @brief Links the executables of a variant.
+ *
+ * @param variant   The variant.
+ *
+ * @return Whether all executables could be linked.
+ */
+static bool link_variant(const struct variant *variant)
 {
     struct file *file;
     struct file **objects = NULL;
     size_t num_objects = 0;
-    time_t latest_time = 0;
+    int64_t latest_mtime = 0;
     struct file *exec;
+    size_t id;
 
-    for (size_t i = 0; i < Files.num; i++) {
-        file = Files.ptr[i];
-        if (file->type == EXT_TYPE_OBJECT && !(file->flags & FLAG_HAS_MAIN)) {
-            latest_time = MAX(latest_time, file->st.st_mtime);
-            objects = sreallocarray(objects, num_objects + 1, sizeof(*objects));
-            objects[num_objects++] = file;
+    id = 0;
+    while (file = next_indexed_file(INDEX_OBJECTS, &id), file != NULL) {
+        if (!is_variant_file(file, variant)) {
+            continue;
         }
+        latest_mtime = MAX(latest_mtime, file->mtime_ns);
+        objects = sreallocarray(objects, num_objects + 1, sizeof(*objects));
+        objects[num_objects++] = file;
     }
+    /* keep the command line the same no matter in which order the objects
+     * were added */
+    qsort(objects, num_objects, sizeof(*objects), compare_file_paths);
 
-    for (size_t i = 0; i < Files.num; i++) {
-        file = Files.ptr[i];
-        if (file->flags & FLAG_HAS_MAIN) {
-            exec = get_exec_file(file);
-            if (!(exec->flags & FLAG_EXISTS) ||
-                    MAX(latest_time, file->st.st_mtime) > exec->st.st_mtime) {
-                if (!relink_executable(exec, objects, num_objects, file)) {
-                    free(objects);
-                    return false;
-                }
-                exec->flags |= FLAG_IS_FRESH;
+    id = 0;
+    while (file = next_indexed_file(INDEX_MAIN_OBJECTS, &id), file != NULL) {
+        if (!is_variant_file(file, variant)) {
+            continue;
+        }
+        exec = get_exec_file(file);
+        if (!(exec->flags & FLAG_EXISTS) ||
+                MAX(latest_mtime, file->mtime_ns) > exec->mtime_ns) {
+            if (!relink_executable(exec, objects, num_objects, file,
+                        variant)) {
+                free(objects);
+                return false;
             }
+            exec->flags |= FLAG_IS_FRESH;
         }
     }
 
@@ -680,126 +1353,156 @@ bool link_executables(void)
     return true;
 }
 
+bool link_executables(void)
+{
+    bool result = true;
+
+    /* a variant that fails to link does not hold up the others */
+    for (size_t v = 0; v < Variants.num; v++) {
+        if (!link_variant(&Variants.ptr[v])) {
+            result = false;
+        }
+    }
+    return result;
+}
+
+void get_test_files(const struct file *exec, struct file **input,
+        struct file **data, struct file **output)
+{
+    struct file *other;
+    const char *name, *n;
+    size_t len, l;
+    size_t id;
+
+    name = exec->ext;
+    while (name != exec->path) {
+        if (name[0] == '/') {
+            name++;
+            break;
+        }
+        name--;
+    }
+    len = exec->ext - name;
+    *input = NULL;
+    *data = NULL;
+    *output = NULL;
+    id = 0;
+    while (other = next_indexed_file(INDEX_OTHERS, &id), other != NULL) {
+        n = other->ext;
+        while (n != other->path) {
+            if (n[0] == '/') {
+                n++;
+                break;
+            }
+            n--;
+        }
+        l = other->ext - n;
+        if (l != len || memcmp(name, n, l) != 0) {
+            continue;
+        }
+        if (strcmp(other->ext, ".input") == 0) {
+            *input = other;
+        } else if (strcmp(other->ext, ".data") == 0) {
+            *data = other;
+        } else if (strcmp(other->ext, ".output") == 0 &&
+                other->ext - other->path == exec->ext - exec->path &&
+                memcmp(other->path, exec->path,
+                    exec->ext - exec->path) == 0) {
+            /* each variant has its own output next to the executable */
+            *output = other;
+        }
+    }
+}
+
 bool run_tests(void)
 {
     struct config_entry *diff_entry;
-    struct file *file, *other, *input, *output, *data;
+    struct file *file, *input, *output, *data;
     bool update;
     char *args[4];
     int c;
     FILE *fp;
-    char *name, *n;
-    size_t len, l;
     char *output_path;
+    size_t id;
 
     diff_entry = get_conf("diff", NULL);
 
-    for (size_t i = 0; i < Files.num; i++) {
-        file = Files.ptr[i];
-        if (file->type != EXT_TYPE_EXECUTABLE ||
-                (file->flags & (FLAG_IS_TEST | FLAG_EXISTS)) !=
-                (FLAG_IS_TEST | FLAG_EXISTS)) {
-            DLOG("'%s' is not a test\n", file->path);
-            continue;
-        }
-
-        update = false;
-
-        name = file->ext;
-        while (name != file->path) {
-            if (name[0] == '/') {
-                name++;
-                break;
-            }
-            name--;
-        }
-        len = file->ext - name;
-        input = NULL;
-        data = NULL;
-        output = NULL;
-        for (size_t j = 0; j < Files.num; j++) {
-            other = Files.ptr[j];
-            if (other->type != EXT_TYPE_OTHER) {
+    for (size_t v = 0; v < Variants.num; v++) {
+        id = 0;
+        while (file = next_indexed_file(INDEX_TESTS, &id), file != NULL) {
+            if (!is_variant_file(file, &Variants.ptr[v])) {
                 continue;
             }
-            n = other->ext;
-            while (n != other->path) {
-                if (n[0] == '/') {
-                    n++;
-                    break;
-                }
-                n--;
-            }
-            l = other->ext - n;
-            if (l != len || memcmp(name, n, l) != 0) {
+            if (!(file->flags & FLAG_EXISTS)) {
+                DLOG("'%s' does not exist\n", file->path);
                 continue;
             }
-            if (strcmp(other->ext, ".input") == 0) {
-                input = other;
-            } else if (strcmp(other->ext, ".data") == 0) {
-                data = other;
-            } else if (strcmp(other->ext, ".output") == 0) {
-                output = other;
-            }
-        }
 
-        if (input == NULL && data == NULL) {
-            DLOG("not running '%s'\n", file->path);
-            continue;
-        }
+            update = false;
 
-        if (output == NULL) {
-            output_path = smalloc(file->ext - file->path + sizeof(".output"));
-            memcpy(output->path, file->path, file->ext - file->path);
-            strcpy(&output->path[file->ext - file->path], ".output");
-            output = add_file(output_path, EXT_TYPE_OTHER, FLAG_IS_TEST);
-            free(output_path);
-            update = true;
-        } else if ((output->flags & FLAG_IS_FRESH)) {
-            update = true;
-        }
-        if (output->st.st_mtime < file->st.st_mtime) {
-            update = true;
-        }
-        if (input != NULL && output->st.st_mtime < input->st.st_mtime) {
-            update = true;
-        }
-        if (data != NULL && output->st.st_mtime < data->st.st_mtime) {
-            update = true;
-        }
+            get_test_files(file, &input, &data, &output);
 
-        output->flags &= ~FLAG_IS_FRESH;
+            if (input == NULL && data == NULL) {
+                DLOG("not running '%s'\n", file->path);
+                continue;
+            }
 
-        if (!update) {
-            DLOG("test has not changed\n");
-            continue;
-        }
+            if (output == NULL) {
+                output_path = smalloc(file->ext - file->path +
+                        sizeof(".output"));
+                memcpy(output_path, file->path, file->ext - file->path);
+                strcpy(&output_path[file->ext - file->path], ".output");
+                /* the build directories are not collected, the output of an
+                 * earlier run may still be up to date */
+                output = add_file(output_path, EXT_TYPE_OTHER, FLAG_IS_TEST);
+                free(output_path);
+            } else if ((output->flags & FLAG_IS_FRESH)) {
+                update = true;
+            }
+            if (!(output->flags & FLAG_EXISTS) ||
+                    output->mtime_ns < file->mtime_ns) {
+                update = true;
+            }
+            if (input != NULL && output->mtime_ns < input->mtime_ns) {
+                update = true;
+            }
+            if (data != NULL && output->mtime_ns < data->mtime_ns) {
+                update = true;
+            }
 
-        args[0] = file->path;
-        args[1] = NULL;
-        if (run_executable(args, output->path, input == NULL ?
-                    "/dev/null" : input->path) != 0) {
-            return false;
-        }
+            output->flags &= ~FLAG_IS_FRESH;
+
+            if (!update) {
+                DLOG("test has not changed\n");
+                continue;
+            }
 
-        fprintf(stderr, "| %s |\n", output->path);
-        if (data != NULL) {
-            args[0] = diff_entry->values[0];
-            args[1] = data->path;
-            args[2] = output->path;
-            args[3] = NULL;
-            if (run_executable(args, NULL, NULL) != 0) {
+            args[0] = file->path;
+            args[1] = NULL;
+            if (run_executable(args, output->path, input == NULL ?
+                        "/dev/null" : input->path) != 0) {
                 return false;
             }
-        } else {
-            fp = fopen(output->path, "rb");
-            if (fp != NULL) {
-                while (c = fgetc(fp), c != EOF) {
-                    fputc(c, stderr);
+
+            fprintf(stderr, "| %s |\n", output->path);
+            if (data != NULL) {
+                args[0] = diff_entry->values[0];
+                args[1] = data->path;
+                args[2] = output->path;
+                args[3] = NULL;
+                if (run_executable(args, NULL, NULL) != 0) {
+                    return false;
                 }
-                fclose(fp);
-                if (c != '\n') {
-                    fputc('\n', stderr);
+            } else {
+                fp = fopen(output->path, "rb");
+                if (fp != NULL) {
+                    while (c = fgetc(fp), c != EOF) {
+                        fputc(c, stderr);
+                    }
+                    fclose(fp);
+                    if (c != '\n') {
+                        fputc('\n', stderr);
+                    }
                 }
             }
         }
@@ -11,8 +11,13 @@
 #define FLAG_IS_FRESH 0x8
 /// toggled if a directory should be scanned recursively
 #define FLAG_IS_RECURSIVE 0x10
+/// if `related` holds the headers this source includes
+#define FLAG_HAS_DEPS 0x20
+
+#include "conf.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <pthread.h>
 
@@ -21,21 +26,54 @@
 /**
  * A file is a reference to a path, its main purpose is to cache data so it does
  * not need to be recomputed every time.
+ *
+ * Files are allocated in slabs and their paths in an arena, the members that
+ * every phase checks come first so a scan over all files touches the first
+ * bytes of each record only. Of the stat information, only what autocar uses
+ * is kept.
  */
 struct file {
+    /// extension type of this file ('EXT_TYPE_*')
+    unsigned char type;
+    /// flags of this file (`FLAG_*`)
+    unsigned short flags;
+    /// value of `Files.cycle` when the stat information was last updated
+    unsigned cycle;
     /// full relative path of this file
     char *path;
     /// points at the file extension in `path`
     char *ext;
-    /// extension type of this file ('EXT_TYPE_*')
-    int type;
-    /// flags of this file (`FLAG_*`)
-    int flags;
-    /// stat information about this file
-    struct stat st;
+    /// modification time in nanoseconds, 0 if the file does not exist
+    int64_t mtime_ns;
+    /// size of the file in bytes
+    int64_t size;
+    /// inode number of the file
+    ino_t ino;
+    /// header files included by this source (see `FLAG_HAS_DEPS`)
     struct file **related;
+    /// number of elements in `related`
+    unsigned num_related;
+    /// stable number of this file, used as key in the indexes (`INDEX_*`)
+    unsigned id;
 };
 
+/// sources
+#define INDEX_SOURCES 0
+/// objects without a main function
+#define INDEX_OBJECTS 1
+/// files with `FLAG_HAS_MAIN`
+#define INDEX_MAIN_OBJECTS 2
+/// executables
+#define INDEX_EXECUTABLES 3
+/// executables with `FLAG_IS_TEST`
+#define INDEX_TESTS 4
+/// files of type `EXT_TYPE_OTHER` (like .input or .data files)
+#define INDEX_OTHERS 5
+/// folders
+#define INDEX_FOLDERS 6
+/// number of indexes
+#define INDEX_MAX 7
+
 /**
  * The file list has all files and is sorted by `path`.
  */
@@ -44,6 +82,10 @@ extern struct file_list {
     struct file **ptr;
     /// number of elements in the list
     size_t num;
+    /// the current build cycle, files are stat'ed at most once per cycle
+    unsigned cycle;
+    /// number of files the last `collect_files()` found but did not add
+    size_t num_skipped;
     /// locks the filer pointer
     pthread_mutex_t lock;
 } Files;
@@ -52,7 +94,8 @@ extern struct file_list {
  * @brief Makes a file object and adds it to the file list.
  *
  * Checks if a file with given parameters already exists and returns this file,
- * it also uses `stat_file()` on it. If it does not exist, it makes a file using
+ * it also uses `stat_file()` on it unless it was already stat'ed in the current
+ * cycle. If it does not exist, it makes a file using
  * given `folder`, `name` and `type`, constructs the `path` and then adds this
  * to the file list.
  *
@@ -78,6 +121,56 @@ struct file *add_file(char *path, int type, int flags);
  */
 struct file *search_file(const char *path, size_t *pindex);
 
+/**
+ * @brief Gets the next file within an index.
+ *
+ * Every index is a set of file ids that is updated whenever a file is added,
+ * removed or its type or flags change (see `set_file_flags()`), so phases can
+ * go over the files they need without looking at all others. Files are
+ * visited in the order of their ids and files added while iterating may or
+ * may not be visited. Usage:
+ * ```
+ * size_t id = 0;
+ * while (file = next_indexed_file(INDEX_SOURCES, &id), file != NULL) {
+ *     ...
+ * }
+ * ```
+ *
+ * @param index The index to go through (`INDEX_*`).
+ * @param pid   The id to start searching at, it is set to the id after the
+ *              returned file.
+ *
+ * @return The next file or `NULL` if there are no more files.
+ */
+struct file *next_indexed_file(int index, size_t *pid);
+
+/**
+ * @brief Sets the flags of a file and updates the indexes.
+ *
+ * Flags that no index depends on (like `FLAG_EXISTS` or `FLAG_IS_FRESH`) may
+ * be changed directly.
+ *
+ * @param file  The file to change.
+ * @param flags The new flags (`FLAG_*`).
+ */
+void set_file_flags(struct file *file, int flags);
+
+/**
+ * @brief Removes the file at given index from the file list and frees it.
+ *
+ * All dependency lists that refer to this file are dropped as well. The record
+ * is reused by the next added file, the path stays in the arena until
+ * `clear_files()`.
+ *
+ * @param index Index of the file within the file list.
+ */
+void remove_file(size_t index);
+
+/**
+ * @brief Removes all files and frees all memory of the file list.
+ */
+void clear_files(void);
+
 /**
  * @brief Find files in directories specified in the config.
  *
@@ -85,24 +178,79 @@ struct file *search_file(const char *path, size_t *pindex);
  * and adds them to the file list. If a file already exists on the file list,
  * then nothing happens.
  *
+ * The directories are traversed in parallel (see `walk_directories()`) and
+ * the results are merged into the file list at once. Entries matching the
+ * `IGNORE` patterns and the `BUILD` directory are skipped.
+ *
+ * Only sources, headers, test files (`.input`, `.data` and `.output`) and
+ * files with an extension in `EXT_COLLECT` are added, all others are only
+ * counted in `Files.num_skipped`.
+ *
  * @return Whether all directories were accessible.
  */
 int collect_files(void);
 
+/**
+ * @brief Updates the stat information of all files in the file list.
+ *
+ * All files are stat'ed in a single batch relative to their directory (see
+ * `stat_batch()`). This runs at the start of `build_objects()` so that files
+ * found by `collect_files()` do not need to be stat'ed on their own.
+ *
+ * A new cycle is started before, all stat information gathered in the
+ * previous cycle is considered outdated.
+ */
+void refresh_files(void);
+
 /**
  * @brief Gets the object file associated with given source file.
  *
- * @param file Source file.
+ * @param file      Source file.
+ * @param variant   The variant whose directory the object is in.
  *
  * @return Object file.
  */
-struct file *get_object_file(const struct file *file);
+struct file *get_object_file(const struct file *file,
+        const struct variant *variant);
 
 /**
- * Build all files.
+ * @brief Checks if a file is in the build directory of a variant.
+ */
+bool is_variant_file(const struct file *file, const struct variant *variant);
+
+/**
+ * @brief Sets `FLAG_HAS_MAIN` of an object without building it.
+ *
+ * Objects that were already looked at are left alone. Otherwise the symbols
+ * of the object are read if it is up to date, if not, the source is scanned
+ * for a definition of 'main'.
+ *
+ * @param src   Source file.
+ * @param obj   Object file of `src`.
+ */
+void classify_object(const struct file *src, struct file *obj);
+
+/**
+ * @brief Builds the objects of all variants.
+ *
+ * The objects that need rebuilding are compiled at once by `run_jobs()`, no
+ * matter which variant they belong to.
  */
 bool build_objects(void);
 
+/**
+ * @brief Gets the compiler invocation that builds an object from a source.
+ *
+ * @param src       Source file.
+ * @param obj       Object file of `src`.
+ * @param variant   The variant with the flags to compile with.
+ *
+ * @return A `NULL` terminated argument list that must be freed, the strings
+ *         belong to the config, the variant and the files.
+ */
+char **get_compile_args(const struct file *src, const struct file *obj,
+        const struct variant *variant);
+
 /**
  * @brief Gets the executable file associated with given source file.
  *
@@ -113,12 +261,38 @@ bool build_objects(void);
 struct file *get_exec_file(const struct file *file);
 
 /**
- * Link all executables.
+ * @brief Compares two file pointers by their path, for `qsort()`.
+ */
+int compare_file_paths(const void *a, const void *b);
+
+/**
+ * @brief Links the executables of all variants.
+ *
+ * The executables of a variant are linked from the objects in its directory
+ * only.
+ *
+ * @return Whether all executables could be linked.
  */
 bool link_executables(void);
 
 /**
- * Run all tests.
+ * @brief Finds the files that belong to a test executable.
+ *
+ * These are the other files with the same name (without directory and
+ * extension) as the executable and the extension ".input" or ".data" and the
+ * file next to the executable with the extension ".output". Any of them not
+ * found is set to `NULL`.
+ *
+ * @param exec      The test executable.
+ * @param input     Output of the file given to the test as standard input.
+ * @param data      Output of the file the test output is compared with.
+ * @param output    Output of the file the test output was written to.
+ */
+void get_test_files(const struct file *exec, struct file **input,
+        struct file **data, struct file **output);
+
+/**
+ * @brief Runs the tests of all variants, one variant after the other.
  */
 bool run_tests(void);
 
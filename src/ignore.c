@@ -0,0 +1,241 @@
+#include "args.h"
+#include "ignore.h"
+#include "salloc.h"
+
+#include <string.h>
+
+/**
+ * @brief Matches a character against a class like "[a-z_]".
+ *
+ * @param pp    Points to the character after '[', it is moved to the closing
+ *              ']'.
+ * @param c     The character to match.
+ *
+ * @return 1 if it matches, 0 if it does not and -1 if the class is not closed.
+ */
+static int match_class(const char **pp, char c)
+{
+    const char *p;
+    bool negate = false;
+    bool match = false;
+
+    p = *pp;
+    if (p[0] == '!' || p[0] == '^') {
+        negate = true;
+        p++;
+    }
+    /* a ']' right at the start is part of the class */
+    do {
+        if (p[0] == '\0') {
+            return -1;
+        }
+        if (p[0] == '\\' && p[1] != '\0') {
+            p++;
+        }
+        if (p[1] == '-' && p[2] != ']' && p[2] != '\0') {
+            if (c >= p[0] && c <= p[2]) {
+                match = true;
+            }
+            p += 3;
+        } else {
+            if (c == p[0]) {
+                match = true;
+            }
+            p++;
+        }
+    } while (p[0] != ']');
+    *pp = p;
+    return match != negate;
+}
+
+/**
+ * @brief Matches a string against a glob pattern.
+ *
+ * '*' does not match '/' but "**" does, if "**" is followed by a '/', it also
+ * matches no directory at all.
+ */
+static bool match_glob(const char *p, const char *s)
+{
+    int m;
+
+    for (; p[0] != '\0'; p++, s++) {
+        switch (p[0]) {
+        case '*':
+            if (p[1] == '*') {
+                p += 2;
+                if (p[0] == '/' && match_glob(p + 1, s)) {
+                    return true;
+                }
+                for (; s[0] != '\0'; s++) {
+                    if (match_glob(p, s)) {
+                        return true;
+                    }
+                }
+                return match_glob(p, s);
+            }
+            p++;
+            for (;; s++) {
+                if (match_glob(p, s)) {
+                    return true;
+                }
+                if (s[0] == '\0' || s[0] == '/') {
+                    return false;
+                }
+            }
+        case '?':
+            if (s[0] == '\0' || s[0] == '/') {
+                return false;
+            }
+            break;
+        case '[':
+            if (s[0] == '\0' || s[0] == '/') {
+                return false;
+            }
+            p++;
+            m = match_class(&p, s[0]);
+            if (m == -1) {
+                /* no closing ']', take the '[' literally */
+                p--;
+                if (s[0] != '[') {
+                    return false;
+                }
+            } else if (m == 0) {
+                return false;
+            }
+            break;
+        case '\\':
+            if (p[1] != '\0') {
+                p++;
+            }
+            /* fall through */
+        default:
+            if (p[0] != s[0]) {
+                return false;
+            }
+        }
+    }
+    return s[0] == '\0';
+}
+
+/**
+ * @brief Adds a rule to the list.
+ *
+ * @param ignore    The list to add to.
+ * @param pattern   The pattern, it is copied.
+ * @param len       The length of the pattern.
+ * @param flags     The flags of the rule (`IGNORE_*`).
+ */
+static void add_rule(struct ignore *ignore, const char *pattern, size_t len,
+        int flags)
+{
+    struct ignore_rule *rule;
+
+    if (strcspn(pattern, "*?[\\") >= len) {
+        flags |= IGNORE_LITERAL;
+    }
+    ignore->rules = sreallocarray(ignore->rules, ignore->num_rules + 1,
+            sizeof(*ignore->rules));
+    rule = &ignore->rules[ignore->num_rules++];
+    rule->pattern = smalloc(len + 1);
+    memcpy(rule->pattern, pattern, len);
+    rule->pattern[len] = '\0';
+    rule->flags = flags;
+    DLOG("ignore rule: '%s' with flags %d\n", rule->pattern, rule->flags);
+}
+
+void compile_ignore(struct ignore *ignore, char **patterns,
+        size_t num_patterns, const char *build)
+{
+    const char *p;
+    size_t len;
+    int flags;
+
+    ignore->rules = NULL;
+    ignore->num_rules = 0;
+    for (size_t i = 0; i < num_patterns; i++) {
+        p = patterns[i];
+        if (p[0] == '\0' || p[0] == '#') {
+            continue;
+        }
+        flags = 0;
+        if (p[0] == '!') {
+            flags |= IGNORE_NEGATE;
+            p++;
+        }
+        len = strlen(p);
+        if (len > 0 && p[len - 1] == '/') {
+            flags |= IGNORE_DIR_ONLY;
+            len--;
+        }
+        if (memchr(p, '/', len) != NULL) {
+            flags |= IGNORE_ANCHORED;
+            if (p[0] == '/') {
+                p++;
+                len--;
+            }
+        }
+        if (len == 0) {
+            continue;
+        }
+        add_rule(ignore, p, len, flags);
+    }
+
+    if (build != NULL) {
+        ignore_directory(ignore, build);
+    }
+}
+
+void ignore_directory(struct ignore *ignore, const char *build)
+{
+    size_t len;
+
+    /* the build directory is matched exactly like the collected paths */
+    while (build[0] == '.' && build[1] == '/') {
+        build += 2;
+        while (build[0] == '/') {
+            build++;
+        }
+    }
+    len = strlen(build);
+    while (len > 0 && build[len - 1] == '/') {
+        len--;
+    }
+    if (len == 0 || build[0] == '/' || (len == 1 && build[0] == '.') ||
+            (build[0] == '.' && build[1] == '.' &&
+             (len == 2 || build[2] == '/'))) {
+        /* the build directory is not below the current directory */
+        return;
+    }
+    add_rule(ignore, build, len,
+            IGNORE_DIR_ONLY | IGNORE_ANCHORED | IGNORE_LITERAL);
+}
+
+bool is_ignored(const struct ignore *ignore, const char *path,
+        const char *name, bool is_dir)
+{
+    const struct ignore_rule *rule;
+    const char *s;
+    size_t i;
+
+    /* the last matching rule decides */
+    for (i = ignore->num_rules; i > 0; i--) {
+        rule = &ignore->rules[i - 1];
+        if ((rule->flags & IGNORE_DIR_ONLY) && !is_dir) {
+            continue;
+        }
+        s = (rule->flags & IGNORE_ANCHORED) ? path : name;
+        if ((rule->flags & IGNORE_LITERAL) ? strcmp(rule->pattern, s) == 0 :
+                match_glob(rule->pattern, s)) {
+            return !(rule->flags & IGNORE_NEGATE);
+        }
+    }
+    return false;
+}
+
+void clear_ignore(struct ignore *ignore)
+{
+    for (size_t i = 0; i < ignore->num_rules; i++) {
+        free(ignore->rules[i].pattern);
+    }
+    free(ignore->rules);
+}
@@ -0,0 +1,89 @@
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// the rule re-includes what earlier rules excluded ('!' prefix)
+#define IGNORE_NEGATE 0x1
+/// the rule only matches directories (trailing '/')
+#define IGNORE_DIR_ONLY 0x2
+/// the rule is matched against the whole path, not just the name
+#define IGNORE_ANCHORED 0x4
+/// the pattern has no wildcards and is compared as is
+#define IGNORE_LITERAL 0x8
+
+/**
+ * A single compiled pattern.
+ */
+struct ignore_rule {
+    /// the pattern without '!', leading and trailing '/'
+    char *pattern;
+    /// flags of this rule (`IGNORE_*`)
+    int flags;
+};
+
+/**
+ * A list of compiled `.gitignore` style patterns.
+ */
+struct ignore {
+    /// all rules in the order they were given
+    struct ignore_rule *rules;
+    /// number of elements in `rules`
+    size_t num_rules;
+};
+
+/**
+ * @brief Compiles `.gitignore` style patterns.
+ *
+ * The rules are:
+ * - empty patterns and patterns starting with '#' are skipped
+ * - a leading '!' negates the pattern
+ * - a trailing '/' only matches directories
+ * - a pattern with a '/' in the beginning or middle is matched against the
+ *   path relative to the current directory, otherwise against the name only
+ * - '*' and '?' match anything but '/', "[...]" matches a character class
+ *   and "**" also matches '/'
+ *
+ * The last matching pattern decides. The build directory is always ignored
+ * and this can not be negated.
+ *
+ * @param ignore        Output of the compiled patterns.
+ * @param patterns      The patterns to compile.
+ * @param num_patterns  The number of patterns.
+ * @param build         The build directory, may be `NULL`.
+ */
+void compile_ignore(struct ignore *ignore, char **patterns,
+        size_t num_patterns, const char *build);
+
+/**
+ * @brief Adds a rule that ignores a directory and can not be negated.
+ *
+ * Nothing is added if the directory is not below the current directory.
+ *
+ * @param ignore    The compiled patterns, the rule is added at the end.
+ * @param build     The directory, like the build directory.
+ */
+void ignore_directory(struct ignore *ignore, const char *build);
+
+/**
+ * @brief Checks if a file or directory is ignored.
+ *
+ * This is safe to call from multiple threads at once.
+ *
+ * @param ignore    The compiled patterns.
+ * @param path      Path relative to the current directory.
+ * @param name      The last segment of `path`.
+ * @param is_dir    Whether the path is a directory.
+ *
+ * @return Whether the path should not be collected.
+ */
+bool is_ignored(const struct ignore *ignore, const char *path,
+        const char *name, bool is_dir);
+
+/**
+ * @brief Frees all resources of compiled patterns.
+ */
+void clear_ignore(struct ignore *ignore);
+
+#endif
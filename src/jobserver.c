@@ -0,0 +1,219 @@
+#include "args.h"
+#include "jobserver.h"
+#include "salloc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/// the byte autocar puts into its own jobserver
+#define TOKEN '+'
+
+static struct {
+    /// where tokens are taken from, -1 if there is no jobserver
+    int read_fd;
+    /// where tokens are given back to, -1 if there is no jobserver
+    int write_fd;
+    /// whether the descriptors were opened by autocar
+    bool owned;
+    /// whether autocar serves the jobserver
+    bool serving;
+    /// number of tokens autocar put into its own jobserver
+    long num_tokens;
+} Jobserver = {
+    .read_fd = -1,
+    .write_fd = -1,
+};
+
+/**
+ * @brief Finds the value of the last option with given name in `MAKEFLAGS`, a
+ * sub-make adds its own after those of its parent.
+ *
+ * @return The start of the value or `NULL` if the option is not there.
+ */
+static const char *find_flag(const char *flags, const char *name)
+{
+    const char *s, *value = NULL;
+    const size_t len = strlen(name);
+
+    for (s = flags; s = strstr(s, name), s != NULL; s += len) {
+        value = s + len;
+    }
+    return value;
+}
+
+/**
+ * @brief Connects to the jobserver given by make.
+ *
+ * @return 0 on success, 1 if make gave none and -1 if it can not be used.
+ */
+static int connect_jobserver(const char *flags)
+{
+    const char *auth;
+    size_t len;
+    char *path;
+    int fd;
+
+    auth = find_flag(flags, "--jobserver-auth=");
+    if (auth == NULL) {
+        /* make before 4.2 */
+        auth = find_flag(flags, "--jobserver-fds=");
+    }
+    if (auth == NULL) {
+        return 1;
+    }
+
+    if (strncmp(auth, "fifo:", 5) == 0) {
+        auth += 5;
+        len = strcspn(auth, " ");
+        path = sasprintf("%.*s", (int) len, auth);
+        /* a named pipe opened for reading and writing never blocks here */
+        fd = open(path, O_RDWR | O_CLOEXEC);
+        if (fd == -1) {
+            fprintf(stderr, "can not open jobserver '%s': %s\n", path,
+                    strerror(errno));
+            free(path);
+            return -1;
+        }
+        DLOG("using jobserver '%s'\n", path);
+        free(path);
+        Jobserver.read_fd = fd;
+        Jobserver.write_fd = fd;
+        Jobserver.owned = true;
+        return 0;
+    }
+
+    if (sscanf(auth, "%d,%d", &Jobserver.read_fd, &Jobserver.write_fd) != 2 ||
+            Jobserver.read_fd < 0 || Jobserver.write_fd < 0 ||
+            fcntl(Jobserver.read_fd, F_GETFD) == -1 ||
+            fcntl(Jobserver.write_fd, F_GETFD) == -1) {
+        /* make only passes them on to recipes marked with '+' */
+        fprintf(stderr, "the jobserver of make is not available, mark the "
+                "rule running autocar with '+'\n");
+        Jobserver.read_fd = -1;
+        Jobserver.write_fd = -1;
+        return -1;
+    }
+    DLOG("using jobserver %d,%d\n", Jobserver.read_fd, Jobserver.write_fd);
+    return 0;
+}
+
+/**
+ * @brief Creates the jobserver autocar serves, it starts out empty.
+ */
+static void create_jobserver(const char *flags)
+{
+    int fds[2];
+    char *new_flags;
+
+    /* the programs autocar starts must inherit it */
+    if (pipe(fds) == -1) {
+        LOG("pipe: %s\n", strerror(errno));
+        return;
+    }
+    if (flags == NULL || flags[0] == '\0') {
+        new_flags = sasprintf("-j --jobserver-auth=%d,%d", fds[0], fds[1]);
+    } else {
+        new_flags = sasprintf("%s -j --jobserver-auth=%d,%d", flags,
+                fds[0], fds[1]);
+    }
+    setenv("MAKEFLAGS", new_flags, 1);
+    free(new_flags);
+    Jobserver.read_fd = fds[0];
+    Jobserver.write_fd = fds[1];
+    Jobserver.owned = true;
+    Jobserver.serving = true;
+}
+
+void start_jobserver(void)
+{
+    const char *flags;
+
+    flags = getenv("MAKEFLAGS");
+    if (flags == NULL || connect_jobserver(flags) == 1) {
+        create_jobserver(flags);
+    }
+}
+
+void fill_jobserver(long num)
+{
+    const char token = TOKEN;
+
+    if (!Jobserver.serving) {
+        return;
+    }
+    for (; Jobserver.num_tokens < num - 1; Jobserver.num_tokens++) {
+        if (write(Jobserver.write_fd, &token, 1) != 1) {
+            LOG("could not fill jobserver: %s\n", strerror(errno));
+            break;
+        }
+    }
+}
+
+int take_token(void)
+{
+    unsigned char token;
+    struct pollfd pfd;
+    ssize_t n;
+
+    if (Jobserver.read_fd == -1) {
+        return -1;
+    }
+    for (;;) {
+        n = read(Jobserver.read_fd, &token, 1);
+        if (n == 1) {
+            return token;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && errno == EAGAIN) {
+            /* make may have made the descriptor it shares non blocking, other
+             * processes may also take the token before this one reads it */
+            pfd.fd = Jobserver.read_fd;
+            pfd.events = POLLIN;
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        LOG("could not take a token from the jobserver: %s\n",
+                n == 0 ? "it was closed" : strerror(errno));
+        return -1;
+    }
+}
+
+void give_token(int token)
+{
+    const unsigned char c = token;
+    ssize_t n;
+
+    if (token == -1) {
+        return;
+    }
+    do {
+        n = write(Jobserver.write_fd, &c, 1);
+    } while (n == -1 && errno == EINTR);
+    if (n != 1) {
+        LOG("could not give a token back to the jobserver: %s\n",
+                strerror(errno));
+    }
+}
+
+void stop_jobserver(void)
+{
+    if (Jobserver.owned) {
+        close(Jobserver.read_fd);
+        if (Jobserver.write_fd != Jobserver.read_fd) {
+            close(Jobserver.write_fd);
+        }
+    }
+    Jobserver.read_fd = -1;
+    Jobserver.write_fd = -1;
+    Jobserver.owned = false;
+    Jobserver.serving = false;
+    Jobserver.num_tokens = 0;
+}
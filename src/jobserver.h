@@ -0,0 +1,56 @@
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+/*
+ * The jobserver of GNU make limits how many jobs a tree of processes runs at
+ * once. It is a pipe (or named pipe) with a byte in it for each job that may run
+ * besides the one every process may always run. A process takes a byte before
+ * it starts another job and puts it back when the job is done. The pipe is
+ * given in `MAKEFLAGS` as "--jobserver-auth=R,W" (the descriptors) or
+ * "--jobserver-auth=fifo:PATH".
+ *
+ * When autocar runs under `make -j`, it takes from the jobserver of make.
+ * Otherwise it serves its own, so sub-makes and things like
+ * `gcc -flto=jobserver` it starts share `JOBS` with its compilers.
+ */
+
+/**
+ * @brief Connects to the jobserver in `MAKEFLAGS` or creates one and adds it to
+ * `MAKEFLAGS`.
+ *
+ * This must happen before autocar starts any program, those started before do
+ * not know the jobserver.
+ */
+void start_jobserver(void);
+
+/**
+ * @brief Makes sure the jobserver autocar serves lets `num` jobs run at once.
+ *
+ * The jobserver of make is never changed. There are never fewer jobs allowed
+ * than before.
+ *
+ * @param num   The number of jobs, including the one that needs no token.
+ */
+void fill_jobserver(long num);
+
+/**
+ * @brief Takes a token from the jobserver, waiting until there is one.
+ *
+ * @return The token, to be given back with `give_token()`, or -1 if there is
+ *         no jobserver (the job may then run without one).
+ */
+int take_token(void);
+
+/**
+ * @brief Gives a token back to the jobserver.
+ *
+ * @param token The token from `take_token()`, nothing happens for -1.
+ */
+void give_token(int token);
+
+/**
+ * @brief Closes the jobserver.
+ */
+void stop_jobserver(void);
+
+#endif
@@ -1,7 +1,15 @@
 #include "args.h"
+#include "cmd.h"
+#include "compdb.h"
 #include "conf.h"
+#include "daemon.h"
 #include "file.h"
+#include "jobserver.h"
+#include "memo.h"
 #include "cli.h"
+#include "meta.h"
+#include "schedule.h"
+#include "util.h"
 
 #include <bfd.h>
 #include <unistd.h>
@@ -9,8 +17,10 @@
 
 int main(int argc, char **argv)
 {
-    char *conf;
-    struct file *file;
+    char *conf = NULL;
+    char *daemon_path = NULL;
+    int server = -1;
+    int result;
 
     if (!parse_args(argc, argv)) {
         return 1;
@@ -29,6 +39,23 @@ int main(int argc, char **argv)
         }
     }
 
+    /* a client skips everything a daemon already did */
+    if (Args.send != NULL) {
+        if (!Args.no_config) {
+            conf = Args.config == NULL ? "autocar.conf" : Args.config;
+            if (!find_autocar_conf(conf)) {
+                return 1;
+            }
+        }
+        daemon_path = get_daemon_path(conf);
+        result = send_to_daemon(daemon_path, Args.send);
+        free(daemon_path);
+        return result == -1 ? 2 : result;
+    }
+
+    /* before the config, it may start programs already */
+    start_jobserver();
+
     set_default_conf();
 
     if (!Args.no_config) {
@@ -41,21 +68,41 @@ int main(int argc, char **argv)
         }
     }
 
+    if (Args.daemon) {
+        daemon_path = get_daemon_path(conf);
+        server = open_daemon(daemon_path);
+        if (server == -1) {
+            free(daemon_path);
+            return 1;
+        }
+    }
+
     LOG("up and running\n");
 
     pthread_mutex_init(&Files.lock, NULL);
 
-    if (Args.interval > 0) {
+    /* set before the cli thread starts, it checks this flag right away and
+     * with an interval of 0, it makes sure there is a single iteration */
+    CliRunning = true;
+    if (Args.interval > 0 && !Args.daemon) {
         run_cli();
     }
 
     while (CliRunning) {
         if (!CliWantsPause) {
+            /* the cli may check the config at the same time and replace the
+             * variants */
+            pthread_mutex_lock(&Files.lock);
             if (check_conf() != 0) {
-                usleep(1000 * 1000);
+                pthread_mutex_unlock(&Files.lock);
+                if (Args.daemon) {
+                    /* a client may fix the config */
+                    serve_daemon(server, 1000 * 1000);
+                } else {
+                    usleep(1000 * 1000);
+                }
                 continue;
             }
-            pthread_mutex_lock(&Files.lock);
             if (collect_files() != 0) {
                 DLOG("0: did not reach the end\n");
             } else if (!build_objects()) {
@@ -67,20 +114,33 @@ int main(int argc, char **argv)
             }
             pthread_mutex_unlock(&Files.lock);
         }
-        if (Args.interval == 0) {
+        if (Args.daemon) {
+            /* without an interval, only clients make it do anything */
+            do {
+                serve_daemon(server, Args.interval == 0 ? -1 : Args.interval);
+            } while (Args.interval == 0 && CliRunning);
+        } else if (Args.interval == 0) {
             break;
+        } else {
+            usleep(Args.interval);
         }
-        usleep(Args.interval);
     }
 
-    /* free resources */
-    for (size_t i = 0; i < Files.num; i++) {
-        file = Files.ptr[i];
-        free(file->path);
-        free(file);
+    if (Args.daemon) {
+        close_daemon(server, daemon_path);
+        free(daemon_path);
     }
-    free(Files.ptr);
 
+    /* free resources */
+    clear_compdb();
+    clear_schedule();
+    clear_files();
+    clear_stat_batch();
+    forget_directories();
+
+    clear_eval();
+    clear_memo();
     clear_conf();
+    stop_jobserver();
     return 0;
 }
@@ -0,0 +1,285 @@
+#include "args.h"
+#include "conf.h"
+#include "memo.h"
+#include "salloc.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+/// first line of `MEMO_PATH`
+#define MEMO_HEADER "autocar memo 1"
+
+/// all stored outputs
+static struct memo_list {
+    struct memo *ptr;
+    size_t num;
+    /// whether `MEMO_PATH` was read
+    bool loaded;
+} Memos;
+
+static void free_memo(struct memo *memo)
+{
+    free(memo->cmd);
+    for (size_t i = 0; i < memo->num_files; i++) {
+        free(memo->files[i].path);
+    }
+    free(memo->files);
+    for (size_t i = 0; i < memo->num_values; i++) {
+        free(memo->values[i]);
+    }
+    free(memo->values);
+}
+
+/**
+ * @brief Gets the modification time of a file, 0 if it does not exist.
+ */
+static struct timespec get_mtime(const char *path)
+{
+    struct stat st;
+    struct timespec none = { 0, 0 };
+
+    if (stat(path, &st) == -1) {
+        return none;
+    }
+    return st.st_mtim;
+}
+
+/**
+ * @brief Reads a line and removes the new line character.
+ *
+ * @return The length of the line or -1 at the end.
+ */
+static ssize_t read_memo_line(FILE *fp, char **pline, size_t *pa)
+{
+    ssize_t len;
+
+    len = getline(pline, pa, fp);
+    if (len <= 0 || (*pline)[len - 1] != '\n') {
+        return -1;
+    }
+    (*pline)[--len] = '\0';
+    return len;
+}
+
+/**
+ * @brief Reads all outputs in `MEMO_PATH`.
+ *
+ * The file is written by autocar only, the first entry that is malformed ends
+ * reading it.
+ *
+ * Format:
+ * - `MEMO_HEADER`
+ * - for each output: "<expires> <number of files> <number of values> <command>"
+ *   followed by "<seconds> <nanoseconds> <path>" for each file and a line
+ *   for each value
+ */
+static void load_memos(void)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t a = 0;
+    struct memo memo;
+    long long expires;
+    size_t num_files, num_values;
+    long long sec;
+    long nsec;
+    int n;
+
+    Memos.loaded = true;
+    fp = fopen(MEMO_PATH, "r");
+    if (fp == NULL) {
+        return;
+    }
+    if (read_memo_line(fp, &line, &a) == -1 || strcmp(line, MEMO_HEADER) != 0) {
+        LOG("'%s' has an unknown format, it is replaced\n", MEMO_PATH);
+        goto end;
+    }
+    while (read_memo_line(fp, &line, &a) != -1) {
+        if (sscanf(line, "%lld %zu %zu %n", &expires, &num_files,
+                    &num_values, &n) != 3) {
+            goto malformed;
+        }
+        memset(&memo, 0, sizeof(memo));
+        memo.cmd = sstrdup(&line[n]);
+        memo.expires = expires;
+        memo.files = sreallocarray(NULL, num_files, sizeof(*memo.files));
+        for (; memo.num_files < num_files; memo.num_files++) {
+            if (read_memo_line(fp, &line, &a) == -1 ||
+                    sscanf(line, "%lld %ld %n", &sec, &nsec, &n) != 2) {
+                free_memo(&memo);
+                goto malformed;
+            }
+            memo.files[memo.num_files].path = sstrdup(&line[n]);
+            memo.files[memo.num_files].mtime.tv_sec = sec;
+            memo.files[memo.num_files].mtime.tv_nsec = nsec;
+        }
+        memo.values = sreallocarray(NULL, num_values, sizeof(*memo.values));
+        for (; memo.num_values < num_values; memo.num_values++) {
+            if (read_memo_line(fp, &line, &a) == -1) {
+                free_memo(&memo);
+                goto malformed;
+            }
+            memo.values[memo.num_values] = sstrdup(line);
+        }
+        Memos.ptr = sreallocarray(Memos.ptr, Memos.num + 1,
+                sizeof(*Memos.ptr));
+        Memos.ptr[Memos.num++] = memo;
+    }
+    goto end;
+
+malformed:
+    LOG("'%s' is malformed, only the first %zu outputs are used\n",
+            MEMO_PATH, Memos.num);
+
+end:
+    fclose(fp);
+    free(line);
+}
+
+/**
+ * @brief Writes all outputs to `MEMO_PATH` (see `load_memos()`).
+ */
+static void save_memos(void)
+{
+    FILE *fp;
+    char *tmp;
+    const struct memo *memo;
+
+    /* write and rename so a parallel autocar never reads half a file */
+    tmp = sasprintf("%s.tmp", MEMO_PATH);
+    fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        LOG("could not open '%s': %s\n", tmp, strerror(errno));
+        free(tmp);
+        return;
+    }
+    fputs(MEMO_HEADER "\n", fp);
+    for (size_t i = 0; i < Memos.num; i++) {
+        memo = &Memos.ptr[i];
+        fprintf(fp, "%lld %zu %zu %s\n", (long long) memo->expires,
+                memo->num_files, memo->num_values, memo->cmd);
+        for (size_t f = 0; f < memo->num_files; f++) {
+            fprintf(fp, "%lld %ld %s\n",
+                    (long long) memo->files[f].mtime.tv_sec,
+                    memo->files[f].mtime.tv_nsec, memo->files[f].path);
+        }
+        for (size_t v = 0; v < memo->num_values; v++) {
+            fprintf(fp, "%s\n", memo->values[v]);
+        }
+    }
+    if (fclose(fp) != 0 || rename(tmp, MEMO_PATH) != 0) {
+        LOG("could not write '%s': %s\n", MEMO_PATH, strerror(errno));
+        unlink(tmp);
+    }
+    free(tmp);
+}
+
+const struct memo *get_memo(const char *cmd)
+{
+    struct memo *memo;
+    struct timespec mtime;
+
+    if (!Memos.loaded) {
+        load_memos();
+    }
+    for (size_t i = 0; i < Memos.num; i++) {
+        memo = &Memos.ptr[i];
+        if (strcmp(memo->cmd, cmd) != 0) {
+            continue;
+        }
+        if (memo->expires != 0 && time(NULL) >= memo->expires) {
+            DLOG("memoized output of '%s' expired\n", cmd);
+            return NULL;
+        }
+        for (size_t f = 0; f < memo->num_files; f++) {
+            mtime = get_mtime(memo->files[f].path);
+            if (mtime.tv_sec != memo->files[f].mtime.tv_sec ||
+                    mtime.tv_nsec != memo->files[f].mtime.tv_nsec) {
+                DLOG("'%s' changed, running '%s' again\n",
+                        memo->files[f].path, cmd);
+                return NULL;
+            }
+        }
+        return memo;
+    }
+    return NULL;
+}
+
+void put_memo(const char *cmd, char **values, size_t num_values)
+{
+    struct config_entry *ttl_entry, *files_entry;
+    struct memo memo;
+    long ttl = 0;
+    char *end;
+    size_t index;
+
+    files_entry = get_conf("memo_files", NULL);
+    /* a new line would break the format, such outputs are never stored */
+    if (strchr(cmd, '\n') != NULL) {
+        return;
+    }
+    for (size_t i = 0; files_entry != NULL && i < files_entry->num_values;
+            i++) {
+        if (strchr(files_entry->values[i], '\n') != NULL) {
+            return;
+        }
+    }
+
+    ttl_entry = get_conf("memo_ttl", NULL);
+    if (ttl_entry != NULL && ttl_entry->num_values == 1) {
+        ttl = strtol(ttl_entry->values[0], &end, 10);
+        if (end == ttl_entry->values[0] || end[0] != '\0' || ttl < 0) {
+            LOG("'MEMO_TTL' must be a number of seconds\n");
+            ttl = 0;
+        }
+    }
+
+    memo.cmd = sstrdup(cmd);
+    memo.expires = ttl == 0 ? 0 : time(NULL) + ttl;
+    memo.num_files = files_entry == NULL ? 0 : files_entry->num_values;
+    memo.files = sreallocarray(NULL, memo.num_files, sizeof(*memo.files));
+    for (size_t i = 0; i < memo.num_files; i++) {
+        memo.files[i].path = sstrdup(files_entry->values[i]);
+        memo.files[i].mtime = get_mtime(memo.files[i].path);
+    }
+    memo.num_values = num_values;
+    memo.values = sreallocarray(NULL, num_values, sizeof(*memo.values));
+    for (size_t i = 0; i < num_values; i++) {
+        memo.values[i] = sstrdup(values[i]);
+    }
+
+    if (!Memos.loaded) {
+        load_memos();
+    }
+    for (index = 0; index < Memos.num; index++) {
+        if (strcmp(Memos.ptr[index].cmd, cmd) == 0) {
+            break;
+        }
+    }
+    if (index == Memos.num) {
+        Memos.ptr = sreallocarray(Memos.ptr, Memos.num + 1,
+                sizeof(*Memos.ptr));
+        Memos.num++;
+    } else {
+        free_memo(&Memos.ptr[index]);
+    }
+    Memos.ptr[index] = memo;
+    save_memos();
+}
+
+void clear_memo(void)
+{
+    for (size_t i = 0; i < Memos.num; i++) {
+        free_memo(&Memos.ptr[i]);
+    }
+    free(Memos.ptr);
+    Memos.ptr = NULL;
+    Memos.num = 0;
+    Memos.loaded = false;
+}
@@ -0,0 +1,64 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stddef.h>
+#include <time.h>
+
+/// file in the project directory the memoized outputs are kept in
+#define MEMO_PATH ".autocar.memo"
+
+/**
+ * A file the output of a memoized command depends on.
+ */
+struct memo_file {
+    char *path;
+    /// modification time when the output was stored, 0 if it did not exist
+    struct timespec mtime;
+};
+
+/**
+ * The output of a command run by `NAME ::= <shell>`.
+ */
+struct memo {
+    /// the command as it is passed to the shell
+    char *cmd;
+    /// time after which the command must run again, 0 for never
+    time_t expires;
+    /// files that make the command run again when they change
+    struct memo_file *files;
+    size_t num_files;
+    /// the words the command printed
+    char **values;
+    size_t num_values;
+};
+
+/**
+ * @brief Looks up the output of a command.
+ *
+ * The stored outputs are read from `MEMO_PATH` the first time.
+ *
+ * @param cmd   The command.
+ *
+ * @return The output or `NULL` if there is none or it is outdated.
+ */
+const struct memo *get_memo(const char *cmd);
+
+/**
+ * @brief Stores the output of a command and writes all outputs to
+ * `MEMO_PATH`, only call it if the command succeeded.
+ *
+ * It is valid for `MEMO_TTL` seconds (forever if not set) and as long as none
+ * of the files in `MEMO_FILES` change.
+ *
+ * @param cmd           The command.
+ * @param values        The words it printed.
+ * @param num_values    The number of words.
+ */
+void put_memo(const char *cmd, char **values, size_t num_values);
+
+/**
+ * @brief Frees all outputs in memory.
+ */
+void clear_memo(void);
+
+#endif
@@ -0,0 +1,303 @@
+#include "args.h"
+#include "meta.h"
+#include "salloc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define HAS_IO_URING 1
+#else
+#define HAS_IO_URING 0
+#endif
+
+/// the fields of `statx` that are needed
+#define STATX_NEEDED (STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | \
+        STATX_MTIME)
+
+/// batches smaller than this are not worth the round trip through io_uring
+#define IO_URING_MIN_BATCH 64
+
+/// number of entries in the submission queue
+#define IO_URING_ENTRIES 256
+
+/**
+ * @brief Copies the needed values from `stx` to `st`.
+ */
+static void statx_to_stat(const struct statx *stx, struct stat *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->st_mode = stx->stx_mode;
+    st->st_ino = stx->stx_ino;
+    st->st_size = stx->stx_size;
+    st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+}
+
+static void stat_one(struct stat_request *req)
+{
+    struct statx stx;
+
+    if (statx(req->dir_fd, req->name, 0, STATX_NEEDED, &stx) == -1) {
+        req->error = errno;
+        return;
+    }
+    req->error = 0;
+    statx_to_stat(&stx, &req->st);
+}
+
+#if HAS_IO_URING
+
+/**
+ * The io_uring instance, it is set up on first use and kept for the entire
+ * run.
+ */
+static struct ring {
+    /// -1 if not tried yet, -2 if io_uring is not available
+    int fd;
+
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned num_sq;
+    struct io_uring_sqe *sqes;
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    size_t sqes_size;
+
+    /// output buffers for the kernel, one for each submission queue entry
+    struct statx *stx;
+} Ring = { .fd = -1 };
+
+static void close_ring(void)
+{
+    if (Ring.sqes != NULL) {
+        munmap(Ring.sqes, Ring.sqes_size);
+    }
+    if (Ring.cq_ptr != NULL && Ring.cq_ptr != Ring.sq_ptr) {
+        munmap(Ring.cq_ptr, Ring.cq_size);
+    }
+    if (Ring.sq_ptr != NULL) {
+        munmap(Ring.sq_ptr, Ring.sq_size);
+    }
+    if (Ring.fd >= 0) {
+        close(Ring.fd);
+    }
+    free(Ring.stx);
+    memset(&Ring, 0, sizeof(Ring));
+    Ring.fd = -2;
+}
+
+/**
+ * @brief Disables io_uring while requests may still be in flight.
+ *
+ * The kernel may still write into the buffers, so the ring and the buffers are
+ * never given back or used again.
+ */
+static void abandon_ring(void)
+{
+    memset(&Ring, 0, sizeof(Ring));
+    Ring.fd = -2;
+}
+
+/**
+ * @brief Sets up the io_uring instance and maps all rings.
+ *
+ * @return Whether io_uring can be used.
+ */
+static bool setup_ring(void)
+{
+    struct io_uring_params p;
+    char *sq, *cq;
+
+    if (Ring.fd != -1) {
+        return Ring.fd >= 0;
+    }
+
+    memset(&p, 0, sizeof(p));
+    Ring.fd = syscall(__NR_io_uring_setup, IO_URING_ENTRIES, &p);
+    if (Ring.fd < 0) {
+        DLOG("io_uring_setup: %s\n", strerror(errno));
+        Ring.fd = -2;
+        return false;
+    }
+
+    Ring.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    Ring.cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (Ring.cq_size > Ring.sq_size) {
+            Ring.sq_size = Ring.cq_size;
+        }
+        Ring.cq_size = Ring.sq_size;
+    }
+
+    Ring.sq_ptr = mmap(NULL, Ring.sq_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, Ring.fd, IORING_OFF_SQ_RING);
+    if (Ring.sq_ptr == MAP_FAILED) {
+        Ring.sq_ptr = NULL;
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        Ring.cq_ptr = Ring.sq_ptr;
+    } else {
+        Ring.cq_ptr = mmap(NULL, Ring.cq_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, Ring.fd, IORING_OFF_CQ_RING);
+        if (Ring.cq_ptr == MAP_FAILED) {
+            Ring.cq_ptr = NULL;
+            goto fail;
+        }
+    }
+    Ring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    Ring.sqes = mmap(NULL, Ring.sqes_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, Ring.fd, IORING_OFF_SQES);
+    if (Ring.sqes == MAP_FAILED) {
+        Ring.sqes = NULL;
+        goto fail;
+    }
+
+    sq = Ring.sq_ptr;
+    Ring.sq_tail = (unsigned*) (sq + p.sq_off.tail);
+    Ring.sq_mask = (unsigned*) (sq + p.sq_off.ring_mask);
+    Ring.sq_array = (unsigned*) (sq + p.sq_off.array);
+    Ring.num_sq = p.sq_entries;
+
+    cq = Ring.cq_ptr;
+    Ring.cq_head = (unsigned*) (cq + p.cq_off.head);
+    Ring.cq_tail = (unsigned*) (cq + p.cq_off.tail);
+    Ring.cq_mask = (unsigned*) (cq + p.cq_off.ring_mask);
+    Ring.cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+
+    Ring.stx = sreallocarray(NULL, Ring.num_sq, sizeof(*Ring.stx));
+    return true;
+
+fail:
+    DLOG("mmap io_uring: %s\n", strerror(errno));
+    close_ring();
+    return false;
+}
+
+/**
+ * @brief Submits up to `Ring.num_sq` requests and waits for all of them.
+ *
+ * @return Whether the requests were handled, if not, io_uring is disabled and
+ * the caller should fall back to `stat_one()`.
+ */
+static bool submit_ring(struct stat_request *reqs, unsigned num_reqs)
+{
+    unsigned tail, index;
+    unsigned head;
+    unsigned done = 0;
+    unsigned submitted = 0;
+    long r;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    bool unsupported = false;
+
+    tail = *Ring.sq_tail;
+    for (unsigned i = 0; i < num_reqs; i++) {
+        index = tail & *Ring.sq_mask;
+        sqe = &Ring.sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = reqs[i].dir_fd;
+        sqe->addr = (unsigned long) reqs[i].name;
+        sqe->len = STATX_NEEDED;
+        sqe->off = (unsigned long) &Ring.stx[i];
+        sqe->user_data = i;
+        Ring.sq_array[index] = index;
+        tail++;
+    }
+    __atomic_store_n(Ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+    while (done < num_reqs) {
+        head = *Ring.cq_head;
+        if (head == __atomic_load_n(Ring.cq_tail, __ATOMIC_ACQUIRE)) {
+            r = syscall(__NR_io_uring_enter, Ring.fd, num_reqs - submitted,
+                    num_reqs - done, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (r < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                DLOG("io_uring_enter: %s\n", strerror(errno));
+                if (submitted > 0) {
+                    abandon_ring();
+                } else {
+                    close_ring();
+                }
+                return false;
+            }
+            submitted += r;
+            continue;
+        }
+        cqe = &Ring.cqes[head & *Ring.cq_mask];
+        index = cqe->user_data;
+        if (cqe->res < 0) {
+            reqs[index].error = -cqe->res;
+            if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) {
+                unsupported = true;
+            }
+        } else {
+            reqs[index].error = 0;
+            statx_to_stat(&Ring.stx[index], &reqs[index].st);
+        }
+        __atomic_store_n(Ring.cq_head, head + 1, __ATOMIC_RELEASE);
+        done++;
+    }
+
+    if (unsupported) {
+        /* the kernel does not know about IORING_OP_STATX */
+        DLOG("io_uring does not support statx\n");
+        close_ring();
+        return false;
+    }
+    return true;
+}
+
+#endif
+
+void stat_batch(struct stat_request *reqs, size_t num_reqs, bool use_io_uring)
+{
+    size_t i = 0;
+
+#if HAS_IO_URING
+    unsigned n;
+
+    if (use_io_uring && num_reqs >= IO_URING_MIN_BATCH && setup_ring()) {
+        for (; i < num_reqs; i += n) {
+            n = num_reqs - i < Ring.num_sq ? num_reqs - i : Ring.num_sq;
+            if (!submit_ring(&reqs[i], n)) {
+                break;
+            }
+        }
+    }
+#else
+    (void) use_io_uring;
+#endif
+
+    for (; i < num_reqs; i++) {
+        stat_one(&reqs[i]);
+    }
+}
+
+void clear_stat_batch(void)
+{
+#if HAS_IO_URING
+    if (Ring.fd >= 0) {
+        close_ring();
+    }
+#endif
+}
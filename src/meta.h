@@ -0,0 +1,46 @@
+#ifndef META_H
+#define META_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sys/stat.h>
+
+/**
+ * A single request for `stat_batch()`.
+ */
+struct stat_request {
+    /// directory the name is relative to, may be `AT_FDCWD`
+    int dir_fd;
+    /// name of the file within the directory
+    const char *name;
+    /// 0 on success, otherwise the error number
+    int error;
+    /// the result, only `st_mode`, `st_ino`, `st_size` and `st_mtim` are set
+    struct stat st;
+};
+
+/**
+ * @brief Stats all given requests.
+ *
+ * Each file is stat'ed relative to its directory file descriptor with `statx()`
+ * only asking for the fields autocar needs. If `use_io_uring` is set, large
+ * batches are submitted all at once through io_uring if the kernel supports
+ * it, otherwise they are stat'ed one after another.
+ *
+ * The kernel hands io_uring stat requests to worker threads, this pays off
+ * when the inodes are not cached yet (or on network file systems) and there
+ * are multiple cores, on a warm cache a plain loop is faster.
+ *
+ * @param reqs          The requests to fill out.
+ * @param num_reqs      The number of requests.
+ * @param use_io_uring  Whether io_uring should be tried.
+ */
+void stat_batch(struct stat_request *reqs, size_t num_reqs, bool use_io_uring);
+
+/**
+ * @brief Frees the resources used by `stat_batch()`.
+ */
+void clear_stat_batch(void);
+
+#endif
@@ -0,0 +1,41 @@
+#include "pressure.h"
+
+#include <stdio.h>
+
+double get_pressure(const char *resource)
+{
+    char path[64];
+    FILE *fp;
+    double avg10;
+
+    snprintf(path, sizeof(path), "/proc/pressure/%s", resource);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    /* the first line is "some avg10=0.00 avg60=0.00 avg300=0.00 total=0" */
+    if (fscanf(fp, "some avg10=%lf", &avg10) != 1) {
+        avg10 = -1;
+    }
+    fclose(fp);
+    return avg10;
+}
+
+long get_available_memory(void)
+{
+    FILE *fp;
+    char line[128];
+    long kb = -1;
+
+    fp = fopen("/proc/meminfo", "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "MemAvailable: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(fp);
+    return kb;
+}
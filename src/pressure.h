@@ -0,0 +1,22 @@
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+/**
+ * @brief Gets the share of time some tasks were stalled on a resource over the
+ * last 10 seconds ("some avg10" in /proc/pressure).
+ *
+ * @param resource  "cpu", "memory" or "io".
+ *
+ * @return The percentage or -1 if the kernel does not report it.
+ */
+double get_pressure(const char *resource);
+
+/**
+ * @brief Gets the memory that can be used without swapping ("MemAvailable" in
+ * /proc/meminfo).
+ *
+ * @return The kilobytes or -1 if they are not known.
+ */
+long get_available_memory(void);
+
+#endif
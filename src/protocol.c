@@ -0,0 +1,208 @@
+#include "args.h"
+#include "protocol.h"
+#include "salloc.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+int write_all(int fd, const void *data, size_t size)
+{
+    const char *p = data;
+    ssize_t n;
+
+    while (size > 0) {
+        n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n == -1 && errno == ENOTSOCK) {
+            n = write(fd, p, size);
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int read_all(int fd, void *data, size_t size)
+{
+    char *p = data;
+    ssize_t n;
+
+    while (size > 0) {
+        n = read(fd, p, size);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int write_u32(int fd, uint32_t u)
+{
+    u = htobe32(u);
+    return write_all(fd, &u, sizeof(u));
+}
+
+int read_u32(int fd, uint32_t *pu)
+{
+    if (read_all(fd, pu, sizeof(*pu)) == -1) {
+        return -1;
+    }
+    *pu = be32toh(*pu);
+    return 0;
+}
+
+int write_blob(int fd, const void *data, size_t size)
+{
+    uint64_t s;
+
+    s = htobe64(size);
+    if (write_all(fd, &s, sizeof(s)) == -1) {
+        return -1;
+    }
+    return write_all(fd, data, size);
+}
+
+int read_blob(int fd, char **pdata, size_t *psize)
+{
+    uint64_t s;
+    char *data;
+
+    if (read_all(fd, &s, sizeof(s)) == -1) {
+        return -1;
+    }
+    s = be64toh(s);
+    if (s > PROTOCOL_MAX_BLOB) {
+        errno = EPROTO;
+        return -1;
+    }
+    data = smalloc(s + 1);
+    if (read_all(fd, data, s) == -1) {
+        free(data);
+        return -1;
+    }
+    data[s] = '\0';
+    *pdata = data;
+    *psize = s;
+    return 0;
+}
+
+int read_file(const char *path, char **pdata, size_t *psize)
+{
+    int fd;
+    struct stat st;
+    char *data;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    data = smalloc(st.st_size + 1);
+    if (read_all(fd, data, st.st_size) == -1) {
+        free(data);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    data[st.st_size] = '\0';
+    *pdata = data;
+    *psize = st.st_size;
+    return 0;
+}
+
+int connect_to(const char *host, const char *port)
+{
+    struct addrinfo hints, *infos, *info;
+    int err;
+    int fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    err = getaddrinfo(host, port, &hints, &infos);
+    if (err != 0) {
+        LOG("getaddrinfo(%s): %s\n", host, gai_strerror(err));
+        return -1;
+    }
+    for (info = infos; info != NULL; info = info->ai_next) {
+        fd = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC,
+                info->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        if (connect(fd, info->ai_addr, info->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(infos);
+    if (fd == -1) {
+        LOG("could not connect to '%s:%s': %s\n", host, port, strerror(errno));
+    }
+    return fd;
+}
+
+int listen_on(const char *address, const char *port)
+{
+    struct addrinfo hints, *infos, *info;
+    int err;
+    int fd = -1;
+    int one = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    err = getaddrinfo(address, port, &hints, &infos);
+    if (err != 0) {
+        fprintf(stderr, "getaddrinfo(%s): %s\n", address, gai_strerror(err));
+        return -1;
+    }
+    for (info = infos; info != NULL; info = info->ai_next) {
+        fd = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC,
+                info->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, info->ai_addr, info->ai_addrlen) == 0 &&
+                listen(fd, 64) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(infos);
+    if (fd == -1) {
+        fprintf(stderr, "could not listen on '%s:%s': %s\n", address, port,
+                strerror(errno));
+    }
+    return fd;
+}
@@ -0,0 +1,112 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * The protocol between autocar and a compile worker (see worker.c), all
+ * numbers are big endian and every connection carries a single job.
+ *
+ * Request:
+ * - magic (u32, `PROTOCOL_MAGIC`)
+ * - number of arguments (u32)
+ * - each argument as blob, the first one is the compiler, "-c <input> -o
+ *   <output>" is added by the worker
+ * - the preprocessed source as blob
+ *
+ * Response:
+ * - exit status of the compiler (u32)
+ * - everything the compiler printed as blob
+ * - the object as blob, empty if compiling failed
+ *
+ * A blob is its size (u64) followed by the bytes.
+ */
+
+/// first four bytes of every request ("ACW1")
+#define PROTOCOL_MAGIC 0x41435731
+
+/// port a worker listens on by default
+#define PROTOCOL_PORT 7543
+
+/// maximum number of arguments in a request
+#define PROTOCOL_MAX_ARGS 4096
+
+/// maximum size of a blob, larger ones are treated as corrupt
+#define PROTOCOL_MAX_BLOB ((uint64_t) 1 << 32)
+
+/**
+ * @brief Writes all bytes to a socket or file.
+ *
+ * Writing to a closed socket fails with `EPIPE` instead of raising `SIGPIPE`.
+ *
+ * @return 0 on success, -1 on failure (see `errno`).
+ */
+int write_all(int fd, const void *data, size_t size);
+
+/**
+ * @brief Reads exactly given number of bytes.
+ *
+ * @return 0 on success, -1 on failure or if the end was reached before.
+ */
+int read_all(int fd, void *data, size_t size);
+
+/**
+ * @brief Writes a number in big endian.
+ */
+int write_u32(int fd, uint32_t u);
+
+/**
+ * @brief Reads a number in big endian.
+ */
+int read_u32(int fd, uint32_t *pu);
+
+/**
+ * @brief Writes the size of some data followed by the data.
+ */
+int write_blob(int fd, const void *data, size_t size);
+
+/**
+ * @brief Reads data written by `write_blob()`.
+ *
+ * @param fd        The file to read from.
+ * @param pdata     Output of the data, it is followed by a null terminator and
+ *                  must be freed.
+ * @param psize     Output of the size of the data.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int read_blob(int fd, char **pdata, size_t *psize);
+
+/**
+ * @brief Reads an entire file into memory.
+ *
+ * @param path      Path of the file.
+ * @param pdata     Output of the data, it must be freed.
+ * @param psize     Output of the size of the data.
+ *
+ * @return 0 on success, -1 on failure (see `errno`).
+ */
+int read_file(const char *path, char **pdata, size_t *psize);
+
+/**
+ * @brief Opens a TCP connection.
+ *
+ * @param host  Host name or address.
+ * @param port  Port or service name.
+ *
+ * @return The socket or -1 on failure.
+ */
+int connect_to(const char *host, const char *port);
+
+/**
+ * @brief Opens a TCP socket to accept connections on.
+ *
+ * @param address   Address to listen on.
+ * @param port      Port or service name.
+ *
+ * @return The socket or -1 on failure, errors are printed to `stderr`.
+ */
+int listen_on(const char *address, const char *port);
+
+#endif
@@ -0,0 +1,1126 @@
+#include "args.h"
+#include "cache.h"
+#include "conf.h"
+#include "jobserver.h"
+#include "macros.h"
+#include "pressure.h"
+#include "protocol.h"
+#include "salloc.h"
+#include "schedule.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+/// returned by `run_remote()` when the worker could not be used
+#define REMOTE_FAILED (-1000)
+
+/// milliseconds a slot waits for lookups before it compiles a job that was
+/// not looked up yet
+#define LOOKUP_PATIENCE 200
+
+/// milliseconds between changes of the number of local compilers
+#define THROTTLE_INTERVAL 1000
+
+/// milliseconds a compiler waiting for its turn checks the pressure again
+#define THROTTLE_POLL 100
+
+/// share of time (in percent) tasks stall on memory from which on fewer local
+/// compilers run, see `get_pressure()`
+#define MEMORY_PRESSURE_HIGH 10.0
+/// share of time tasks stall on memory below which more may run again
+#define MEMORY_PRESSURE_LOW 1.0
+/// share of time tasks wait for a processor from which on fewer local
+/// compilers run
+#define CPU_PRESSURE_HIGH 40.0
+/// share of time tasks wait for a processor below which more may run again
+#define CPU_PRESSURE_LOW 10.0
+
+/**
+ * A worker given in `WORKERS`.
+ */
+struct remote {
+    /// host name or address
+    char *host;
+    /// port or service name
+    char *port;
+    /// number of jobs sent to it at once
+    unsigned slots;
+    /// set once the worker could not be reached
+    bool down;
+};
+
+/**
+ * A thread running jobs.
+ */
+struct slot {
+    /// the thread, the first slot is run by the calling thread
+    pthread_t thread;
+    /// whether `thread` was started
+    bool running;
+    /// the worker this slot sends jobs to, `NULL` for a local slot
+    struct remote *remote;
+    /// whether the slot compiles without a token from the jobserver, true for
+    /// the first slot because every process may run one job
+    bool implicit_token;
+};
+
+static struct {
+    /// the jobs of the current `run_jobs()` call
+    struct job *jobs;
+    /// number of elements in `jobs`
+    size_t num_jobs;
+    /// protects the members below
+    pthread_mutex_t lock;
+    /// signaled when a job was looked up, compiled or all slots are done
+    pthread_cond_t cond;
+    /// index of the first job nobody took yet, fetchers take from here
+    size_t front;
+    /// index after the last job nobody took yet, with a cache slots take from
+    /// here, so they do not race the fetchers
+    size_t back;
+    /// the cache given in `CACHE`, `NULL` if there is none
+    struct cache *cache;
+    /// set once the cache failed, it is not used for the rest of the call
+    bool cache_down;
+    /// added to all compiler arguments when there is a cache
+    char *prefix_map;
+    /// output of "<compiler> --version", part of every key
+    char *version;
+    /// size of `version`
+    size_t version_size;
+    /// the key of each job, empty if it is not known
+    char (*keys)[CACHE_KEY_SIZE];
+    /// jobs that are not in the cache, in the order they were looked up
+    size_t *missed;
+    /// number of elements in `missed`
+    size_t num_missed;
+    /// index of the next element in `missed` no slot took yet
+    size_t next_missed;
+    /// jobs a worker could not be reached for, left to the local slots
+    size_t *returned;
+    /// number of elements in `returned`
+    size_t num_returned;
+    /// index of the next element in `returned` no slot took yet
+    size_t next_returned;
+    /// number of jobs sent to workers right now, they may still be returned
+    size_t num_remote;
+    /// number of jobs the fetchers are looking up right now
+    size_t num_fetching;
+    /// jobs that were compiled after they were missed, to be stored
+    size_t *compiled;
+    /// number of elements in `compiled`
+    size_t num_compiled;
+    /// index of the next element in `compiled` no fetcher stored yet
+    size_t next_compiled;
+    /// set once all slots are done, the fetchers then only store the rest
+    bool slots_done;
+    /// number of local slots, the most `limit` grows to
+    long num_local;
+    /// local compilers allowed to run at once, lowered while memory or the
+    /// processors are under pressure
+    long limit;
+    /// number of local compilers running
+    long num_running;
+    /// kilobytes the running local compilers are expected to use at most
+    long reserved;
+    /// kilobytes that were available when the call started, -1 if not known
+    long available;
+    /// the highest peak of a compiler in this call, expected of the jobs that
+    /// have none remembered
+    long max_rss;
+    /// peak kilobytes of the compiler of each job, the remembered one until it
+    /// ran, then the measured one, 0 if not known
+    long *rss;
+    /// memory pressure when `limit` was last checked
+    double memory_pressure;
+    /// when `limit` was last checked (`CLOCK_MONOTONIC`)
+    struct timespec adjusted;
+    /// the environment of the compilers, a copy so the config may change while
+    /// the threads start them
+    char **envp;
+} Schedule = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+/**
+ * The peak memory the compiler of each object used the last time it ran,
+ * sorted by the path of the object so it can be binary searched.
+ */
+static struct {
+    struct usage {
+        /// path of the object
+        char *path;
+        /// peak in kilobytes
+        long rss;
+    } *ptr;
+    size_t num;
+} Usages;
+
+/**
+ * @brief Searches the usage of an object in `Usages`.
+ *
+ * @param path      The path of the object.
+ * @param pindex    Output of the index of the usage or where to insert it.
+ *
+ * @return Whether the object has a usage.
+ */
+static bool search_usage(const char *path, size_t *pindex)
+{
+    size_t l, m, r;
+    int cmp;
+
+    l = 0;
+    r = Usages.num;
+    while (l < r) {
+        m = (l + r) / 2;
+        cmp = strcmp(Usages.ptr[m].path, path);
+        if (cmp == 0) {
+            *pindex = m;
+            return true;
+        }
+        if (cmp < 0) {
+            l = m + 1;
+        } else {
+            r = m;
+        }
+    }
+    *pindex = r;
+    return false;
+}
+
+/**
+ * @brief Remembers the peak memory the compiler of an object used.
+ */
+static void set_usage(const char *path, long rss)
+{
+    size_t index;
+
+    if (search_usage(path, &index)) {
+        Usages.ptr[index].rss = rss;
+        return;
+    }
+    Usages.ptr = sreallocarray(Usages.ptr, Usages.num + 1,
+            sizeof(*Usages.ptr));
+    memmove(&Usages.ptr[index + 1], &Usages.ptr[index],
+            sizeof(*Usages.ptr) * (Usages.num - index));
+    Usages.ptr[index].path = sstrdup(path);
+    Usages.ptr[index].rss = rss;
+    Usages.num++;
+}
+
+void clear_schedule(void)
+{
+    for (size_t i = 0; i < Usages.num; i++) {
+        free(Usages.ptr[i].path);
+    }
+    free(Usages.ptr);
+    Usages.ptr = NULL;
+    Usages.num = 0;
+}
+
+/**
+ * @brief Parses a value like "host:port/slots" or "[::1]:port".
+ *
+ * @return 0 on success, -1 if the value is malformed.
+ */
+static int parse_remote(const char *value, struct remote *remote)
+{
+    const char *colon, *slash, *host_end;
+    const char *host = value;
+    long slots = 1;
+    char *end;
+
+    slash = strchr(value, '/');
+    if (slash == NULL) {
+        slash = &value[strlen(value)];
+    } else {
+        slots = strtol(slash + 1, &end, 10);
+        if (end == slash + 1 || end[0] != '\0' || slots < 1) {
+            return -1;
+        }
+    }
+    colon = slash;
+    while (colon != value && colon[-1] != ':') {
+        colon--;
+    }
+    if (colon == value || colon == slash) {
+        return -1;
+    }
+    host_end = colon - 1;
+    if (host[0] == '[' && host_end[-1] == ']') {
+        host++;
+        host_end--;
+    }
+    if (host_end <= host) {
+        return -1;
+    }
+    remote->host = smalloc(host_end - host + 1);
+    memcpy(remote->host, host, host_end - host);
+    remote->host[host_end - host] = '\0';
+    remote->port = smalloc(slash - colon + 1);
+    memcpy(remote->port, colon, slash - colon);
+    remote->port[slash - colon] = '\0';
+    remote->slots = slots;
+    remote->down = false;
+    return 0;
+}
+
+/**
+ * @brief Writes data to a new file that replaces `path` once it is complete.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int replace_file(const char *path, const char *data, size_t size)
+{
+    char *tmp;
+    int fd;
+    int result = -1;
+
+    tmp = sasprintf("%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd != -1) {
+        if (write_all(fd, data, size) == 0 && close(fd) == 0) {
+            result = rename(tmp, path);
+        } else {
+            close(fd);
+        }
+    }
+    if (result == -1) {
+        LOG("could not write '%s': %s\n", path, strerror(errno));
+        unlink(tmp);
+    }
+    free(tmp);
+    return result;
+}
+
+/**
+ * @brief Sends the arguments and the preprocessed source to a worker and
+ * reads the result.
+ *
+ * @return The exit status of the compiler or `REMOTE_FAILED`.
+ */
+static int exchange_job(int fd, char **args, size_t num_args,
+        const char *source, size_t source_size, const char *err_file)
+{
+    const char *object = args[num_args + 3];
+    uint32_t status;
+    char *diag, *obj;
+    size_t diag_size, obj_size;
+    FILE *fp;
+
+    if (write_u32(fd, PROTOCOL_MAGIC) == -1 ||
+            write_u32(fd, num_args) == -1) {
+        return REMOTE_FAILED;
+    }
+    for (size_t i = 0; i < num_args; i++) {
+        if (write_blob(fd, args[i], strlen(args[i])) == -1) {
+            return REMOTE_FAILED;
+        }
+    }
+    if (write_blob(fd, source, source_size) == -1) {
+        return REMOTE_FAILED;
+    }
+
+    if (read_u32(fd, &status) == -1) {
+        return REMOTE_FAILED;
+    }
+    if (read_blob(fd, &diag, &diag_size) == -1) {
+        return REMOTE_FAILED;
+    }
+    if (read_blob(fd, &obj, &obj_size) == -1) {
+        free(diag);
+        return REMOTE_FAILED;
+    }
+
+    if (diag_size > 0) {
+        fp = err_file == NULL ? stderr : fopen(err_file, "wb");
+        if (fp != NULL) {
+            fwrite(diag, 1, diag_size, fp);
+            if (fp != stderr) {
+                fclose(fp);
+            }
+        }
+    }
+    if (status == 0 && replace_file(object, obj, obj_size) == -1) {
+        status = 1;
+    }
+    free(diag);
+    free(obj);
+    return status;
+}
+
+/**
+ * @brief Compiles a job on a worker.
+ *
+ * The source is preprocessed next to the object, so the worker does not need
+ * any of the headers.
+ *
+ * @return The exit status of the compiler or `REMOTE_FAILED`.
+ */
+static int run_remote(const struct remote *remote, char **args,
+        const char *err_file)
+{
+    size_t num_args;
+    char *pre;
+    char *source;
+    size_t source_size;
+    int status;
+    int fd;
+
+    /* the arguments end with "-c <source> -o <object>" */
+    num_args = 0;
+    while (args[num_args] != NULL) {
+        num_args++;
+    }
+    num_args -= 4;
+
+    char *pre_args[num_args + 5];
+
+    memcpy(pre_args, args, sizeof(*pre_args) * (num_args + 5));
+    pre = sasprintf("%s.i", args[num_args + 3]);
+    pre_args[num_args] = (char*) "-E";
+    pre_args[num_args + 3] = pre;
+    status = run_executable_usage(pre_args, err_file, NULL, Schedule.envp,
+            NULL);
+    if (status != 0) {
+        unlink(pre);
+        free(pre);
+        return status;
+    }
+    if (read_file(pre, &source, &source_size) == -1) {
+        LOG("could not read '%s': %s\n", pre, strerror(errno));
+        unlink(pre);
+        free(pre);
+        return REMOTE_FAILED;
+    }
+    unlink(pre);
+    free(pre);
+
+    fd = connect_to(remote->host, remote->port);
+    if (fd == -1) {
+        free(source);
+        return REMOTE_FAILED;
+    }
+    LOG("%s:%s: %s\n", remote->host, remote->port, args[num_args + 1]);
+    status = exchange_job(fd, args, num_args, source, source_size, err_file);
+    close(fd);
+    free(source);
+    return status;
+}
+
+/**
+ * @brief Runs a program with its output going to a file and its errors going
+ * nowhere.
+ *
+ * @param args      The program and its arguments.
+ * @param output    Where the output goes, `NULL` drops it.
+ *
+ * @return The exit status of the program or -1 if it could not be run.
+ */
+static int run_silent(char **args, const char *output)
+{
+    int pid;
+    int fd;
+    int wstatus;
+
+    pid = fork();
+    if (pid == -1) {
+        LOG("fork: %s\n", strerror(errno));
+        return -1;
+    }
+    if (pid == 0) {
+        fd = open("/dev/null", O_WRONLY);
+        if (fd != -1) {
+            dup2(fd, STDERR_FILENO);
+            if (output == NULL) {
+                dup2(fd, STDOUT_FILENO);
+            }
+        }
+        if (output != NULL) {
+            fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd == -1) {
+                _exit(127);
+            }
+            dup2(fd, STDOUT_FILENO);
+        }
+        execvpe(args[0], args, Schedule.envp);
+        _exit(127);
+    }
+    if (waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus)) {
+        return -1;
+    }
+    return WEXITSTATUS(wstatus);
+}
+
+/**
+ * @brief Gets the arguments a job is run with.
+ *
+ * With a cache, the current directory is mapped to "." so the objects do not
+ * depend on where the project is checked out.
+ *
+ * @return The arguments, the array (but not the strings) must be freed.
+ */
+static char **get_job_args(const struct job *job)
+{
+    size_t num_args = 0;
+    char **args;
+
+    while (job->args[num_args] != NULL) {
+        num_args++;
+    }
+    args = sreallocarray(NULL, num_args + 2, sizeof(*args));
+    args[0] = job->args[0];
+    if (Schedule.prefix_map == NULL) {
+        memcpy(&args[1], &job->args[1], sizeof(*args) * num_args);
+    } else {
+        args[1] = Schedule.prefix_map;
+        memcpy(&args[2], &job->args[1], sizeof(*args) * num_args);
+    }
+    return args;
+}
+
+/**
+ * @brief Computes the key of a job.
+ *
+ * The key is the hash of the compiler version, the arguments (without the
+ * source and the object) and the preprocessed source. The preprocessor runs
+ * with the directory mapping of `get_job_args()`, so the key is the same in
+ * every checkout as long as the flags only use relative paths.
+ *
+ * @param job   The job.
+ * @param key   Output of the key.
+ *
+ * @return 0 on success, -1 if the source could not be preprocessed.
+ */
+static int compute_key(const struct job *job, char key[CACHE_KEY_SIZE])
+{
+    char **args;
+    size_t num_args = 0;
+    char *pre;
+    char *source;
+    size_t source_size;
+    struct sha256 ctx;
+    unsigned char digest[SHA256_SIZE];
+    int result = -1;
+
+    args = get_job_args(job);
+    while (args[num_args] != NULL) {
+        num_args++;
+    }
+    /* the arguments end with "-c <source> -o <object>" */
+    pre = sasprintf("%s.key.i", args[num_args - 1]);
+    args[num_args - 4] = (char*) "-E";
+    args[num_args - 1] = pre;
+    if (run_silent(args, NULL) == 0 &&
+            read_file(pre, &source, &source_size) == 0) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, Schedule.version, Schedule.version_size + 1);
+        for (size_t i = 0; i < num_args - 4; i++) {
+            /* the mapping names the current directory */
+            if (args[i] != Schedule.prefix_map) {
+                sha256_update(&ctx, args[i], strlen(args[i]) + 1);
+            }
+        }
+        sha256_update(&ctx, source, source_size);
+        sha256_final(&ctx, digest);
+        make_cache_key(digest, key);
+        free(source);
+        result = 0;
+    }
+    unlink(pre);
+    free(pre);
+    free(args);
+    return result;
+}
+
+/**
+ * @brief Gets the path of the object a job compiles to, the last argument.
+ */
+static const char *get_object(const struct job *job)
+{
+    char **a = job->args;
+
+    while (a[1] != NULL) {
+        a++;
+    }
+    return a[0];
+}
+
+/**
+ * @brief Marks the cache as not usable.
+ */
+static void set_cache_down(void)
+{
+    pthread_mutex_lock(&Schedule.lock);
+    if (!Schedule.cache_down) {
+        LOG("not using the cache anymore\n");
+        Schedule.cache_down = true;
+        pthread_cond_broadcast(&Schedule.cond);
+    }
+    pthread_mutex_unlock(&Schedule.lock);
+}
+
+/**
+ * @brief Looks up a job in the cache, if it is there, its object is written
+ * and the job is done, otherwise it is handed to the slots.
+ */
+static void fetch_job(size_t index)
+{
+    struct job *job = &Schedule.jobs[index];
+    char *key = Schedule.keys[index];
+    char *data;
+    size_t size;
+    int found = 0;
+
+    if (compute_key(job, key) == -1) {
+        /* the compiler reports the error */
+        key[0] = '\0';
+    } else {
+        found = cache_get(Schedule.cache, key, &data, &size);
+        if (found == -1) {
+            set_cache_down();
+        } else if (found == 1) {
+            LOG("cache hit: %s\n", get_object(job));
+            job->status = 0;
+            if (replace_file(get_object(job), data, size) == -1) {
+                found = 0;
+            }
+            free(data);
+        }
+    }
+
+    pthread_mutex_lock(&Schedule.lock);
+    if (found != 1) {
+        Schedule.missed[Schedule.num_missed++] = index;
+    }
+    Schedule.num_fetching--;
+    pthread_cond_broadcast(&Schedule.cond);
+    pthread_mutex_unlock(&Schedule.lock);
+}
+
+/**
+ * @brief Stores the object of a compiled job in the cache.
+ */
+static void store_job(size_t index)
+{
+    const char *object = get_object(&Schedule.jobs[index]);
+    char *data;
+    size_t size;
+
+    if (read_file(object, &data, &size) == -1) {
+        LOG("could not read '%s': %s\n", object, strerror(errno));
+        return;
+    }
+    if (cache_put(Schedule.cache, Schedule.keys[index], data, size) == -1) {
+        set_cache_down();
+    }
+    free(data);
+}
+
+/**
+ * @brief Looks up jobs from the front while the slots take them from the back
+ * and then stores what the slots compiled.
+ */
+static void *run_fetcher(void *arg)
+{
+    size_t i;
+
+    (void) arg;
+    pthread_mutex_lock(&Schedule.lock);
+    while (!Schedule.cache_down) {
+        if (Schedule.front < Schedule.back) {
+            i = Schedule.front++;
+            Schedule.num_fetching++;
+            pthread_mutex_unlock(&Schedule.lock);
+            fetch_job(i);
+            pthread_mutex_lock(&Schedule.lock);
+        } else if (Schedule.next_compiled < Schedule.num_compiled) {
+            i = Schedule.compiled[Schedule.next_compiled++];
+            pthread_mutex_unlock(&Schedule.lock);
+            store_job(i);
+            pthread_mutex_lock(&Schedule.lock);
+        } else if (Schedule.slots_done) {
+            break;
+        } else {
+            pthread_cond_wait(&Schedule.cond, &Schedule.lock);
+        }
+    }
+    pthread_mutex_unlock(&Schedule.lock);
+    return NULL;
+}
+
+/**
+ * @brief Takes the next job for a slot.
+ *
+ * Jobs that are not in the cache come first. While there are jobs not looked
+ * up yet, a slot waits for the fetchers for `LOOKUP_PATIENCE` at most, after
+ * that it takes one of them, so a slow cache does not hold up the build. Jobs
+ * returned by `return_job()` come before all others.
+ *
+ * @param slot  The slot taking the job, a remote one must give it to
+ *              `return_job()` when it is done.
+ *
+ * @return The index of the job or `SIZE_MAX` if all jobs are taken.
+ */
+static size_t take_job(const struct slot *slot)
+{
+    struct timespec deadline;
+    bool patient = true;
+    size_t i = SIZE_MAX;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += LOOKUP_PATIENCE * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+
+    pthread_mutex_lock(&Schedule.lock);
+    for (;;) {
+        if (Schedule.next_returned < Schedule.num_returned) {
+            i = Schedule.returned[Schedule.next_returned++];
+            break;
+        }
+        if (Schedule.next_missed < Schedule.num_missed) {
+            i = Schedule.missed[Schedule.next_missed++];
+            break;
+        }
+        if (Schedule.front < Schedule.back) {
+            if (Schedule.cache == NULL) {
+                i = Schedule.front++;
+                break;
+            }
+            if (!patient || Schedule.cache_down) {
+                i = --Schedule.back;
+                break;
+            }
+        } else if (Schedule.num_fetching == 0 && Schedule.num_remote == 0) {
+            /* a worker may still return the jobs it has */
+            break;
+        }
+        if (!patient) {
+            pthread_cond_wait(&Schedule.cond, &Schedule.lock);
+        } else if (pthread_cond_timedwait(&Schedule.cond, &Schedule.lock,
+                    &deadline) == ETIMEDOUT) {
+            patient = false;
+        }
+    }
+    if (i != SIZE_MAX && slot->remote != NULL) {
+        Schedule.num_remote++;
+    }
+    pthread_mutex_unlock(&Schedule.lock);
+    return i;
+}
+
+/**
+ * @brief Ends a job a remote slot took.
+ *
+ * @param index     The index of the job.
+ * @param failed    Whether the worker could not be reached, the job is then
+ *                  left to the local slots.
+ */
+static void return_job(size_t index, bool failed)
+{
+    pthread_mutex_lock(&Schedule.lock);
+    Schedule.num_remote--;
+    if (failed) {
+        Schedule.returned[Schedule.num_returned++] = index;
+    }
+    pthread_cond_broadcast(&Schedule.cond);
+    pthread_mutex_unlock(&Schedule.lock);
+}
+
+/**
+ * @brief Changes the number of local compilers allowed at once by the pressure
+ * on memory and the processors, at most once every `THROTTLE_INTERVAL`.
+ *
+ * Swapping only gets worse, so the number is halved under memory pressure. The
+ * pressure is an average over 10 seconds and falls slowly, so this only happens
+ * again while it keeps rising. `Schedule.lock` must be held.
+ */
+static void adjust_limit(void)
+{
+    struct timespec now;
+    double memory, cpu;
+    long limit;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((now.tv_sec - Schedule.adjusted.tv_sec) * 1000 +
+            (now.tv_nsec - Schedule.adjusted.tv_nsec) / 1000000 <
+            THROTTLE_INTERVAL) {
+        return;
+    }
+    Schedule.adjusted = now;
+
+    memory = get_pressure("memory");
+    cpu = get_pressure("cpu");
+    limit = Schedule.limit;
+    if (memory >= MEMORY_PRESSURE_HIGH) {
+        if (memory >= Schedule.memory_pressure) {
+            limit = MAX(limit / 2, 1);
+        }
+    } else if (cpu >= CPU_PRESSURE_HIGH) {
+        limit = MAX(limit - 1, 1);
+    } else if (memory < MEMORY_PRESSURE_LOW && cpu < CPU_PRESSURE_LOW) {
+        limit = MIN(limit + 1, Schedule.num_local);
+    }
+    Schedule.memory_pressure = memory;
+    if (limit != Schedule.limit) {
+        LOG("running %ld compilers at once (pressure: memory %.2f%%, "
+                "processors %.2f%%)\n", limit, memory, cpu);
+        Schedule.limit = limit;
+    }
+}
+
+/**
+ * @brief Waits until the compiler of a job may run on this machine.
+ *
+ * It may if no other runs, otherwise there must be less than `Schedule.limit`
+ * running and the peaks they are expected to reach must fit into the memory
+ * that was available.
+ *
+ * @param index The index of the job.
+ *
+ * @return The kilobytes the compiler is expected to use, to be given to
+ *         `leave_local()`.
+ */
+static long enter_local(size_t index)
+{
+    struct timespec deadline;
+    long rss;
+
+    pthread_mutex_lock(&Schedule.lock);
+    for (;;) {
+        adjust_limit();
+        rss = Schedule.rss[index] > 0 ? Schedule.rss[index] : Schedule.max_rss;
+        if (Schedule.num_running == 0 ||
+                (Schedule.num_running < Schedule.limit &&
+                 (Schedule.available < 0 ||
+                  Schedule.reserved + rss <= Schedule.available))) {
+            break;
+        }
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += THROTTLE_POLL * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&Schedule.cond, &Schedule.lock, &deadline);
+    }
+    Schedule.num_running++;
+    Schedule.reserved += rss;
+    pthread_mutex_unlock(&Schedule.lock);
+    return rss;
+}
+
+/**
+ * @brief Records that the compiler of a job ended.
+ *
+ * @param index     The index of the job.
+ * @param rss       What `enter_local()` returned.
+ * @param used      The kilobytes the compiler used at its peak.
+ */
+static void leave_local(size_t index, long rss, long used)
+{
+    pthread_mutex_lock(&Schedule.lock);
+    Schedule.num_running--;
+    Schedule.reserved -= rss;
+    if (used > 0) {
+        Schedule.rss[index] = used;
+        Schedule.max_rss = MAX(Schedule.max_rss, used);
+    }
+    pthread_cond_broadcast(&Schedule.cond);
+    pthread_mutex_unlock(&Schedule.lock);
+}
+
+static void *run_slot(void *arg)
+{
+    struct slot *slot = arg;
+    struct job *job;
+    char **args;
+    size_t i;
+    int status;
+    int token;
+    long rss;
+    struct rusage usage;
+
+    while (i = take_job(slot), i != SIZE_MAX) {
+        job = &Schedule.jobs[i];
+        args = get_job_args(job);
+        if (slot->remote != NULL) {
+            status = REMOTE_FAILED;
+            if (!__atomic_load_n(&slot->remote->down, __ATOMIC_RELAXED)) {
+                status = run_remote(slot->remote, args, job->err_file);
+                if (status == REMOTE_FAILED) {
+                    __atomic_store_n(&slot->remote->down, true,
+                            __ATOMIC_RELAXED);
+                    LOG("not using worker '%s:%s' anymore\n",
+                            slot->remote->host, slot->remote->port);
+                }
+            }
+            if (status == REMOTE_FAILED) {
+                /* the local slots compile it, only they are limited by the
+                 * jobserver */
+                free(args);
+                return_job(i, true);
+                break;
+            }
+            return_job(i, false);
+        } else {
+            rss = enter_local(i);
+            token = slot->implicit_token ? -1 : take_token();
+            memset(&usage, 0, sizeof(usage));
+            status = run_executable_usage(args, job->err_file, NULL,
+                    Schedule.envp, &usage);
+            give_token(token);
+            leave_local(i, rss, usage.ru_maxrss);
+        }
+        free(args);
+        job->status = status;
+        if (status == 0 && Schedule.cache != NULL &&
+                Schedule.keys[i][0] != '\0') {
+            pthread_mutex_lock(&Schedule.lock);
+            Schedule.compiled[Schedule.num_compiled++] = i;
+            pthread_cond_broadcast(&Schedule.cond);
+            pthread_mutex_unlock(&Schedule.lock);
+        }
+        if (slot->remote != NULL &&
+                __atomic_load_n(&slot->remote->down, __ATOMIC_RELAXED)) {
+            /* the local slots do the rest */
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Opens the cache in `CACHE` and gets what all keys have in common.
+ *
+ * @return 0 on success, -1 if there is no cache or it can not be used.
+ */
+static int prepare_cache(const char *compiler)
+{
+    static struct cache cache;
+    struct config_entry *entry;
+    char version_file[] = "/tmp/autocar-version.XXXXXX";
+    char *args[] = { (char*) compiler, (char*) "--version", NULL };
+    char *cwd;
+    int fd;
+
+    entry = get_conf("cache", NULL);
+    if (entry == NULL || entry->num_values == 0) {
+        return -1;
+    }
+    if (open_cache(&cache, entry->values[0]) == -1) {
+        LOG("invalid cache '%s', expected http://host[:port][/path] or a"
+                " directory\n", entry->values[0]);
+        return -1;
+    }
+
+    /* objects of different compilers must not be mixed up */
+    fd = mkstemp(version_file);
+    if (fd == -1) {
+        LOG("mkstemp: %s\n", strerror(errno));
+        close_cache(&cache);
+        return -1;
+    }
+    close(fd);
+    if (run_silent(args, version_file) != 0 ||
+            read_file(version_file, &Schedule.version,
+                &Schedule.version_size) == -1) {
+        LOG("could not get the version of '%s', not using the cache\n",
+                compiler);
+        unlink(version_file);
+        close_cache(&cache);
+        return -1;
+    }
+    unlink(version_file);
+
+    cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        LOG("getcwd: %s\n", strerror(errno));
+        free(Schedule.version);
+        close_cache(&cache);
+        return -1;
+    }
+    Schedule.prefix_map = sasprintf("-ffile-prefix-map=%s=.", cwd);
+    free(cwd);
+    Schedule.cache = &cache;
+    return 0;
+}
+
+void run_jobs(struct job *jobs, size_t num_jobs)
+{
+    struct config_entry *entry;
+    long num_local;
+    struct remote *remotes = NULL;
+    size_t num_remotes = 0;
+    struct slot *slots;
+    size_t num_slots;
+    pthread_t *fetchers = NULL;
+    size_t num_fetchers = 0;
+    size_t index;
+    int err;
+
+    entry = get_conf("jobs", NULL);
+    if (entry != NULL && entry->num_values > 0) {
+        num_local = strtol(entry->values[0], NULL, 0);
+    } else {
+        num_local = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (num_local < 1) {
+        num_local = 1;
+    }
+    /* also when there is nothing to compile, the linker may take tokens */
+    fill_jobserver(num_local);
+    if (num_jobs == 0) {
+        return;
+    }
+    num_slots = num_local;
+
+    entry = get_conf("workers", NULL);
+    if (entry != NULL) {
+        remotes = sreallocarray(NULL, entry->num_values, sizeof(*remotes));
+        for (size_t i = 0; i < entry->num_values; i++) {
+            if (parse_remote(entry->values[i], &remotes[num_remotes]) == -1) {
+                LOG("invalid worker '%s', expected host:port[/slots]\n",
+                        entry->values[i]);
+                continue;
+            }
+            num_slots += remotes[num_remotes++].slots;
+        }
+    }
+
+    /* local slots come first, workers are only used once they are busy */
+    if (num_slots > num_jobs) {
+        num_slots = num_jobs;
+    }
+    slots = scalloc(num_slots, sizeof(*slots));
+    slots[0].implicit_token = true;
+    for (size_t i = num_local, r = 0, s = 0; i < num_slots; i++) {
+        slots[i].remote = &remotes[r];
+        if (++s == remotes[r].slots) {
+            r++;
+            s = 0;
+        }
+    }
+
+    Schedule.jobs = jobs;
+    Schedule.num_jobs = num_jobs;
+    Schedule.front = 0;
+    Schedule.back = num_jobs;
+    Schedule.cache = NULL;
+    Schedule.cache_down = false;
+    Schedule.num_missed = 0;
+    Schedule.next_missed = 0;
+    Schedule.returned = sreallocarray(NULL, num_jobs,
+            sizeof(*Schedule.returned));
+    Schedule.num_returned = 0;
+    Schedule.next_returned = 0;
+    Schedule.num_remote = 0;
+    Schedule.num_fetching = 0;
+    Schedule.num_compiled = 0;
+    Schedule.next_compiled = 0;
+    Schedule.slots_done = false;
+    Schedule.num_local = num_local;
+    Schedule.limit = num_local;
+    Schedule.num_running = 0;
+    Schedule.reserved = 0;
+    Schedule.available = get_available_memory();
+    Schedule.max_rss = 0;
+    Schedule.memory_pressure = 0;
+    Schedule.adjusted.tv_sec = 0;
+    Schedule.adjusted.tv_nsec = 0;
+    Schedule.envp = copy_conf_environ();
+    Schedule.rss = sreallocarray(NULL, num_jobs, sizeof(*Schedule.rss));
+    for (size_t i = 0; i < num_jobs; i++) {
+        Schedule.rss[i] = 0;
+        if (search_usage(get_object(&jobs[i]), &index)) {
+            Schedule.rss[i] = Usages.ptr[index].rss;
+        }
+    }
+
+    if (prepare_cache(jobs[0].args[0]) == 0) {
+        Schedule.keys = scalloc(num_jobs, sizeof(*Schedule.keys));
+        Schedule.missed = sreallocarray(NULL, num_jobs,
+                sizeof(*Schedule.missed));
+        Schedule.compiled = sreallocarray(NULL, num_jobs,
+                sizeof(*Schedule.compiled));
+        /* looking up runs alongside the slots, which are never kept waiting
+         * while there are jobs not looked up yet, a fetcher for each slot
+         * makes sure most jobs are looked up before a slot gets to them */
+        fetchers = sreallocarray(NULL, num_slots, sizeof(*fetchers));
+        for (; num_fetchers < num_slots; num_fetchers++) {
+            err = pthread_create(&fetchers[num_fetchers], NULL, run_fetcher,
+                    NULL);
+            if (err != 0) {
+                LOG("pthread_create: %s\n", strerror(err));
+                break;
+            }
+        }
+        if (num_fetchers == 0) {
+            /* nobody would look up the jobs */
+            Schedule.cache_down = true;
+        }
+    }
+
+    /* the calling thread is the first slot */
+    for (size_t i = 1; i < num_slots; i++) {
+        err = pthread_create(&slots[i].thread, NULL, run_slot, &slots[i]);
+        if (err != 0) {
+            /* the other slots take over its share */
+            LOG("pthread_create: %s\n", strerror(err));
+            continue;
+        }
+        slots[i].running = true;
+    }
+    run_slot(&slots[0]);
+    for (size_t i = 1; i < num_slots; i++) {
+        if (slots[i].running) {
+            pthread_join(slots[i].thread, NULL);
+        }
+    }
+
+    if (Schedule.cache != NULL) {
+        pthread_mutex_lock(&Schedule.lock);
+        Schedule.slots_done = true;
+        pthread_cond_broadcast(&Schedule.cond);
+        pthread_mutex_unlock(&Schedule.lock);
+        for (size_t i = 0; i < num_fetchers; i++) {
+            pthread_join(fetchers[i], NULL);
+        }
+        close_cache(Schedule.cache);
+        Schedule.cache = NULL;
+        free(Schedule.prefix_map);
+        Schedule.prefix_map = NULL;
+        free(Schedule.version);
+        free(Schedule.keys);
+        free(Schedule.missed);
+        free(Schedule.compiled);
+        free(fetchers);
+    }
+
+    for (size_t i = 0; i < num_jobs; i++) {
+        if (Schedule.rss[i] > 0) {
+            set_usage(get_object(&jobs[i]), Schedule.rss[i]);
+        }
+    }
+    free(Schedule.rss);
+    free(Schedule.returned);
+    free_conf_environ(Schedule.envp);
+    Schedule.envp = NULL;
+
+    free(slots);
+    for (size_t i = 0; i < num_remotes; i++) {
+        free(remotes[i].host);
+        free(remotes[i].port);
+    }
+    free(remotes);
+}
@@ -0,0 +1,53 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stddef.h>
+
+/**
+ * A single compile handed to `run_jobs()`.
+ */
+struct job {
+    /// the compiler invocation (see `get_compile_args()`)
+    char **args;
+    /// where the compiler output goes, `NULL` for the terminal
+    const char *err_file;
+    /// set to the exit status of the compiler
+    int status;
+};
+
+/**
+ * @brief Runs compile jobs on local and remote slots.
+ *
+ * There are `JOBS` local slots (by default one for each online processor) and
+ * each value "host:port[/slots]" in `WORKERS` adds remote slots (one if not
+ * given). Every slot is a thread that takes the next job not taken yet, so
+ * faster slots end up doing more jobs.
+ *
+ * Fewer local compilers run while memory or the processors are under pressure
+ * (see /proc/pressure), and a compiler only starts if the peak memory it used
+ * the last time (with `wait4()`) fits next to those already running.
+ *
+ * A remote slot runs the preprocessor locally, sends its output with the
+ * arguments to a worker and writes back the object it gets. If the worker can
+ * not be reached, it is not used for the rest of the call and the job is
+ * compiled locally.
+ *
+ * With a `CACHE`, fetcher threads look up the jobs while the slots compile the
+ * ones that were missed, which are then stored. Objects found are written
+ * directly and their compiler output is not shown again. All compilers get
+ * "-ffile-prefix-map=<current directory>=." so the objects are the same in
+ * every checkout.
+ *
+ * The caller must create the directories of the objects beforehand.
+ *
+ * @param jobs      The jobs to run.
+ * @param num_jobs  The number of jobs.
+ */
+void run_jobs(struct job *jobs, size_t num_jobs);
+
+/**
+ * @brief Frees the peak memory remembered of the compilers.
+ */
+void clear_schedule(void);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// size of a digest in bytes
+#define SHA256_SIZE 32
+
+/**
+ * The state of a running SHA-256 computation.
+ */
+struct sha256 {
+    /// the intermediate hash value
+    uint32_t state[8];
+    /// number of bytes hashed so far
+    uint64_t length;
+    /// bytes not yet making a full block
+    unsigned char block[64];
+};
+
+/**
+ * @brief Starts a new computation.
+ */
+void sha256_init(struct sha256 *ctx);
+
+/**
+ * @brief Adds data to the computation.
+ */
+void sha256_update(struct sha256 *ctx, const void *data, size_t size);
+
+/**
+ * @brief Finishes the computation.
+ *
+ * @param ctx       The computation, it must be initialized again to be reused.
+ * @param digest    Output of the digest.
+ */
+void sha256_final(struct sha256 *ctx, unsigned char digest[SHA256_SIZE]);
+
+#endif
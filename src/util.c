@@ -1,14 +1,18 @@
 #include "args.h"
+#include "conf.h"
 #include "salloc.h"
 #include "util.h"
 
 #include <ctype.h>
+#include <stdbool.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
@@ -173,25 +177,41 @@ void split_string_at_space(char *str, char ***psplit, size_t *pnum)
 
 int run_executable(char **args, const char *output_redirect,
         const char *input_redirect)
+{
+    return run_executable_usage(args, output_redirect, input_redirect, NULL,
+            NULL);
+}
+
+int run_executable_usage(char **args, const char *output_redirect,
+        const char *input_redirect, char **envp, struct rusage *usage)
 {
     int pid;
     int wstatus;
+    struct rusage used;
 
     for (char **a = args; a[0] != NULL; a++) {
         LOG("%s ", a[0]);
     }
     LOG("\n");
 
+    if (envp == NULL) {
+        envp = get_conf_environ();
+    }
+    /* `freopen()` in the child flushes what is still buffered, that would be
+     * printed once more by every child */
+    fflush(stdout);
     pid = fork();
     if (pid == -1) {
         LOG("fork: %s\n", strerror(errno));
         return -1;
     }
     if (pid == 0) {
+        /* the child must not return, it would continue as a second autocar
+         * (and autocar may have other threads running) */
         if (output_redirect != NULL) {
             if (freopen(output_redirect, "wb", stdout) == NULL) {
                 LOG("freopen '%s' stdout: %s\n", output_redirect, strerror(errno));
-                return -1;
+                _exit(127);
             }
         } else {
             dup2(STDOUT_FILENO, STDERR_FILENO);
@@ -200,38 +220,167 @@ int run_executable(char **args, const char *output_redirect,
             printf("%s\n", input_redirect);
             if (freopen(input_redirect, "rb", stdin) == NULL) {
                 LOG("freopen '%s' stdin: %s\n", input_redirect, strerror(errno));
-                return -1;
+                _exit(127);
             }
         }
-        if (execvp(args[0], args) < 0) {
-            LOG("execvp: %s\n", strerror(errno));
+        execvpe(args[0], args, envp);
+        LOG("execvpe: %s\n", strerror(errno));
+        _exit(127);
+    }
+
+    while (wait4(pid, &wstatus, 0, &used) == -1) {
+        if (errno != EINTR) {
+            LOG("wait4: %s\n", strerror(errno));
             return -1;
         }
-    } else {
-        waitpid(pid, &wstatus, 0);
-        if (WEXITSTATUS(wstatus) != 0) {
-            LOG("`%s` returned: %d\n", args[0], wstatus);
-            return WEXITSTATUS(wstatus);
-        }
+    }
+    if (usage != NULL) {
+        *usage = used;
+    }
+    /* a compiler killed (like by the OOM killer) did not succeed */
+    if (!WIFEXITED(wstatus)) {
+        LOG("`%s` was killed by signal %d\n", args[0], WTERMSIG(wstatus));
+        return -1;
+    }
+    if (WEXITSTATUS(wstatus) != 0) {
+        LOG("`%s` returned: %d\n", args[0], wstatus);
+        return WEXITSTATUS(wstatus);
     }
     return 0;
 }
 
+pid_t start_shell(const char *shell, const char *cmd, int *pfd)
+{
+    int pipe_fd[2];
+    char **envp;
+    pid_t pid;
+
+    /* the pipe must not leak into commands running at the same time, the
+     * output would then only end when they do */
+    if (pfd != NULL && pipe2(pipe_fd, O_CLOEXEC) == -1) {
+        LOG("pipe: %s\n", strerror(errno));
+        return -1;
+    }
+
+    envp = get_conf_environ();
+    pid = fork();
+    if (pid == -1) {
+        LOG("fork: %s\n", strerror(errno));
+        if (pfd != NULL) {
+            close(pipe_fd[0]);
+            close(pipe_fd[1]);
+        }
+        return -1;
+    }
+
+    if (pid == 0) {
+        if (pfd != NULL) {
+            dup2(pipe_fd[1], STDOUT_FILENO);
+        }
+        execle(shell, shell, "-c", cmd, (char*) NULL, envp);
+        LOG("execle '%s': %s\n", shell, strerror(errno));
+        _exit(127);
+    }
+    if (pfd != NULL) {
+        close(pipe_fd[1]);
+        *pfd = pipe_fd[0];
+    }
+    return pid;
+}
+
+int wait_process(pid_t pid)
+{
+    int wstatus;
+
+    while (waitpid(pid, &wstatus, 0) == -1) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    if (!WIFEXITED(wstatus)) {
+        return -1;
+    }
+    return WEXITSTATUS(wstatus);
+}
+
+/**
+ * Directories that are known to exist, sorted so they can be binary searched.
+ */
+static struct {
+    char **ptr;
+    size_t num;
+} Directories;
+
+/**
+ * @brief Searches a path in `Directories`.
+ *
+ * @param path      The path to search.
+ * @param pindex    Output of the index to insert the path at.
+ *
+ * @return Whether the directory is known to exist.
+ */
+static bool search_directory(const char *path, size_t *pindex)
+{
+    size_t l, m, r;
+    int cmp;
+
+    l = 0;
+    r = Directories.num;
+    while (l < r) {
+        m = (l + r) / 2;
+        cmp = strcmp(Directories.ptr[m], path);
+        if (cmp == 0) {
+            *pindex = m;
+            return true;
+        }
+        if (cmp < 0) {
+            l = m + 1;
+        } else {
+            r = m;
+        }
+    }
+    *pindex = r;
+    return false;
+}
+
 int create_recursive_directory(/* const */ char *path)
 {
     char *cur, *s;
+    size_t index;
+    bool known;
+
+    /* most of the time, the direct parent was already created */
+    s = strrchr(path, '/');
+    if (s == NULL) {
+        return 0;
+    }
+    s[0] = '\0';
+    known = search_directory(path, &index);
+    s[0] = '/';
+    if (known) {
+        return 0;
+    }
 
     cur = path;
     while (s = strchr(cur, '/'), s != NULL) {
         s[0] = '\0';
-        if (mkdir(path, 0755) == -1) {
-            if (errno != EEXIST) {
-                LOG("mkdir '%s': %s\n", path, strerror(errno));
-                return -1;
+        if (!search_directory(path, &index)) {
+            if (mkdir(path, 0755) == -1) {
+                if (errno != EEXIST) {
+                    LOG("mkdir '%s': %s\n", path, strerror(errno));
+                    s[0] = '/';
+                    return -1;
+                }
+                DLOG("mkdir '%s': exists\n", path);
+            } else {
+                DLOG("mkdir '%s'\n", path);
             }
-            DLOG("mkdir '%s': exists\n", path);
-        } else {
-            DLOG("mkdir '%s'\n", path);
+            Directories.ptr = sreallocarray(Directories.ptr,
+                    Directories.num + 1, sizeof(*Directories.ptr));
+            memmove(&Directories.ptr[index + 1], &Directories.ptr[index],
+                    sizeof(*Directories.ptr) * (Directories.num - index));
+            Directories.ptr[index] = sstrdup(path);
+            Directories.num++;
         }
         s[0] = '/';
         cur = s + 1;
@@ -239,3 +388,12 @@ int create_recursive_directory(/* const */ char *path)
     return 0;
 }
 
+void forget_directories(void)
+{
+    for (size_t i = 0; i < Directories.num; i++) {
+        free(Directories.ptr[i]);
+    }
+    free(Directories.ptr);
+    Directories.ptr = NULL;
+    Directories.num = 0;
+}
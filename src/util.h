@@ -3,6 +3,9 @@
 
 #include <stdlib.h>
 
+#include <sys/resource.h>
+#include <sys/types.h>
+
 struct rip {
     char *s;
     char c;
@@ -54,21 +57,66 @@ void split_string_at_space(char *str, char ***psplit, size_t *pnum);
  * @param output_redirect Replaces `stdout`, may be `NULL` to not replace.
  * @param input_redirect Replaces `stdin`, may be `NULL` to not replace.
  *
- * @return -1 or the exit code of the sub process.
+ * @return -1 if it could not be run or was killed, otherwise its exit code.
  */
 int run_executable(char **args, const char *output_redirect,
         const char *input_redirect);
 
+/**
+ * @brief Like `run_executable()` but also gets the resources the program used.
+ *
+ * @param envp  The environment of the program, `NULL` for that of
+ *              `get_conf_environ()`.
+ * @param usage Output of the resources, `ru_maxrss` is the peak of the program
+ *              and the processes it waited for (like the compiler proper). It
+ *              is left as is if the program could not be waited for.
+ *
+ * @return -1 if it could not be run or was killed, otherwise its exit code.
+ */
+int run_executable_usage(char **args, const char *output_redirect,
+        const char *input_redirect, char **envp, struct rusage *usage);
+
+/**
+ * @brief Starts a command through a shell, like `popen()`, the environment of
+ * the command is that of the config (see `get_conf_environ()`).
+ *
+ * @param shell The shell to run the command with, like "/bin/sh".
+ * @param cmd   The command.
+ * @param pfd   Output of a pipe the command writes its output to, `NULL` to
+ *              keep the output of autocar.
+ *
+ * @return The process or -1 if it could not be started.
+ */
+pid_t start_shell(const char *shell, const char *cmd, int *pfd);
+
+/**
+ * @brief Waits until a process ends.
+ *
+ * @return The exit code of the process or -1 if it did not exit normally.
+ */
+int wait_process(pid_t pid);
+
 /**
  * @brief Creates a directory by creating all parent directories.
  *
  * If the `path` is parent/folder/A then the directories 'parent',
  * 'parent/folder' and 'parent/folder/A' are created in that order.
  *
+ * Directories that were created (or already existed) are remembered until
+ * `forget_directories()` is called, they are not passed to `mkdir()` again.
+ *
  * @param path The directory to create.
  *
  * @return -1 if mkdir failed, 0 otherwise.
  */
 int create_recursive_directory(/* const */ char *path);
 
+/**
+ * @brief Forgets all directories that `create_recursive_directory()` knows.
+ *
+ * This is called at the start of each cycle because the directories might
+ * have been removed in the mean time.
+ */
+void forget_directories(void);
+
 #endif
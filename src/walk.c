@@ -0,0 +1,496 @@
+#include "args.h"
+#include "salloc.h"
+#include "walk.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/// size of the buffer each thread reads directory entries into
+#define WALK_BUFFER_SIZE (128 * 1024)
+
+/// minimum size of the memory blocks paths are stored in
+#define WALK_BLOCK_SIZE (64 * 1024)
+
+/// upper limit for the number of threads
+#define WALK_MAX_THREADS 16
+
+/**
+ * The layout of the entries `getdents64()` returns.
+ */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/**
+ * A directory that is left to read.
+ */
+struct task {
+    /// path of the directory, empty for the current directory
+    char *path;
+    /// length of `path`
+    size_t len;
+    /// file descriptor of the opened directory or -1 if not opened yet
+    int fd;
+    /// index of the root this directory belongs to
+    size_t root;
+};
+
+/**
+ * A thread of the pool together with its queue and results.
+ */
+struct worker {
+    pthread_t thread;
+    /// whether `thread` was started
+    bool running;
+
+    /// locks the task queue
+    pthread_mutex_t lock;
+    /// queued directories, the owner takes from the end and others steal from
+    /// the front
+    struct task *tasks;
+    /// index of the first queued task
+    size_t first;
+    /// index after the last queued task
+    size_t num_tasks;
+    /// number of allocated elements in `tasks`
+    size_t a_tasks;
+
+    /// files found by this thread
+    struct walk_entry *entries;
+    /// number of elements in `entries`
+    size_t num_entries;
+    /// number of allocated elements in `entries`
+    size_t a_entries;
+    /// number of files skipped because of their extension
+    size_t num_skipped;
+
+    /// memory blocks the paths are stored in
+    char **blocks;
+    /// number of elements in `blocks`
+    size_t num_blocks;
+    /// next free byte in the last block
+    char *block_ptr;
+    /// number of free bytes in the last block
+    size_t block_left;
+
+    /// buffer for `getdents64()`
+    char *buffer;
+};
+
+/**
+ * State of the current traversal.
+ */
+static struct {
+    const struct walk_root *roots;
+    const struct walk_filter *filter;
+    struct worker *workers;
+    unsigned num_workers;
+    /// number of directories that are queued or being read
+    size_t pending;
+    /// number of workers waiting for new tasks
+    unsigned num_idle;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+} Walk = {
+    .idle_lock = PTHREAD_MUTEX_INITIALIZER,
+    .idle_cond = PTHREAD_COND_INITIALIZER,
+};
+
+/**
+ * @brief Gets memory for a path from the blocks of a worker.
+ */
+static char *alloc_path(struct worker *w, size_t size)
+{
+    char *s;
+    size_t a;
+
+    if (size > w->block_left) {
+        a = size > WALK_BLOCK_SIZE ? size : WALK_BLOCK_SIZE;
+        w->blocks = sreallocarray(w->blocks, w->num_blocks + 1,
+                sizeof(*w->blocks));
+        w->block_ptr = smalloc(a);
+        w->blocks[w->num_blocks++] = w->block_ptr;
+        w->block_left = a;
+    }
+    s = w->block_ptr;
+    w->block_ptr += size;
+    w->block_left -= size;
+    return s;
+}
+
+/**
+ * @brief Wakes up one waiting worker, if any.
+ */
+static void wake_worker(void)
+{
+    if (__atomic_load_n(&Walk.num_idle, __ATOMIC_ACQUIRE) > 0) {
+        pthread_mutex_lock(&Walk.idle_lock);
+        pthread_cond_signal(&Walk.idle_cond);
+        pthread_mutex_unlock(&Walk.idle_lock);
+    }
+}
+
+/**
+ * @brief Adds a task to the end of the queue of a worker.
+ *
+ * `Walk.pending` must have been incremented already.
+ */
+static void push_task(struct worker *w, const struct task *task)
+{
+    pthread_mutex_lock(&w->lock);
+    if (w->num_tasks == w->a_tasks) {
+        w->a_tasks = w->a_tasks == 0 ? 16 : w->a_tasks * 2;
+        w->tasks = sreallocarray(w->tasks, w->a_tasks, sizeof(*w->tasks));
+    }
+    w->tasks[w->num_tasks++] = *task;
+    pthread_mutex_unlock(&w->lock);
+    wake_worker();
+}
+
+/**
+ * @brief Takes the most recently added task of a worker.
+ *
+ * Reading the newest directory first keeps the queue short and the entries of
+ * a sub tree close together.
+ */
+static bool pop_task(struct worker *w, struct task *task)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->num_tasks > w->first) {
+        *task = w->tasks[--w->num_tasks];
+        if (w->num_tasks == w->first) {
+            w->first = 0;
+            w->num_tasks = 0;
+        }
+        found = true;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+/**
+ * @brief Takes the oldest task of any other worker.
+ *
+ * The oldest directories are the ones closest to the root and therefore most
+ * likely the largest sub trees.
+ */
+static bool steal_task(struct worker *self, struct task *task)
+{
+    struct worker *w;
+    size_t index;
+    bool found;
+
+    index = self - Walk.workers;
+    for (unsigned i = 1; i < Walk.num_workers; i++) {
+        w = &Walk.workers[(index + i) % Walk.num_workers];
+        found = false;
+        pthread_mutex_lock(&w->lock);
+        if (w->num_tasks > w->first) {
+            *task = w->tasks[w->first++];
+            if (w->num_tasks == w->first) {
+                w->first = 0;
+                w->num_tasks = 0;
+            }
+            found = true;
+        }
+        pthread_mutex_unlock(&w->lock);
+        if (found) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Waits until there might be new tasks.
+ *
+ * The wait is limited to a millisecond, a wake up may get lost if a task is
+ * pushed right before this worker counts itself as idle.
+ */
+static void wait_for_task(void)
+{
+    struct timespec ts;
+
+    pthread_mutex_lock(&Walk.idle_lock);
+    __atomic_add_fetch(&Walk.num_idle, 1, __ATOMIC_ACQ_REL);
+    if (__atomic_load_n(&Walk.pending, __ATOMIC_ACQUIRE) > 0) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 1000 * 1000;
+        if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000 * 1000 * 1000;
+        }
+        pthread_cond_timedwait(&Walk.idle_cond, &Walk.idle_lock, &ts);
+    }
+    __atomic_sub_fetch(&Walk.num_idle, 1, __ATOMIC_ACQ_REL);
+    pthread_mutex_unlock(&Walk.idle_lock);
+}
+
+/**
+ * @brief Checks if a file name has one of the extensions of the filter.
+ */
+static bool has_wanted_extension(const char *name)
+{
+    const char *ext;
+
+    ext = strrchr(name, '.');
+    if (ext == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < Walk.filter->num_exts; i++) {
+        if (strcmp(ext, Walk.filter->exts[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Reads a directory, queues its sub directories and stores its files.
+ */
+static void read_directory(struct worker *w, const struct task *task)
+{
+    const struct walk_root *root;
+    int fd;
+    long n;
+    struct linux_dirent64 *ent;
+    unsigned char type;
+    struct stat st;
+    size_t len_name, len_prefix;
+    char *path;
+    struct task sub;
+    struct walk_entry *entry;
+
+    root = &Walk.roots[task->root];
+    fd = task->fd;
+    if (fd == -1) {
+        fd = open(task->len == 0 ? "." : task->path,
+                O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd == -1) {
+            LOG("open(%s): %s\n", task->path, strerror(errno));
+            return;
+        }
+    }
+
+    DLOG("collect from directory: '%s'\n", task->path);
+
+    len_prefix = task->len == 0 ? 0 : task->len + 1;
+    while (n = syscall(SYS_getdents64, fd, w->buffer, WALK_BUFFER_SIZE),
+            n > 0) {
+        for (long off = 0; off < n; off += ent->d_reclen) {
+            ent = (struct linux_dirent64*) &w->buffer[off];
+            if (ent->d_name[0] == '.') {
+                if (ent->d_name[1] == '\0') {
+                    continue;
+                }
+                if (ent->d_name[1] == '.' && ent->d_name[2] == '\0') {
+                    continue;
+                }
+            }
+
+            type = ent->d_type;
+            if (type == DT_UNKNOWN) {
+                /* not all file systems fill out `d_type` */
+                if (fstatat(fd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+                    continue;
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR :
+                    S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if (type != DT_REG && (type != DT_DIR || !root->recursive)) {
+                continue;
+            }
+            if (type == DT_REG && Walk.filter->exts != NULL &&
+                    !has_wanted_extension(ent->d_name)) {
+                w->num_skipped++;
+                continue;
+            }
+
+            len_name = strlen(ent->d_name);
+            path = alloc_path(w, len_prefix + len_name + 1);
+            memcpy(path, task->path, task->len);
+            if (len_prefix > 0) {
+                path[task->len] = '/';
+            }
+            memcpy(&path[len_prefix], ent->d_name, len_name + 1);
+
+            if (Walk.filter->ignore != NULL &&
+                    is_ignored(Walk.filter->ignore, path, &path[len_prefix],
+                        type == DT_DIR)) {
+                DLOG("ignoring '%s'\n", path);
+                /* give the memory back, it was the last allocation */
+                w->block_ptr -= len_prefix + len_name + 1;
+                w->block_left += len_prefix + len_name + 1;
+                continue;
+            }
+
+            if (type == DT_DIR) {
+                sub.path = path;
+                sub.len = len_prefix + len_name;
+                sub.fd = -1;
+                sub.root = task->root;
+                __atomic_add_fetch(&Walk.pending, 1, __ATOMIC_ACQ_REL);
+                push_task(w, &sub);
+                continue;
+            }
+
+            if (w->num_entries == w->a_entries) {
+                w->a_entries = w->a_entries == 0 ? 256 : w->a_entries * 2;
+                w->entries = sreallocarray(w->entries, w->a_entries,
+                        sizeof(*w->entries));
+            }
+            entry = &w->entries[w->num_entries++];
+            entry->path = path;
+            entry->flags = root->flags;
+            entry->root = task->root;
+        }
+    }
+    if (n == -1) {
+        LOG("getdents64(%s): %s\n", task->path, strerror(errno));
+    }
+    close(fd);
+}
+
+static void *run_worker(void *arg)
+{
+    struct worker *const w = arg;
+    struct task task;
+
+    while (1) {
+        if (!pop_task(w, &task) && !steal_task(w, &task)) {
+            if (__atomic_load_n(&Walk.pending, __ATOMIC_ACQUIRE) == 0) {
+                break;
+            }
+            wait_for_task();
+            continue;
+        }
+        read_directory(w, &task);
+        if (__atomic_sub_fetch(&Walk.pending, 1, __ATOMIC_ACQ_REL) == 0) {
+            /* the last directory was read, let all others stop */
+            pthread_mutex_lock(&Walk.idle_lock);
+            pthread_cond_broadcast(&Walk.idle_cond);
+            pthread_mutex_unlock(&Walk.idle_lock);
+        }
+    }
+    return NULL;
+}
+
+int walk_directories(const struct walk_root *roots, size_t num_roots,
+        const struct walk_filter *filter, struct walk *walk)
+{
+    int result = 0;
+    long num_cpus;
+    struct worker *w;
+    struct task task;
+    size_t num_entries;
+    int err;
+
+    num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    Walk.num_workers = num_cpus < 1 ? 1 : num_cpus > WALK_MAX_THREADS ?
+        WALK_MAX_THREADS : num_cpus;
+    Walk.workers = scalloc(Walk.num_workers, sizeof(*Walk.workers));
+    Walk.roots = roots;
+    Walk.filter = filter;
+    Walk.pending = 0;
+    for (unsigned i = 0; i < Walk.num_workers; i++) {
+        w = &Walk.workers[i];
+        pthread_mutex_init(&w->lock, NULL);
+        w->buffer = smalloc(WALK_BUFFER_SIZE);
+    }
+
+    /* the roots are opened here so failures can be counted */
+    for (size_t i = 0; i < num_roots; i++) {
+        task.fd = open(roots[i].path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (task.fd == -1) {
+            LOG("open(%s): %s\n", roots[i].path, strerror(errno));
+            result--;
+            continue;
+        }
+        /* entries of the current directory have no prefix */
+        task.len = strcmp(roots[i].path, ".") == 0 ? 0 : strlen(roots[i].path);
+        task.path = alloc_path(&Walk.workers[0], task.len + 1);
+        memcpy(task.path, roots[i].path, task.len);
+        task.path[task.len] = '\0';
+        task.root = i;
+        Walk.pending++;
+        push_task(&Walk.workers[0], &task);
+    }
+
+    /* the calling thread is the first worker */
+    for (unsigned i = 1; i < Walk.num_workers; i++) {
+        w = &Walk.workers[i];
+        err = pthread_create(&w->thread, NULL, run_worker, w);
+        if (err != 0) {
+            /* the other workers take over its share */
+            LOG("pthread_create: %s\n", strerror(err));
+            continue;
+        }
+        w->running = true;
+    }
+    run_worker(&Walk.workers[0]);
+
+    num_entries = 0;
+    for (unsigned i = 0; i < Walk.num_workers; i++) {
+        w = &Walk.workers[i];
+        if (w->running) {
+            pthread_join(w->thread, NULL);
+        }
+        num_entries += w->num_entries;
+    }
+
+    walk->entries = sreallocarray(NULL, num_entries, sizeof(*walk->entries));
+    walk->num_entries = 0;
+    walk->num_skipped = 0;
+    walk->blocks = NULL;
+    walk->num_blocks = 0;
+    for (unsigned i = 0; i < Walk.num_workers; i++) {
+        w = &Walk.workers[i];
+        walk->num_skipped += w->num_skipped;
+        if (w->num_entries > 0) {
+            memcpy(&walk->entries[walk->num_entries], w->entries,
+                    sizeof(*w->entries) * w->num_entries);
+            walk->num_entries += w->num_entries;
+        }
+        if (w->num_blocks > 0) {
+            walk->blocks = sreallocarray(walk->blocks,
+                    walk->num_blocks + w->num_blocks, sizeof(*walk->blocks));
+            memcpy(&walk->blocks[walk->num_blocks], w->blocks,
+                    sizeof(*w->blocks) * w->num_blocks);
+            walk->num_blocks += w->num_blocks;
+        }
+
+        pthread_mutex_destroy(&w->lock);
+        free(w->tasks);
+        free(w->entries);
+        free(w->blocks);
+        free(w->buffer);
+    }
+    free(Walk.workers);
+    Walk.workers = NULL;
+    Walk.num_workers = 0;
+    return result;
+}
+
+void clear_walk(struct walk *walk)
+{
+    for (size_t i = 0; i < walk->num_blocks; i++) {
+        free(walk->blocks[i]);
+    }
+    free(walk->blocks);
+    free(walk->entries);
+}
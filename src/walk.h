@@ -0,0 +1,91 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include "ignore.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * A directory to start the traversal at.
+ */
+struct walk_root {
+    /// path of the directory, "." is the current directory
+    const char *path;
+    /// whether sub directories are entered
+    bool recursive;
+    /// passed on to all entries found under this root
+    int flags;
+};
+
+/**
+ * Decides which entries `walk_directories()` keeps.
+ */
+struct walk_filter {
+    /// patterns of entries to skip, may be `NULL`
+    const struct ignore *ignore;
+    /// extensions (including the '.') of files to keep, `NULL` keeps all
+    char **exts;
+    /// number of elements in `exts`
+    size_t num_exts;
+};
+
+/**
+ * A regular file found by `walk_directories()`.
+ */
+struct walk_entry {
+    /// relative path of the file, entries of "." have no prefix
+    char *path;
+    /// flags of the root the file was found under
+    int flags;
+    /// index of the root the file was found under
+    size_t root;
+};
+
+/**
+ * The result of `walk_directories()`, the paths of all entries stay valid until
+ * `clear_walk()` is called.
+ */
+struct walk {
+    /// all regular files found, in no particular order
+    struct walk_entry *entries;
+    /// number of elements in `entries`
+    size_t num_entries;
+    /// number of regular files that were skipped because of their extension
+    size_t num_skipped;
+    /// memory blocks the paths are stored in
+    char **blocks;
+    /// number of elements in `blocks`
+    size_t num_blocks;
+};
+
+/**
+ * @brief Finds all regular files within given directories.
+ *
+ * The directories are read by a pool of threads (one for each online
+ * processor), each thread has its own queue of directories left to read and
+ * steals from the others when it runs out. Directories are read with
+ * `getdents64()` into a large buffer and the entries are first gathered per
+ * thread, they are put together in `walk` at the end.
+ *
+ * Entries named "." and ".." are skipped, so are ignored files and directories,
+ * an ignored directory is not even opened. Files without a wanted extension
+ * are only counted.
+ *
+ * @param roots     The directories to start at.
+ * @param num_roots The number of roots.
+ * @param filter    Which entries to keep.
+ * @param walk      Output of the result, it must be cleared with
+ *                  `clear_walk()`.
+ *
+ * @return The negated number of roots that could not be opened.
+ */
+int walk_directories(const struct walk_root *roots, size_t num_roots,
+        const struct walk_filter *filter, struct walk *walk);
+
+/**
+ * @brief Frees all resources of a walk.
+ */
+void clear_walk(struct walk *walk);
+
+#endif
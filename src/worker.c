@@ -0,0 +1,275 @@
+#include "macros.h"
+#include "protocol.h"
+#include "salloc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/*
+ * A compile worker for autocar, it takes preprocessed sources and sends back
+ * the objects (see protocol.h). By default it only listens on localhost, a
+ * client can pass any flags to the compiler, so a worker must only be
+ * reachable within a trusted network.
+ */
+
+/// compilers a client may ask for when none are given with `-a`
+static char *DefaultCompilers[] = { "cc", "gcc", "clang" };
+
+/// compilers a client may ask for
+static char **Compilers = DefaultCompilers;
+/// number of elements in `Compilers`
+static size_t NumCompilers = ARRAY_SIZE(DefaultCompilers);
+
+static void usage(const char *program)
+{
+    printf("usage: %s [-l address] [-p port] [-j jobs] [-a compiler]...\n"
+            "  -l  address to listen on (default: 127.0.0.1)\n"
+            "  -p  port to listen on (default: %d)\n"
+            "  -j  number of compilers running at once (default: number of"
+            " processors)\n"
+            "  -a  allow a compiler, can be given multiple times (default: cc,"
+            " gcc and clang)\n", program, PROTOCOL_PORT);
+}
+
+static bool is_allowed_compiler(const char *name)
+{
+    for (size_t i = 0; i < NumCompilers; i++) {
+        if (strcmp(Compilers[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Runs the compiler with all output going to a file.
+ *
+ * @return The exit status of the compiler.
+ */
+static int run_compiler(char **args, const char *output)
+{
+    int pid;
+    int fd;
+    int wstatus;
+
+    pid = fork();
+    if (pid == -1) {
+        return 127;
+    }
+    if (pid == 0) {
+        fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+            _exit(127);
+        }
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+        execvp(args[0], args);
+        fprintf(stderr, "execvp '%s': %s\n", args[0], strerror(errno));
+        _exit(127);
+    }
+    if (waitpid(pid, &wstatus, 0) == -1) {
+        return 127;
+    }
+    if (WIFEXITED(wstatus)) {
+        return WEXITSTATUS(wstatus);
+    }
+    return 128 + WTERMSIG(wstatus);
+}
+
+/**
+ * @brief Sends the result of a job.
+ */
+static int send_result(int fd, uint32_t status, const char *diag,
+        size_t diag_size, const char *obj, size_t obj_size)
+{
+    if (write_u32(fd, status) == -1 ||
+            write_blob(fd, diag, diag_size) == -1 ||
+            write_blob(fd, obj, obj_size) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads a single job from a client, compiles it and sends back the
+ * result.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int handle_client(int fd)
+{
+    uint32_t magic;
+    uint32_t num_args;
+    char **args;
+    size_t size;
+    char *source = NULL;
+    size_t source_size;
+    char dir[] = "/tmp/autocar-worker.XXXXXX";
+    char *input = NULL, *output = NULL, *diag_path = NULL;
+    char *diag = NULL, *obj = NULL;
+    size_t diag_size = 0, obj_size = 0;
+    int source_fd;
+    int status;
+    int result = -1;
+
+    if (read_u32(fd, &magic) == -1 || magic != PROTOCOL_MAGIC ||
+            read_u32(fd, &num_args) == -1 ||
+            num_args == 0 || num_args > PROTOCOL_MAX_ARGS) {
+        fprintf(stderr, "invalid request\n");
+        return -1;
+    }
+    args = scalloc(num_args + 5, sizeof(*args));
+    for (uint32_t i = 0; i < num_args; i++) {
+        if (read_blob(fd, &args[i], &size) == -1) {
+            goto end;
+        }
+    }
+    if (read_blob(fd, &source, &source_size) == -1) {
+        goto end;
+    }
+
+    if (!is_allowed_compiler(args[0])) {
+        diag = sasprintf("the compiler '%s' is not allowed on this worker\n",
+                args[0]);
+        result = send_result(fd, 127, diag, strlen(diag), NULL, 0);
+        goto end;
+    }
+
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "mkdtemp: %s\n", strerror(errno));
+        goto end;
+    }
+    input = sasprintf("%s/source.i", dir);
+    output = sasprintf("%s/object.o", dir);
+    diag_path = sasprintf("%s/diagnostics", dir);
+
+    source_fd = open(input, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (source_fd == -1 || write_all(source_fd, source, source_size) == -1) {
+        fprintf(stderr, "could not write '%s': %s\n", input, strerror(errno));
+        if (source_fd != -1) {
+            close(source_fd);
+        }
+        goto end;
+    }
+    close(source_fd);
+
+    args[num_args] = (char*) "-c";
+    args[num_args + 1] = input;
+    args[num_args + 2] = (char*) "-o";
+    args[num_args + 3] = output;
+    status = run_compiler(args, diag_path);
+    if (read_file(diag_path, &diag, &diag_size) == -1) {
+        diag = NULL;
+        diag_size = 0;
+    }
+    if (status == 0 && read_file(output, &obj, &obj_size) == -1) {
+        status = 127;
+    }
+    result = send_result(fd, status, diag, diag_size, obj, obj_size);
+
+end:
+    if (input != NULL) {
+        unlink(input);
+        unlink(output);
+        unlink(diag_path);
+        rmdir(dir);
+    }
+    free(input);
+    free(output);
+    free(diag_path);
+    free(diag);
+    free(obj);
+    free(source);
+    for (uint32_t i = 0; i < num_args; i++) {
+        free(args[i]);
+    }
+    free(args);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    const char *address = "127.0.0.1";
+    char port[16];
+    long jobs;
+    int opt;
+    int server, client;
+    long running = 0;
+    int pid;
+
+    snprintf(port, sizeof(port), "%d", PROTOCOL_PORT);
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    while (opt = getopt(argc, argv, "l:p:j:a:h"), opt != -1) {
+        switch (opt) {
+        case 'l':
+            address = optarg;
+            break;
+        case 'p':
+            snprintf(port, sizeof(port), "%s", optarg);
+            break;
+        case 'j':
+            jobs = strtol(optarg, NULL, 0);
+            break;
+        case 'a':
+            if (Compilers == DefaultCompilers) {
+                Compilers = NULL;
+                NumCompilers = 0;
+            }
+            Compilers = sreallocarray(Compilers, NumCompilers + 1,
+                    sizeof(*Compilers));
+            Compilers[NumCompilers++] = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (jobs < 1) {
+        jobs = 1;
+    }
+
+    server = listen_on(address, port);
+    if (server == -1) {
+        return 1;
+    }
+    fprintf(stderr, "listening on %s:%s with %ld jobs\n", address, port, jobs);
+
+    for (;;) {
+        while (waitpid(-1, NULL, running >= jobs ? 0 : WNOHANG) > 0) {
+            running--;
+        }
+        client = accept4(server, NULL, NULL, SOCK_CLOEXEC);
+        if (client == -1) {
+            if (errno != EINTR) {
+                fprintf(stderr, "accept: %s\n", strerror(errno));
+            }
+            continue;
+        }
+        /* every job gets its own process, so a crashing compile or a broken
+         * client does not take the worker down */
+        pid = fork();
+        if (pid == 0) {
+            close(server);
+            _exit(handle_client(client) == 0 ? 0 : 1);
+        }
+        if (pid == -1) {
+            fprintf(stderr, "fork: %s\n", strerror(errno));
+        } else {
+            running++;
+        }
+        close(client);
+    }
+}